@@ -1,30 +1,71 @@
 #version 450
 
+// Variant defines, see the Makefile
+#define NORMAL_MODE_DERIVATIVE 0
+#define NORMAL_MODE_VERTEX 1
+
+#define LIGHTING_BASIC 0
+#define LIGHTING_SPECULAR 1
+
+#ifndef NORMAL_MODE
+#define NORMAL_MODE NORMAL_MODE_DERIVATIVE
+#endif
+
+#ifndef LIGHTING
+#define LIGHTING LIGHTING_BASIC
+#endif
+
 layout(location = 0) in vec3 world_pos;
 layout(location = 1) in vec2 uv;
+#if NORMAL_MODE == NORMAL_MODE_VERTEX
+layout(location = 2) in vec3 vertex_normal;
+#endif
+layout(location = 3) flat in vec4 material;
 
 layout(binding = 0, set = 2) uniform sampler2D noise;
 
-layout(location = 0) out vec4 final_color;
+// Fragment uniform buffers live in set 3
+layout(binding = 0, set = 3) uniform FragmentUniform
+{
+    vec4 sun_dir;
+    vec4 sun_color;
+    vec4 camera_pos;
+} frag;
 
-vec3 sun_dir = normalize(vec3(1, 2, 3));
-vec3 sun_color = vec3(1.2, 1.2, 1.2);
+layout(location = 0) out vec4 final_color;
 
 void main()
 {
+#if NORMAL_MODE == NORMAL_MODE_VERTEX
+    vec3 n = normalize(vertex_normal);
+#else
     vec3 pos_dx = dFdxFine(world_pos);
     vec3 pos_dy = dFdyFine(world_pos);
     vec3 n = normalize(cross(pos_dx, pos_dy));
     n.y *= -1;
+#endif
 
-    vec3 water_color = vec3(0.2, 0.3, 0.4);
+    vec3 water_color = material.rgb;
     
     // float noise_sample = texture(noise, uv).r;
     // final_color = vec4(vec3(noise_sample), 1);
     // final_color = vec4(uv, 0, 1);
 
+    vec3 sun_dir = frag.sun_dir.xyz;
+    vec3 sun_color = frag.sun_color.rgb;
+
     vec3 light = vec3(0.1);
     light += clamp(dot(sun_dir, n), 0, 1) * sun_color; 
 
-    final_color = vec4(water_color * light, 1);
+    vec3 color = water_color * light;
+
+#if LIGHTING == LIGHTING_SPECULAR
+    vec3 view_dir = normalize(frag.camera_pos.xyz - world_pos);
+    vec3 half_dir = normalize(view_dir + sun_dir);
+    float fresnel = pow(1 - clamp(dot(view_dir, n), 0, 1), 5);
+    color += pow(clamp(dot(n, half_dir), 0, 1), 64) * sun_color;
+    color = mix(color, vec3(0.6, 0.7, 0.8), fresnel * 0.5);
+#endif
+
+    final_color = vec4(color, 1);
 }
@@ -1,5 +1,17 @@
 #version 450
 
+// Variant defines, see the Makefile
+#define NORMAL_MODE_DERIVATIVE 0
+#define NORMAL_MODE_VERTEX 1
+
+#ifndef OCTAVE_COUNT
+#define OCTAVE_COUNT 4
+#endif
+
+#ifndef NORMAL_MODE
+#define NORMAL_MODE NORMAL_MODE_DERIVATIVE
+#endif
+
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec2 in_uv;
@@ -10,33 +22,68 @@ layout(binding = 0, set = 0) uniform sampler2D noise;
 // Was fun figuring that out...
 layout(binding = 0, set = 1) uniform GlobalUniform 
 {
-    mat4 projection;
-    mat4 view;
+    mat4 view_projection;
     float time;
 } global;
 
+// Storage buffers come after the samplers in set 0. One entry per object,
+// indexed by the instance, see uniforms.cpp
+struct ObjectData
+{
+    mat4 model;
+    vec4 material;
+};
+
+layout(std430, binding = 1, set = 0) readonly buffer ObjectBuffer
+{
+    ObjectData objects[];
+};
+
 layout(location = 0) out vec3 out_world_pos;
 layout(location = 1) out vec2 out_uv;
+#if NORMAL_MODE == NORMAL_MODE_VERTEX
+layout(location = 2) out vec3 out_normal;
+#endif
+layout(location = 3) flat out vec4 out_material;
 
-float NoiseLayer(vec3 world_pos, float value)
+float NoiseLayer(vec2 world_xz, float value)
 {
-    vec2 noise_position = (world_pos.xz * 0.1 + vec2(global.time * 0.01)) * value;
+    vec2 noise_position = (world_xz * 0.1 + vec2(global.time * 0.01)) * value;
     float noise_sample = texture(noise, noise_position).r * 2 - 1;
     return 0.2 / value * noise_sample;
 }
 
+float WaterHeight(vec2 world_xz)
+{
+    float y_offset = 0;
+    float value = 1;
+    for (int i = 0; i < OCTAVE_COUNT; ++i)
+    {
+        y_offset += NoiseLayer(world_xz, value);
+        value *= 2;
+    }
+    return y_offset;
+}
+
 void main()
 {
-    vec3 world_pos = in_position;
+    ObjectData object = objects[gl_InstanceIndex];
+    vec3 world_pos = (object.model * vec4(in_position, 1)).xyz;
 
-    float y_offset = 0;
-    y_offset += NoiseLayer(world_pos, 1);
-    y_offset += NoiseLayer(world_pos, 2);
-    y_offset += NoiseLayer(world_pos, 4);
-    y_offset += NoiseLayer(world_pos, 8);
+    float y_offset = WaterHeight(world_pos.xz);
+    world_pos.y += y_offset;
 
-    gl_Position = global.projection * global.view * vec4(in_position + vec3(0, y_offset, 0), 1);
+    gl_Position = global.view_projection * vec4(world_pos, 1);
 
     out_uv = in_uv;
-    out_world_pos = vec3(world_pos.x, world_pos.y + y_offset, world_pos.z);
+    out_world_pos = world_pos;
+    out_material = object.material;
+
+#if NORMAL_MODE == NORMAL_MODE_VERTEX
+    // Cheaper per pixel than screen space derivatives, but only as smooth as the mesh.
+    float epsilon = 0.01;
+    float dx = WaterHeight(world_pos.xz + vec2(epsilon, 0)) - y_offset;
+    float dz = WaterHeight(world_pos.xz + vec2(0, epsilon)) - y_offset;
+    out_normal = normalize(vec3(-dx, epsilon, -dz));
+#endif
 }
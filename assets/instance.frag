@@ -0,0 +1,30 @@
+#version 450
+
+layout(location = 0) in vec3 world_pos;
+layout(location = 1) in vec3 normal;
+
+// Fragment uniform buffers live in set 3
+layout(binding = 0, set = 3) uniform FragmentUniform
+{
+    vec4 sun_dir;
+    vec4 sun_color;
+    vec4 camera_pos;
+} frag;
+
+// Pushed once per batch
+layout(binding = 1, set = 3) uniform InstanceMaterial
+{
+    vec4 color;
+} material;
+
+layout(location = 0) out vec4 final_color;
+
+void main()
+{
+    vec3 n = normalize(normal);
+
+    vec3 light = vec3(0.1);
+    light += clamp(dot(frag.sun_dir.xyz, n), 0, 1) * frag.sun_color.rgb;
+
+    final_color = vec4(material.color.rgb * light, 1);
+}
@@ -0,0 +1,36 @@
+#version 450
+
+// Instanced path for floating objects, see code/instancing.cpp
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_uv;
+
+// Per instance (slot 1, SDL_GPU_VERTEXINPUTRATE_INSTANCE), matches entity_instance
+layout(location = 3) in vec4 in_position_scale;
+layout(location = 4) in vec4 in_rotation;
+
+layout(binding = 0, set = 1) uniform GlobalUniform 
+{
+    mat4 view_projection;
+    float time;
+} global;
+
+layout(location = 0) out vec3 out_world_pos;
+layout(location = 1) out vec3 out_normal;
+
+vec3 Rotate(vec4 q, vec3 v)
+{
+    vec3 t = 2 * cross(q.xyz, v);
+    return v + q.w * t + cross(q.xyz, t);
+}
+
+void main()
+{
+    vec3 world_pos = Rotate(in_rotation, in_position * in_position_scale.w) + in_position_scale.xyz;
+
+    gl_Position = global.view_projection * vec4(world_pos, 1);
+
+    out_world_pos = world_pos;
+    out_normal = Rotate(in_rotation, in_normal);
+}
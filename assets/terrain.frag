@@ -0,0 +1,31 @@
+#version 450
+
+layout(location = 0) in vec3 world_pos;
+layout(location = 1) in float height;
+
+// Fragment uniform buffers live in set 3
+layout(binding = 0, set = 3) uniform FragmentUniform
+{
+    vec4 sun_dir;
+    vec4 sun_color;
+    vec4 camera_pos;
+} frag;
+
+layout(location = 0) out vec4 final_color;
+
+void main()
+{
+    vec3 pos_dx = dFdxFine(world_pos);
+    vec3 pos_dy = dFdyFine(world_pos);
+    vec3 n = normalize(cross(pos_dx, pos_dy));
+    n.y *= -1;
+
+    vec3 low = vec3(0.76, 0.7, 0.5);
+    vec3 high = vec3(0.35, 0.4, 0.3);
+    vec3 albedo = mix(low, high, smoothstep(0.4, 0.7, height));
+
+    vec3 light = vec3(0.1);
+    light += clamp(dot(frag.sun_dir.xyz, n), 0, 1) * frag.sun_color.rgb;
+
+    final_color = vec4(albedo * light, 1);
+}
@@ -0,0 +1,76 @@
+#version 450
+
+// Streamed heightfield, see code/heightfield.cpp
+// Heights are looked up through the page table: one mip per level, one texel
+// per tile, naming the atlas page that holds it (or the closest resident tile
+// above it).
+
+#define TILE_SIZE 128.0
+#define BORDER 1.0
+#define PAGE_SIZE (TILE_SIZE + 2.0 * BORDER)
+
+layout(location = 0) in vec3 in_position;
+
+layout(binding = 0, set = 0) uniform sampler2D atlas;
+layout(binding = 1, set = 0) uniform sampler2D page_table;
+
+layout(binding = 0, set = 1) uniform GlobalUniform 
+{
+    mat4 view_projection;
+    float time;
+} global;
+
+// Matches terrain_uniforms
+layout(binding = 1, set = 1) uniform TerrainUniform
+{
+    vec4 origin;
+    vec4 params;
+    vec4 grid;
+} terrain;
+
+layout(location = 0) out vec3 out_world_pos;
+layout(location = 1) out float out_height;
+
+// position in level 0 samples
+float Height(vec2 position, int level)
+{
+    ivec2 tiles = textureSize(page_table, level);
+    ivec2 tile = clamp(ivec2(floor(position / (TILE_SIZE * exp2(float(level))))), ivec2(0), tiles - 1);
+    vec4 entry = round(texelFetch(page_table, tile, level) * 255);
+
+    // The page may belong to a coarser level.
+    float resident = entry.z;
+    float resident_size = exp2(resident);
+    ivec2 resident_tiles = textureSize(page_table, int(resident));
+    vec2 resident_tile = clamp(floor(position / (TILE_SIZE * resident_size)), vec2(0), vec2(resident_tiles - 1));
+
+    // Level samples sit at the center of their footprint. The border keeps
+    // bilinear filtering inside the page.
+    vec2 texel = position / resident_size - 0.5 - resident_tile * TILE_SIZE;
+    texel = clamp(texel, vec2(-0.5), vec2(TILE_SIZE - 0.5));
+    vec2 uv = (entry.xy * PAGE_SIZE + BORDER + texel + 0.5) / (terrain.params.z * PAGE_SIZE);
+    return textureLod(atlas, uv, 0).r;
+}
+
+void main()
+{
+    // Snapped to the grid spacing so vertices don't swim as the camera moves.
+    vec2 center = floor(terrain.origin.xy / terrain.grid.y) * terrain.grid.y;
+    vec2 position = center + in_position.xz * terrain.grid.x;
+
+    // The streamer keeps origin.w tiles around the camera on every level, use
+    // the finest level that is guaranteed to cover this vertex.
+    float camera_distance = length(position - terrain.origin.xy);
+    float level = ceil(log2(max(camera_distance / (terrain.origin.w * TILE_SIZE), 1.0)));
+    level = min(level, terrain.params.w - 1);
+
+    float height = Height(position, int(level));
+    vec3 world_pos = vec3((position.x - terrain.origin.x) * terrain.params.x,
+                          height * terrain.params.y + terrain.origin.z,
+                          (position.y - terrain.origin.y) * terrain.params.x);
+
+    gl_Position = global.view_projection * vec4(world_pos, 1);
+
+    out_world_pos = world_pos;
+    out_height = height;
+}
@@ -0,0 +1,1134 @@
+// CPU benchmarks, run with `sdltest --bench`. No window or GPU device needed.
+
+// Keeps the compiler from throwing away loops that only read memory.
+volatile f32 BenchmarkSink;
+
+f64 GetSeconds()
+{
+    return (f64) SDL_GetPerformanceCounter() / (f64) SDL_GetPerformanceFrequency();
+}
+
+void BenchmarkEntities()
+{
+    printf("entities:\n");
+
+    u8 *NoiseData = (u8 *) SDL_malloc(NOISE_SIZE * NOISE_SIZE);
+    BakeNoise(NoiseData, 0);
+
+    u32 Counts[] = { 10000, 100000, 1000000 };
+    for (u32 CountIndex = 0; CountIndex < SDL_arraysize(Counts); ++CountIndex)
+    {
+        u32 Count = Counts[CountIndex];
+        u32 Repeats = SDL_max(1u, 2000000u / Count);
+        u32 Random = 0x1234567;
+
+        entity_store Store;
+        InitEntityStore(&Store);
+
+        f64 Start = GetSeconds();
+        SpawnEntities(&Store, Count, 10, &Random);
+        f64 SpawnTime = GetSeconds() - Start;
+
+        // Plain read over one column of every archetype.
+        f32 Sum = 0;
+        Start = GetSeconds();
+        for (u32 Repeat = 0; Repeat < Repeats; ++Repeat)
+        {
+            for (u32 Kind = 0; Kind < Archetype_Count; ++Kind)
+            {
+                archetype *Archetype = Store.Archetypes + Kind;
+                f32 *PositionX = Archetype->Columns[Field_PositionX];
+                for (u32 I = 0; I < Archetype->Count; ++I)
+                {
+                    Sum += PositionX[I];
+                }
+            }
+        }
+        f64 IterateTime = (GetSeconds() - Start) / Repeats;
+        BenchmarkSink = Sum;
+
+        f32 Time = 0;
+        Start = GetSeconds();
+        for (u32 Repeat = 0; Repeat < Repeats; ++Repeat)
+        {
+            Time += 1.0f / 60.0f;
+            UpdateEntities(&Store, NoiseData, 4, Time, 1.0f / 60.0f);
+        }
+        f64 UpdateTime = (GetSeconds() - Start) / Repeats;
+
+        entity_instance *Instances = (entity_instance *) SDL_malloc(sizeof(entity_instance) * Count);
+        Start = GetSeconds();
+        for (u32 Repeat = 0; Repeat < Repeats; ++Repeat)
+        {
+            FillEntityInstances(&Store, Instances, NULL);
+        }
+        f64 FillTime = (GetSeconds() - Start) / Repeats;
+
+        // Destroy and recreate 10% to check handle churn.
+        u32 ChurnCount = Count / 10;
+        entity_handle *Handles = (entity_handle *) SDL_malloc(sizeof(entity_handle) * ChurnCount);
+        for (u32 I = 0; I < ChurnCount; ++I)
+        {
+            Handles[I] = { I * 10, 1 };
+        }
+        Start = GetSeconds();
+        for (u32 I = 0; I < ChurnCount; ++I)
+        {
+            DestroyEntity(&Store, Handles[I]);
+        }
+        SpawnEntities(&Store, ChurnCount, 10, &Random);
+        f64 ChurnTime = GetSeconds() - Start;
+
+        for (u32 I = 0; I < ChurnCount; ++I)
+        {
+            assert(!IsEntityAlive(&Store, Handles[I]));
+        }
+        assert(Store.EntityCount == Count);
+
+        printf("  %8u | spawn %7.2f ms | iterate %6.3f ns/entity | update %7.2f ms (%6.2f M/s) | fill %6.2f ms | churn 10%% %6.2f ms\n",
+               Count, SpawnTime * 1000, IterateTime * 1e9 / Count,
+               UpdateTime * 1000, Count / UpdateTime / 1e6, FillTime * 1000, ChurnTime * 1000);
+
+        SDL_free(Handles);
+        SDL_free(Instances);
+        FreeEntityStore(&Store);
+    }
+
+    SDL_free(NoiseData);
+}
+
+// Encodes a noise heightfield (BC4) and a palette coloured version of it
+// (BC1, BC7), decodes them again and reports throughput and error.
+void BenchmarkTextureCompression()
+{
+    printf("texture compression:\n");
+
+    u32 Size = 2048;
+    u32 PixelCount = Size * Size;
+    u8 *Gray = (u8 *) SDL_malloc(PixelCount);
+    u8 *Color = (u8 *) SDL_malloc(PixelCount * 4);
+    u8 *Decoded = (u8 *) SDL_malloc(PixelCount * 4);
+    u8 *Blocks = (u8 *) SDL_malloc(CompressedSize(Codec_BC7, Size, Size));
+
+    for (u32 Y = 0; Y < Size; ++Y)
+    {
+        for (u32 X = 0; X < Size; ++X)
+        {
+            f32 Noise = stb_perlin_fbm_noise3((f32) X / 128.0f, (f32) Y / 128.0f, 0, 2, 0.5f, 6);
+            f32 Value = SDL_clamp(Noise * 0.5f + 0.5f, 0.0f, 1.0f);
+            u32 Index = X + Y * Size;
+            Gray[Index] = (u8) (Value * 255);
+
+            // Water to sand to grass, roughly what a colour scheme texture looks like.
+            Color[Index * 4 + 0] = (u8) (SDL_clamp(Value * 2 - 0.6f, 0.0f, 1.0f) * 200 + 30);
+            Color[Index * 4 + 1] = (u8) (Value * 160 + 60);
+            Color[Index * 4 + 2] = (u8) ((1 - Value) * 180 + 40);
+            Color[Index * 4 + 3] = 255;
+        }
+    }
+
+    texture_codec Codecs[] = { Codec_BC4, Codec_BC1, Codec_BC7 };
+    for (u32 I = 0; I < SDL_arraysize(Codecs); ++I)
+    {
+        texture_codec Codec = Codecs[I];
+        u32 Channels = CodecChannels(Codec);
+        u8 *Source = Channels == 1 ? Gray : Color;
+        u32 SourceBytes = PixelCount * Channels;
+        u32 Repeats = 4;
+
+        f64 Start = GetSeconds();
+        for (u32 Repeat = 0; Repeat < Repeats; ++Repeat)
+        {
+            CompressTexture(Codec, Source, Size, Size, Blocks);
+        }
+        f64 EncodeTime = (GetSeconds() - Start) / Repeats;
+
+        DecompressTexture(Codec, Blocks, Size, Size, Decoded);
+        f64 RMSE = TextureRMSE(Source, Decoded, SourceBytes);
+        f64 PSNR = RMSE > 0 ? 20 * log10(255.0 / RMSE) : 99;
+
+        printf("  %s %ux%u | %5.1f:1 | encode %7.2f ms (%7.2f MPixel/s) | RMSE %5.2f | PSNR %5.2f dB\n",
+               CodecNames[Codec], Size, Size, (f64) SourceBytes / CompressedSize(Codec, Size, Size),
+               EncodeTime * 1000, PixelCount / EncodeTime / 1e6, RMSE, PSNR);
+    }
+
+    SDL_free(Blocks);
+    SDL_free(Decoded);
+    SDL_free(Color);
+    SDL_free(Gray);
+}
+
+// A grid of separately built planes, so every tile edge has duplicate seam
+// vertices, like meshes combined from parts. Seams are jittered a bit so the
+// weld has to go by distance rather than exact matches.
+void BenchmarkMesh()
+{
+    printf("mesh processing:\n");
+
+    // Welding is transitive: a chain of gaps under the distance collapses into
+    // one vertex even though its ends are far apart, whatever the index order.
+    {
+        f32 ChainX[] = { 2.7f, 0.0f, 5.0f, 1.8f, 0.9f };
+        vertex ChainVertices[SDL_arraysize(ChainX)] = {};
+        for (u32 I = 0; I < SDL_arraysize(ChainX); ++I)
+        {
+            ChainVertices[I].Position = V3(ChainX[I], 0, 0);
+        }
+        u32 ChainIndices[] = { 0, 1, 2, 2, 3, 4 };
+
+        mesh Chain = {};
+        Chain.Vertices = ChainVertices;
+        Chain.VertexCount = SDL_arraysize(ChainVertices);
+        Chain.Indices = ChainIndices;
+        Chain.IndexCount = SDL_arraysize(ChainIndices);
+        WeldVertices(&Chain, 1.0f);
+        assert(Chain.VertexCount == 2);
+        assert(Chain.Vertices[0].Position.X == 2.7f && Chain.Vertices[1].Position.X == 5.0f);
+        assert(ChainIndices[0] == 0 && ChainIndices[1] == 0 && ChainIndices[2] == 1 && ChainIndices[4] == 0);
+    }
+
+    i32 Segments = 32;
+    u32 TileVertexCount = (2 * Segments + 1) * (2 * Segments + 1);
+    u32 TileIndexCount = 2 * Segments * 2 * Segments * 6;
+
+    u32 TileCounts[] = { 16, 24 };
+    for (u32 CountIndex = 0; CountIndex < SDL_arraysize(TileCounts); ++CountIndex)
+    {
+        u32 Tiles = TileCounts[CountIndex];
+        u32 Random = 0x1234567;
+
+        mesh Mesh = {};
+        Mesh.Vertices = (vertex *) SDL_malloc(sizeof(vertex) * TileVertexCount * Tiles * Tiles);
+        Mesh.Indices = (u32 *) SDL_malloc(sizeof(u32) * TileIndexCount * Tiles * Tiles);
+
+        for (u32 TileZ = 0; TileZ < Tiles; ++TileZ)
+        {
+            for (u32 TileX = 0; TileX < Tiles; ++TileX)
+            {
+                vertex *Vertices = Mesh.Vertices + Mesh.VertexCount;
+                u32 *Indices = Mesh.Indices + Mesh.IndexCount;
+                u32 VertexCount;
+                u32 IndexCount;
+                BuildPlane(Segments, Vertices, &VertexCount, Indices, &IndexCount);
+
+                for (u32 I = 0; I < VertexCount; ++I)
+                {
+                    v3 *P = &Vertices[I].Position;
+                    P->X += 2.0f * TileX + RandomBilateral(&Random) * 1e-5f;
+                    P->Z += 2.0f * TileZ + RandomBilateral(&Random) * 1e-5f;
+                    P->Y = 0.2f * sinf(P->X * 0.7f) * cosf(P->Z * 0.5f);
+                }
+                for (u32 I = 0; I < IndexCount; ++I)
+                {
+                    Indices[I] += Mesh.VertexCount;
+                }
+
+                Mesh.VertexCount += VertexCount;
+                Mesh.IndexCount += IndexCount;
+            }
+        }
+
+        u32 VertexCount = Mesh.VertexCount;
+
+        f64 Start = GetSeconds();
+        u32 Welded = WeldVertices(&Mesh, 1e-4f);
+        f64 WeldTime = GetSeconds() - Start;
+
+        u32 ExpectedCount = (Tiles * 2 * Segments + 1) * (Tiles * 2 * Segments + 1);
+        assert(Mesh.VertexCount == ExpectedCount);
+
+        Start = GetSeconds();
+        u32 Degenerates = RemoveDegenerateTriangles(&Mesh, 1e-10f);
+        f64 DegenerateTime = GetSeconds() - Start;
+
+        Start = GetSeconds();
+        RecomputeNormals(&Mesh);
+        f64 NormalTime = GetSeconds() - Start;
+
+        Start = GetSeconds();
+        FlipFaces(&Mesh);
+        f64 FlipTime = GetSeconds() - Start;
+
+        // NOTE: BuildPlane winds clockwise seen from above, so the recomputed
+        // normals point down and the flipped ones up.
+        for (u32 I = 0; I < Mesh.VertexCount; ++I)
+        {
+            assert(Mesh.Vertices[I].Normal.Y > 0);
+        }
+
+        printf("  %8u verts | weld %7.2f ms (%6.2f M/s, %u merged) | degenerates %6.2f ms (%u) | normals %7.2f ms | flip %6.2f ms\n",
+               VertexCount, WeldTime * 1000, VertexCount / WeldTime / 1e6, Welded,
+               DegenerateTime * 1000, Degenerates, NormalTime * 1000, FlipTime * 1000);
+
+        SDL_free(Mesh.Indices);
+        SDL_free(Mesh.Vertices);
+    }
+}
+
+// Writes an N x N grid as OBJ (quads, so the fan triangulation runs too) and
+// as GLB, then times OpenMeshFile + DecodeMeshFile. The files were just
+// written, so this measures parsing out of the page cache, not the disk.
+u64 WriteBenchmarkObj(const char *Path, u32 N)
+{
+    u64 Capacity = (u64) N * N * 256;
+    char *Text = (char *) SDL_malloc(Capacity);
+    u64 Size = 0;
+
+    for (u32 Z = 0; Z < N; ++Z)
+    {
+        for (u32 X = 0; X < N; ++X)
+        {
+            f32 U = (f32) X / (N - 1);
+            f32 V = (f32) Z / (N - 1);
+            f32 Height = 0.2f * sinf(U * 20) * cosf(V * 14);
+            Size += SDL_snprintf(Text + Size, Capacity - Size, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0.000000 1.000000 0.000000\n",
+                                 U * 10 - 5, Height, V * 10 - 5, U, V);
+        }
+    }
+
+    for (u32 Z = 0; Z + 1 < N; ++Z)
+    {
+        for (u32 X = 0; X + 1 < N; ++X)
+        {
+            u32 A = X + Z * N + 1;
+            u32 B = A + N;
+            Size += SDL_snprintf(Text + Size, Capacity - Size, "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n",
+                                 A, A, A, B, B, B, B + 1, B + 1, B + 1, A + 1, A + 1, A + 1);
+        }
+    }
+
+    SDL_IOStream *Stream = SDL_IOFromFile(Path, "wb");
+    SDL_WriteIO(Stream, Text, Size);
+    SDL_CloseIO(Stream);
+    SDL_free(Text);
+    return Size;
+}
+
+u64 WriteBenchmarkGlb(const char *Path, u32 N)
+{
+    u32 VertexCount = N * N;
+    u32 IndexCount = (N - 1) * (N - 1) * 6;
+    u32 PositionBytes = VertexCount * 12;
+    u32 UVBytes = VertexCount * 8;
+    u32 IndexBytes = IndexCount * 4;
+    u32 BinSize = PositionBytes * 2 + UVBytes + IndexBytes;
+
+    char Json[2048];
+    u32 JsonSize = SDL_snprintf(Json, sizeof(Json),
+        "{\"asset\":{\"version\":\"2.0\"},\"buffers\":[{\"byteLength\":%u}],"
+        "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%u},{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u},"
+        "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u},{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u}],"
+        "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+        "{\"bufferView\":1,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+        "{\"bufferView\":2,\"componentType\":5126,\"count\":%u,\"type\":\"VEC2\"},"
+        "{\"bufferView\":3,\"componentType\":5125,\"count\":%u,\"type\":\"SCALAR\"}],"
+        "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3}]}]}",
+        BinSize, PositionBytes, PositionBytes, PositionBytes, PositionBytes * 2, UVBytes,
+        PositionBytes * 2 + UVBytes, IndexBytes, VertexCount, VertexCount, VertexCount, IndexCount);
+    u32 PaddedJsonSize = (JsonSize + 3) & ~3u;
+    SDL_memset(Json + JsonSize, ' ', PaddedJsonSize - JsonSize);
+
+    u64 Size = 12 + 8 + PaddedJsonSize + 8 + BinSize;
+    u8 *Data = (u8 *) SDL_malloc(Size);
+    u32 Header[5] = { GLB_MAGIC, 2, (u32) Size, PaddedJsonSize, GLB_CHUNK_JSON };
+    SDL_memcpy(Data, Header, sizeof(Header));
+    SDL_memcpy(Data + 20, Json, PaddedJsonSize);
+    u32 BinHeader[2] = { BinSize, GLB_CHUNK_BIN };
+    SDL_memcpy(Data + 20 + PaddedJsonSize, BinHeader, sizeof(BinHeader));
+
+    f32 *Positions = (f32 *) (Data + 28 + PaddedJsonSize);
+    f32 *Normals = Positions + VertexCount * 3;
+    f32 *UVs = Normals + VertexCount * 3;
+    u32 *Indices = (u32 *) (UVs + VertexCount * 2);
+
+    for (u32 Z = 0; Z < N; ++Z)
+    {
+        for (u32 X = 0; X < N; ++X)
+        {
+            u32 I = X + Z * N;
+            f32 U = (f32) X / (N - 1);
+            f32 V = (f32) Z / (N - 1);
+            Positions[I * 3 + 0] = U * 10 - 5;
+            Positions[I * 3 + 1] = 0.2f * sinf(U * 20) * cosf(V * 14);
+            Positions[I * 3 + 2] = V * 10 - 5;
+            Normals[I * 3 + 0] = 0;
+            Normals[I * 3 + 1] = 1;
+            Normals[I * 3 + 2] = 0;
+            UVs[I * 2 + 0] = U;
+            UVs[I * 2 + 1] = V;
+        }
+    }
+
+    for (u32 Z = 0; Z + 1 < N; ++Z)
+    {
+        for (u32 X = 0; X + 1 < N; ++X)
+        {
+            u32 A = X + Z * N;
+            u32 B = A + N;
+            u32 Quad[6] = { A, B, B + 1, A, B + 1, A + 1 };
+            SDL_memcpy(Indices, Quad, sizeof(Quad));
+            Indices += 6;
+        }
+    }
+
+    SDL_IOStream *Stream = SDL_IOFromFile(Path, "wb");
+    SDL_WriteIO(Stream, Data, Size);
+    SDL_CloseIO(Stream);
+    SDL_free(Data);
+    return Size;
+}
+
+void BenchmarkMeshImport()
+{
+    printf("mesh import:\n");
+
+    const char *Paths[] = { "import_benchmark.obj", "import_benchmark.glb" };
+    u32 Sizes[] = { 128, 512, 1024 };
+
+    for (u32 SizeIndex = 0; SizeIndex < SDL_arraysize(Sizes); ++SizeIndex)
+    {
+        u32 N = Sizes[SizeIndex];
+
+        for (u32 Format = 0; Format < SDL_arraysize(Paths); ++Format)
+        {
+            const char *Path = Paths[Format];
+            u64 FileSize = Format == 0 ? WriteBenchmarkObj(Path, N) : WriteBenchmarkGlb(Path, N);
+
+            f64 Start = GetSeconds();
+            mesh_file File;
+            bool Opened = OpenMeshFile(&File, Path);
+            f64 OpenTime = GetSeconds() - Start;
+            assert(Opened);
+
+            vertex *Vertices = (vertex *) SDL_malloc(sizeof(vertex) * File.VertexCount);
+            u32 *Indices = (u32 *) SDL_malloc(sizeof(u32) * File.IndexCount);
+            u8 *Scratch = (u8 *) SDL_aligned_alloc(MESH_SCRATCH_ALIGN, SDL_max(File.ScratchSize, 1));
+
+            Start = GetSeconds();
+            mesh Mesh;
+            bool Decoded = DecodeMeshFile(&File, Vertices, Indices, Scratch, &Mesh);
+            f64 DecodeTime = GetSeconds() - Start;
+            assert(Decoded);
+            assert(Mesh.VertexCount == N * N);
+            assert(Mesh.IndexCount == (N - 1) * (N - 1) * 6);
+
+            SDL_aligned_free(Scratch);
+            CloseMeshFile(&File);
+            SDL_RemovePath(Path);
+
+            f64 Total = OpenTime + DecodeTime;
+            printf("  %s %8.2f MB | %8u verts | open %7.2f ms | decode %8.2f ms | %7.1f MB/s\n",
+                   Format == 0 ? "obj" : "glb", FileSize / 1e6, Mesh.VertexCount,
+                   OpenTime * 1000, DecodeTime * 1000, FileSize / Total / 1e6);
+
+            SDL_free(Indices);
+            SDL_free(Vertices);
+        }
+    }
+}
+
+// Random boxes on a large water surface, seen from a camera just above it.
+// Checks the BVH against testing every box and compares the timings.
+void BenchmarkCulling()
+{
+    printf("culling:\n");
+
+    mat4 ViewProjection = Multiply(Perspective(Radians(50), 16.0f / 9.0f, 0.01, 1000),
+                                   LookAt(V3(0, 2, 0), V3(10, 0, 10), V3(0, 1, 0)));
+    frustum Frustum = ExtractFrustum(ViewProjection);
+
+    u32 Counts[] = { 1000, 10000, 100000, 1000000 };
+    for (u32 CountIndex = 0; CountIndex < SDL_arraysize(Counts); ++CountIndex)
+    {
+        u32 Count = Counts[CountIndex];
+        u32 Repeats = SDL_max(1u, 1000000u / Count);
+        u32 Random = 0x1234567;
+        f32 Extent = SDL_sqrtf((f32) Count) * 2;
+
+        aabb *Bounds = (aabb *) SDL_malloc(sizeof(aabb) * Count);
+        for (u32 I = 0; I < Count; ++I)
+        {
+            v3 Center = V3(RandomBilateral(&Random) * Extent, RandomBilateral(&Random), RandomBilateral(&Random) * Extent);
+            v3 Size = V3(0.5f + RandomUnilateral(&Random), 0.5f, 0.5f + RandomUnilateral(&Random));
+            aabb Box = { V3(Center.X - Size.X, Center.Y - Size.Y, Center.Z - Size.Z),
+                         V3(Center.X + Size.X, Center.Y + Size.Y, Center.Z + Size.Z) };
+            Bounds[I] = InflateBounds(Box, V3(0, MaxWaterDisplacement(4), 0));
+        }
+
+        f64 Start = GetSeconds();
+        cull_bvh Bvh;
+        BuildCullBvh(&Bvh, Bounds, Count);
+        f64 BuildTime = GetSeconds() - Start;
+
+        u32 *Visible = (u32 *) SDL_malloc(sizeof(u32) * Count);
+        u32 *Reference = (u32 *) SDL_malloc(sizeof(u32) * Count);
+
+        u32 ReferenceCount = 0;
+        Start = GetSeconds();
+        for (u32 Repeat = 0; Repeat < Repeats; ++Repeat)
+        {
+            ReferenceCount = CullBoxes(Bounds, Count, &Frustum, Reference);
+        }
+        f64 BoxesTime = (GetSeconds() - Start) / Repeats;
+
+        cull_stats Stats = {};
+        u32 VisibleCount = 0;
+        Start = GetSeconds();
+        for (u32 Repeat = 0; Repeat < Repeats; ++Repeat)
+        {
+            VisibleCount = CullBvh(&Bvh, &Frustum, Visible, &Stats);
+        }
+        f64 BvhTime = (GetSeconds() - Start) / Repeats;
+
+        // Same set, CullBoxes already returns it sorted.
+        SDL_qsort(Visible, VisibleCount, sizeof(u32), CompareU32);
+        assert(VisibleCount == ReferenceCount);
+        assert(SDL_memcmp(Visible, Reference, sizeof(u32) * VisibleCount) == 0);
+
+        printf("  %7u boxes | %6u visible | build %7.3f ms | per box %7.3f ms | bvh %7.3f ms, %u nodes\n",
+               Count, VisibleCount, BuildTime * 1000, BoxesTime * 1000, BvhTime * 1000, Stats.NodesVisited);
+
+        FreeCullBvh(&Bvh);
+        SDL_free(Reference);
+        SDL_free(Visible);
+        SDL_free(Bounds);
+    }
+}
+
+// Pushing instances of 3 meshes x 3 materials in random order and sorting
+// them into batches, which is the CPU side of the instanced path.
+void BenchmarkInstanceBatching()
+{
+    printf("instance batching:\n");
+
+    u32 Counts[] = { 1000, 10000, 100000 };
+    for (u32 CountIndex = 0; CountIndex < SDL_arraysize(Counts); ++CountIndex)
+    {
+        u32 Count = Counts[CountIndex];
+        u32 Repeats = SDL_max(1u, 1000000u / Count);
+        u32 Random = 0x1234567;
+
+        entity_instance *Source = (entity_instance *) SDL_malloc(sizeof(entity_instance) * Count);
+        u8 *Keys = (u8 *) SDL_malloc(Count);
+        for (u32 I = 0; I < Count; ++I)
+        {
+            Source[I].Position = V3(RandomBilateral(&Random), 0, RandomBilateral(&Random));
+            Source[I].Scale = 1;
+            Source[I].Rotation = V4(0, 0, 0, 1);
+            Keys[I] = RandomNext(&Random) % 9;
+        }
+
+        instance_renderer Renderer;
+        InitInstanceBatches(&Renderer, Count);
+        entity_instance *Destination = (entity_instance *) SDL_malloc(sizeof(entity_instance) * Count);
+
+        f64 Start = GetSeconds();
+        for (u32 Repeat = 0; Repeat < Repeats; ++Repeat)
+        {
+            BeginInstances(&Renderer);
+            for (u32 I = 0; I < Count; ++I)
+            {
+                PushInstances(&Renderer, Keys[I] / 3, Keys[I] % 3, Source + I, 1);
+            }
+            BuildInstanceBatches(&Renderer, Destination);
+        }
+        f64 BatchTime = (GetSeconds() - Start) / Repeats;
+
+        // Every instance lands in its batch's range exactly once.
+        u32 Total = 0;
+        for (u32 Batch = 0; Batch < Renderer.BatchCount; ++Batch)
+        {
+            assert(Renderer.Batches[Batch].FirstInstance == Total);
+            Total += Renderer.Batches[Batch].InstanceCount;
+        }
+        assert(Total == Count && Renderer.BatchCount == 9);
+
+        printf("  %6u instances | %u batches | push + batch %7.3f ms | %6.1f M/s\n",
+               Count, Renderer.BatchCount, BatchTime * 1000, Count / BatchTime / 1e6);
+
+        FreeInstanceRenderer(&Renderer);
+        SDL_free(Destination);
+        SDL_free(Keys);
+        SDL_free(Source);
+    }
+}
+
+// Writes a Size^2 heightfield (32768 is about 3 GB) to the pref directory and
+// flies the camera across it diagonally, at a cruising speed and a fast one.
+// Reports how many tile requests faulted and how much had to be streamed in.
+// The file was just written, so most of it probably still sits in the page
+// cache. Only runs with `--bench-heightfield SIZE`, it takes a while.
+void BenchmarkHeightfield(u32 Size)
+{
+    printf("heightfield streaming:\n");
+
+    char *PrefPath = SDL_GetPrefPath("", "sdltest");
+    if (!PrefPath)
+    {
+        printf("  skipped, no place to write to: %s\n", SDL_GetError());
+        return;
+    }
+    char *Path;
+    SDL_asprintf(&Path, "%sheightfield_benchmark.hf", PrefPath);
+    SDL_free(PrefPath);
+    f32 SampleSpacing = 1.0f;
+
+    f64 Start = GetSeconds();
+    u64 FileSize = WriteHeightfield(Path, Size, 1234, SampleSpacing, 512.0f);
+    f64 WriteTime = GetSeconds() - Start;
+    if (!FileSize)
+    {
+        printf("  skipped, can't write %s: %s\n", Path, SDL_GetError());
+        SDL_free(Path);
+        return;
+    }
+    printf("  write %u^2 to %s | %8.2f MB | %7.2f s | %6.1f MB/s\n", Size, Path, FileSize / 1e6, WriteTime,
+           FileSize / WriteTime / 1e6);
+
+    const char *Names[] = { "cruise", "fast" };
+    u32 FrameCounts[] = { 4000, 1000 };
+    for (u32 Flight = 0; Flight < SDL_arraysize(FrameCounts); ++Flight)
+    {
+        u32 FrameCount = FrameCounts[Flight];
+
+        heightfield_streamer Streamer;
+        bool Opened = OpenHeightfield(&Streamer, Path, 32 * 1024 * 1024, 2, 32);
+        assert(Opened);
+
+        f32 WorldSize = Size * SampleSpacing;
+        f32 CameraX = 0;
+        f32 CameraZ = 0;
+        for (u32 Frame = 0; Frame < FrameCount; ++Frame)
+        {
+            f32 T = (f32) Frame / FrameCount;
+            CameraX = WorldSize * (0.05f + 0.9f * T);
+            CameraZ = WorldSize * (0.05f + 0.9f * T * T);
+            UpdateHeightfield(&Streamer, CameraX, CameraZ, NULL);
+        }
+        heightfield_stats Stats = Streamer.Stats;
+
+        // Once the camera stops everything around it comes in, and the finest
+        // level reads back exactly what was generated.
+        for (u32 Frame = 0; Frame < 16; ++Frame)
+        {
+            UpdateHeightfield(&Streamer, CameraX, CameraZ, NULL);
+        }
+        u32 SampleX = (u32) (CameraX / SampleSpacing);
+        u32 SampleZ = (u32) (CameraZ / SampleSpacing);
+        u8 *NoiseData = (u8 *) SDL_malloc(NOISE_SIZE * NOISE_SIZE);
+        BakeNoise(NoiseData, 1234);
+        f32 Expected;
+        GenerateHeightRow(NoiseData, 0, SampleX, SampleZ, 1, &Expected);
+        f32 Height = SampleHeightfield(&Streamer, CameraX, CameraZ, 0);
+        assert(SDL_fabsf(Height - QuantizeHeight(Expected) / 65535.0f * 512.0f) < 1e-3f);
+        SDL_free(NoiseData);
+
+        f64 StreamTime = Stats.StreamNS / 1e9;
+        printf("  %-6s | %4u frames | %8llu requests | %6.2f%% faults | %6llu loads | %6llu evictions | %6llu deferred | "
+               "%8.2f MB | %6.1f MB/s at 60 fps | update %6.3f ms/frame (%6.1f MB/s)\n",
+               Names[Flight], FrameCount, (unsigned long long) Stats.Requests,
+               100.0 * Stats.Faults / Stats.Requests, (unsigned long long) Stats.Loads,
+               (unsigned long long) Stats.Evictions, (unsigned long long) Stats.Deferred,
+               Stats.BytesStreamed / 1e6, Stats.BytesStreamed / 1e6 / FrameCount * 60,
+               StreamTime * 1000 / FrameCount, Stats.BytesStreamed / StreamTime / 1e6);
+
+        CloseHeightfield(&Streamer);
+    }
+
+    SDL_RemovePath(Path);
+    SDL_free(Path);
+}
+
+void RunBenchmarks()
+{
+    printf("worker threads: %u\n", Jobs.WorkerCount);
+    BenchmarkEntities();
+    BenchmarkTextureCompression();
+    BenchmarkMesh();
+    BenchmarkMeshImport();
+    BenchmarkCulling();
+    BenchmarkInstanceBatching();
+}
+
+// GPU benchmarks, run with `sdltest --bench-gpu`. Renders offscreen, so no
+// window shows up, but a GPU is required.
+
+// Renders the water plane offscreen with every shader variant the build makes
+// and reports the average frame time including GPU work. Variants a quality
+// tier picks are labelled with it.
+void BenchmarkShaderVariants()
+{
+    printf("shader variants:\n");
+
+    u32 Width = 1920;
+    u32 Height = 1080;
+    u32 FrameCount = 200;
+    SDL_GPUTextureFormat ColorFormat = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+    SDL_GPUTextureFormat DepthFormat = SDL_GPU_TEXTUREFORMAT_D32_FLOAT;
+
+    SDL_GPUTextureCreateInfo TargetInfo = {};
+    TargetInfo.type = SDL_GPU_TEXTURETYPE_2D;
+    TargetInfo.format = ColorFormat;
+    TargetInfo.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET;
+    TargetInfo.width = Width;
+    TargetInfo.height = Height;
+    TargetInfo.layer_count_or_depth = 1;
+    TargetInfo.num_levels = 1;
+    SDL_GPUTexture *Target = CreateGpuTexture(&State.Resources, GpuCategory_Targets, "benchmark target", &TargetInfo);
+
+    TargetInfo.format = DepthFormat;
+    TargetInfo.usage = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET;
+    SDL_GPUTexture *DepthBuffer = CreateGpuTexture(&State.Resources, GpuCategory_Targets, "benchmark depth", &TargetInfo);
+
+    // Denser than the default plane so the vertex side of the variants shows up too.
+    i32 Segments = 128;
+    u32 MaxVertexCount = (2 * Segments + 1) * (2 * Segments + 1);
+    u32 MaxIndexCount = 2 * Segments * 2 * Segments * 6;
+    vertex *Vertices = (vertex *) SDL_malloc(sizeof(vertex) * MaxVertexCount);
+    u32 *Indices = (u32 *) SDL_malloc(sizeof(u32) * MaxIndexCount);
+    u32 VertexCount;
+    u32 IndexCount;
+    BuildPlane(Segments, Vertices, &VertexCount, Indices, &IndexCount);
+
+    SDL_GPUBufferCreateInfo BufferInfo = {};
+    BufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
+    BufferInfo.size = sizeof(vertex) * VertexCount;
+    SDL_GPUBuffer *VertexBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Geometry, "benchmark plane", &BufferInfo);
+    CopyToBuffer(VertexBuffer, Vertices, sizeof(vertex) * VertexCount);
+
+    BufferInfo.usage = SDL_GPU_BUFFERUSAGE_INDEX;
+    BufferInfo.size = sizeof(u32) * IndexCount;
+    SDL_GPUBuffer *IndexBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Geometry, "benchmark plane", &BufferInfo);
+    CopyToBuffer(IndexBuffer, Indices, sizeof(u32) * IndexCount);
+
+    BakeNoise(State.NoiseData, 0);
+    SDL_GPUTexture *Texture = CreateNoiseTexture(State.NoiseData);
+    SDL_GPUSampler *Sampler = CreateWrapSampler();
+
+    object_buffer Objects;
+    InitObjectBuffer(&Objects, 1);
+    AddObject(&Objects, Identity(), V4(0.2, 0.3, 0.4, 1));
+
+    v3 CameraPosition = V3(0, 1, 1);
+    camera Camera = {};
+    SetCameraView(&Camera, CameraPosition, V3(0), V3(0, 1, 0));
+    SetCameraProjection(&Camera, Radians(50), (f32) Width / (f32) Height, 0.01, 1000);
+    UpdateCamera(&Camera);
+
+    global_uniforms GlobalUniforms = {};
+    GlobalUniforms.ViewProjection = Camera.ViewProjection;
+    fragment_uniforms FragmentUniforms = DefaultFragmentUniforms(CameraPosition);
+
+    u32 LightingCount = SDL_arraysize(VariantLightings);
+    u32 NormalModeCount = SDL_arraysize(VariantNormalModes);
+    u32 VariantCount = SDL_arraysize(VariantOctaveCounts) * NormalModeCount * LightingCount;
+    for (u32 VariantIndex = 0; VariantIndex < VariantCount; ++VariantIndex)
+    {
+        shader_variant Variant;
+        Variant.OctaveCount = VariantOctaveCounts[VariantIndex / (NormalModeCount * LightingCount)];
+        Variant.NormalMode = VariantNormalModes[VariantIndex / LightingCount % NormalModeCount];
+        Variant.Lighting = VariantLightings[VariantIndex % LightingCount];
+
+        const char *TierName = "";
+        for (u32 Tier = 0; Tier < Quality_Count; ++Tier)
+        {
+            shader_variant TierVariant = QualityVariants[Tier];
+            if (TierVariant.OctaveCount == Variant.OctaveCount && TierVariant.NormalMode == Variant.NormalMode &&
+                TierVariant.Lighting == Variant.Lighting)
+            {
+                TierName = QualityNames[Tier];
+            }
+        }
+
+        water_shaders Shaders = LoadWaterShaders(Variant);
+        if (!Shaders.Vertex)
+        {
+            printf("  %-6s | %u octaves, normal mode %u, lighting %u | not built, skipped\n",
+                   TierName, Variant.OctaveCount, Variant.NormalMode, Variant.Lighting);
+            continue;
+        }
+        SDL_GPUGraphicsPipeline *Pipeline = CreateWaterPipeline(Shaders, ColorFormat, DepthFormat);
+
+        // Every frame waits for its own fence, so this is the time from submit
+        // to done for one frame, not throughput with frames overlapping.
+        f64 FrameTime = 0;
+        u32 WarmupCount = 10;
+        for (u32 Frame = 0; Frame < WarmupCount + FrameCount; ++Frame)
+        {
+            GlobalUniforms.Time = Frame / 60.0f;
+
+            f64 Start = GetSeconds();
+            SDL_GPUCommandBuffer *CommandBuffer = SDL_AcquireGPUCommandBuffer(State.Device);
+            UploadObjects(&Objects, CommandBuffer);
+
+            SDL_GPUColorTargetInfo ColorTargetInfo = {};
+            ColorTargetInfo.texture = Target;
+            ColorTargetInfo.clear_color = { 1, 1, 1, 1 };
+            ColorTargetInfo.load_op = SDL_GPU_LOADOP_CLEAR;
+            ColorTargetInfo.store_op = SDL_GPU_STOREOP_STORE;
+
+            SDL_GPUDepthStencilTargetInfo DepthTargetInfo = {};
+            DepthTargetInfo.texture = DepthBuffer;
+            DepthTargetInfo.clear_depth = 1;
+            DepthTargetInfo.load_op = SDL_GPU_LOADOP_CLEAR;
+            DepthTargetInfo.store_op = SDL_GPU_STOREOP_DONT_CARE;
+
+            SDL_GPURenderPass *RenderPass = SDL_BeginGPURenderPass(CommandBuffer, &ColorTargetInfo, 1, &DepthTargetInfo);
+            SDL_BindGPUGraphicsPipeline(RenderPass, Pipeline);
+
+            SDL_GPUBufferBinding VertexBufferBinding = {};
+            VertexBufferBinding.buffer = VertexBuffer;
+            SDL_BindGPUVertexBuffers(RenderPass, 0, &VertexBufferBinding, 1);
+
+            SDL_GPUBufferBinding IndexBufferBinding = {};
+            IndexBufferBinding.buffer = IndexBuffer;
+            SDL_BindGPUIndexBuffer(RenderPass, &IndexBufferBinding, SDL_GPU_INDEXELEMENTSIZE_32BIT);
+
+            SDL_GPUTextureSamplerBinding TextureSamplerBinding = {};
+            TextureSamplerBinding.texture = Texture;
+            TextureSamplerBinding.sampler = Sampler;
+            SDL_BindGPUVertexSamplers(RenderPass, 0, &TextureSamplerBinding, 1);
+            SDL_BindGPUFragmentSamplers(RenderPass, 0, &TextureSamplerBinding, 1);
+            SDL_BindGPUVertexStorageBuffers(RenderPass, 0, &Objects.Buffer, 1);
+
+            SDL_PushGPUVertexUniformData(CommandBuffer, 0, &GlobalUniforms, sizeof(GlobalUniforms));
+            SDL_PushGPUFragmentUniformData(CommandBuffer, 0, &FragmentUniforms, sizeof(FragmentUniforms));
+            SDL_DrawGPUIndexedPrimitives(RenderPass, IndexCount, Objects.Count, 0, 0, 0);
+
+            SDL_EndGPURenderPass(RenderPass);
+            SDL_GPUFence *Fence = SDL_SubmitGPUCommandBufferAndAcquireFence(CommandBuffer);
+            SDL_WaitForGPUFences(State.Device, true, &Fence, 1);
+            SDL_ReleaseGPUFence(State.Device, Fence);
+            if (Frame >= WarmupCount)
+            {
+                FrameTime += GetSeconds() - Start;
+            }
+        }
+        FrameTime /= FrameCount;
+
+        printf("  %-6s | %u octaves, normal mode %u, lighting %u | %7.3f ms/frame\n",
+               TierName, Variant.OctaveCount, Variant.NormalMode, Variant.Lighting, FrameTime * 1000);
+
+        ReleaseGpuResource(&State.Resources, Pipeline);
+    }
+
+    FreeObjectBuffer(&Objects);
+    ReleaseGpuResource(&State.Resources, Sampler);
+    ReleaseGpuResource(&State.Resources, Texture);
+    ReleaseGpuResource(&State.Resources, IndexBuffer);
+    ReleaseGpuResource(&State.Resources, VertexBuffer);
+    ReleaseGpuResource(&State.Resources, DepthBuffer);
+    ReleaseGpuResource(&State.Resources, Target);
+    SDL_free(Indices);
+    SDL_free(Vertices);
+}
+
+// Draws N boxes offscreen once with one draw call per instance and once
+// through the instanced batches. Reports draw calls and the CPU time spent
+// recording and submitting, GPU time is left out on purpose.
+void BenchmarkInstancing()
+{
+    printf("instancing:\n");
+
+    u32 Width = 1920;
+    u32 Height = 1080;
+    u32 FrameCount = 50;
+    SDL_GPUTextureFormat ColorFormat = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+    SDL_GPUTextureFormat DepthFormat = SDL_GPU_TEXTUREFORMAT_D32_FLOAT;
+
+    SDL_GPUTextureCreateInfo TargetInfo = {};
+    TargetInfo.type = SDL_GPU_TEXTURETYPE_2D;
+    TargetInfo.format = ColorFormat;
+    TargetInfo.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET;
+    TargetInfo.width = Width;
+    TargetInfo.height = Height;
+    TargetInfo.layer_count_or_depth = 1;
+    TargetInfo.num_levels = 1;
+    SDL_GPUTexture *Target = CreateGpuTexture(&State.Resources, GpuCategory_Targets, "benchmark target", &TargetInfo);
+
+    TargetInfo.format = DepthFormat;
+    TargetInfo.usage = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET;
+    SDL_GPUTexture *DepthBuffer = CreateGpuTexture(&State.Resources, GpuCategory_Targets, "benchmark depth", &TargetInfo);
+
+    u32 MaxCount = 100000;
+    instance_renderer Renderer;
+    if (!InitInstanceRenderer(&Renderer, MaxCount, ColorFormat, DepthFormat))
+    {
+        FreeInstanceRenderer(&Renderer);
+        ReleaseGpuResource(&State.Resources, DepthBuffer);
+        ReleaseGpuResource(&State.Resources, Target);
+        return;
+    }
+
+    vertex Vertices[24];
+    u32 Indices[36];
+    u32 VertexCount;
+    u32 IndexCount;
+    for (u32 Mesh = 0; Mesh < 3; ++Mesh)
+    {
+        BuildBox(V3(1, 0.5f + Mesh * 0.5f, 1), Vertices, &VertexCount, Indices, &IndexCount);
+        AddInstanceMesh(&Renderer, Vertices, VertexCount, Indices, IndexCount);
+        AddInstanceMaterial(&Renderer, V4(0.3f * Mesh, 0.5, 0.5, 1));
+    }
+
+    entity_instance *Instances = (entity_instance *) SDL_malloc(sizeof(entity_instance) * MaxCount);
+    u32 Random = 0x1234567;
+    for (u32 I = 0; I < MaxCount; ++I)
+    {
+        Instances[I].Position = V3(RandomBilateral(&Random) * 10, 0, RandomBilateral(&Random) * 10);
+        Instances[I].Scale = 0.02f;
+        Instances[I].Rotation = V4(0, 0, 0, 1);
+    }
+
+    global_uniforms GlobalUniforms = {};
+    GlobalUniforms.ViewProjection = Multiply(Perspective(Radians(50), (f32) Width / (f32) Height, 0.01, 1000),
+                                             LookAt(V3(0, 5, 12), V3(0), V3(0, 1, 0)));
+    fragment_uniforms FragmentUniforms = DefaultFragmentUniforms(V3(0, 5, 12));
+
+    u32 Counts[] = { 1000, 10000, 100000 };
+    for (u32 CountIndex = 0; CountIndex < SDL_arraysize(Counts); ++CountIndex)
+    {
+        u32 Count = Counts[CountIndex];
+
+        for (u32 Instanced = 0; Instanced < 2; ++Instanced)
+        {
+            f64 CpuTime = 0;
+            u32 DrawCount = 0;
+            for (u32 Frame = 0; Frame < FrameCount; ++Frame)
+            {
+                f64 Start = GetSeconds();
+
+                BeginInstances(&Renderer);
+                for (u32 Mesh = 0; Mesh < 3; ++Mesh)
+                {
+                    u32 First = Count * Mesh / 3;
+                    u32 Last = Count * (Mesh + 1) / 3;
+                    PushInstances(&Renderer, Mesh, Mesh, Instances + First, Last - First);
+                }
+
+                SDL_GPUCommandBuffer *CommandBuffer = SDL_AcquireGPUCommandBuffer(State.Device);
+                UploadInstances(&Renderer, CommandBuffer);
+
+                SDL_GPUColorTargetInfo ColorTargetInfo = {};
+                ColorTargetInfo.texture = Target;
+                ColorTargetInfo.clear_color = { 1, 1, 1, 1 };
+                ColorTargetInfo.load_op = SDL_GPU_LOADOP_CLEAR;
+                ColorTargetInfo.store_op = SDL_GPU_STOREOP_STORE;
+
+                SDL_GPUDepthStencilTargetInfo DepthTargetInfo = {};
+                DepthTargetInfo.texture = DepthBuffer;
+                DepthTargetInfo.clear_depth = 1;
+                DepthTargetInfo.load_op = SDL_GPU_LOADOP_CLEAR;
+                DepthTargetInfo.store_op = SDL_GPU_STOREOP_DONT_CARE;
+
+                SDL_GPURenderPass *RenderPass = SDL_BeginGPURenderPass(CommandBuffer, &ColorTargetInfo, 1, &DepthTargetInfo);
+                if (Instanced)
+                {
+                    DrawCount = DrawInstances(&Renderer, RenderPass, CommandBuffer, &GlobalUniforms, &FragmentUniforms);
+                }
+                else
+                {
+                    // Same buffers, but every instance is its own draw.
+                    SDL_BindGPUGraphicsPipeline(RenderPass, Renderer.Pipeline);
+                    SDL_PushGPUVertexUniformData(CommandBuffer, 0, &GlobalUniforms, sizeof(GlobalUniforms));
+                    SDL_PushGPUFragmentUniformData(CommandBuffer, 0, &FragmentUniforms, sizeof(FragmentUniforms));
+
+                    DrawCount = 0;
+                    for (u32 I = 0; I < Renderer.BatchCount; ++I)
+                    {
+                        instance_batch *Batch = Renderer.Batches + I;
+                        instance_mesh *Mesh = Renderer.Meshes + Batch->Mesh;
+
+                        SDL_GPUBufferBinding VertexBufferBindings[2] = {};
+                        VertexBufferBindings[0].buffer = Mesh->VertexBuffer;
+                        VertexBufferBindings[1].buffer = Renderer.InstanceBuffer;
+                        SDL_BindGPUVertexBuffers(RenderPass, 0, VertexBufferBindings, 2);
+
+                        SDL_GPUBufferBinding IndexBufferBinding = {};
+                        IndexBufferBinding.buffer = Mesh->IndexBuffer;
+                        SDL_BindGPUIndexBuffer(RenderPass, &IndexBufferBinding, SDL_GPU_INDEXELEMENTSIZE_32BIT);
+
+                        SDL_PushGPUFragmentUniformData(CommandBuffer, 1, Renderer.Materials + Batch->Material, sizeof(instance_material));
+                        for (u32 Instance = 0; Instance < Batch->InstanceCount; ++Instance)
+                        {
+                            SDL_DrawGPUIndexedPrimitives(RenderPass, Mesh->IndexCount, 1, 0, 0, Batch->FirstInstance + Instance);
+                        }
+                        DrawCount += Batch->InstanceCount;
+                    }
+                }
+                SDL_EndGPURenderPass(RenderPass);
+                SDL_SubmitGPUCommandBuffer(CommandBuffer);
+
+                CpuTime += GetSeconds() - Start;
+
+                // Keeps the frames from piling up, like the swapchain would.
+                SDL_WaitForGPUIdle(State.Device);
+            }
+
+            printf("  %6u instances | %-9s | %6u draws | %8.3f ms CPU/frame\n", Count,
+                   Instanced ? "instanced" : "per draw", DrawCount, CpuTime * 1000 / FrameCount);
+        }
+    }
+
+    SDL_free(Instances);
+    FreeInstanceRenderer(&Renderer);
+    ReleaseGpuResource(&State.Resources, DepthBuffer);
+    ReleaseGpuResource(&State.Resources, Target);
+}
+
+#define STREAMED_TEXTURE_COUNT 256
+
+struct streamed_textures
+{
+    SDL_GPUTexture *Textures[STREAMED_TEXTURE_COUNT];
+};
+
+void EvictStreamedTexture(void *Data, void *Handle)
+{
+    streamed_textures *Set = (streamed_textures *) Data;
+    for (u32 I = 0; I < STREAMED_TEXTURE_COUNT; ++I)
+    {
+        if (Set->Textures[I] == Handle)
+        {
+            Set->Textures[I] = NULL;
+        }
+    }
+}
+
+// Streams 256 KB textures through a small budget. Every frame uses a window
+// of textures that slides over a bigger set, missing ones get created and
+// uploaded, and the registry evicts whatever was used longest ago. Reports
+// how many releases had to wait for a frame fence.
+void BenchmarkResourceBudgets()
+{
+    printf("resource budgets:\n");
+
+    u32 Size = 256;
+    u32 FrameCount = 500;
+    u64 Budget = 8 * 1024 * 1024;
+    SetGpuBudget(&State.Resources, GpuCategory_Streaming, Budget);
+
+    u32 *Pixels = (u32 *) SDL_malloc(sizeof(u32) * Size * Size);
+    for (u32 I = 0; I < Size * Size; ++I)
+    {
+        Pixels[I] = 0xFF000000 | I;
+    }
+
+    SDL_GPUTransferBufferCreateInfo StagingInfo = {};
+    StagingInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+    StagingInfo.size = sizeof(u32) * Size * Size;
+    SDL_GPUTransferBuffer *Staging = CreateGpuTransferBuffer(&State.Resources, "benchmark staging", &StagingInfo);
+    void *StagingData = SDL_MapGPUTransferBuffer(State.Device, Staging, false);
+    SDL_memcpy(StagingData, Pixels, sizeof(u32) * Size * Size);
+    SDL_UnmapGPUTransferBuffer(State.Device, Staging);
+
+    // The last window doesn't fit, nothing in it can be evicted.
+    u32 Windows[] = { 16, 30, 40 };
+    for (u32 WindowIndex = 0; WindowIndex < SDL_arraysize(Windows); ++WindowIndex)
+    {
+        u32 Window = Windows[WindowIndex];
+        streamed_textures Set = {};
+        u64 EvictionsBefore = State.Resources.Categories[GpuCategory_Streaming].Evictions;
+        u32 Loads = 0;
+        u32 MaxPending = 0;
+
+        f64 Start = GetSeconds();
+        for (u32 Frame = 0; Frame < FrameCount; ++Frame)
+        {
+            SDL_GPUCommandBuffer *CommandBuffer = SDL_AcquireGPUCommandBuffer(State.Device);
+            SDL_GPUCopyPass *CopyPass = SDL_BeginGPUCopyPass(CommandBuffer);
+
+            // Touch everything in the window first, so none of it gets evicted
+            // for a texture that's loaded later in the same frame.
+            for (u32 I = 0; I < Window; ++I)
+            {
+                SDL_GPUTexture *Texture = Set.Textures[(Frame + I) % STREAMED_TEXTURE_COUNT];
+                if (Texture)
+                {
+                    TouchGpuResource(&State.Resources, Texture);
+                }
+            }
+
+            for (u32 I = 0; I < Window; ++I)
+            {
+                u32 Index = (Frame + I) % STREAMED_TEXTURE_COUNT;
+                if (Set.Textures[Index])
+                {
+                    continue;
+                }
+
+                SDL_GPUTextureCreateInfo TextureInfo = {};
+                TextureInfo.type = SDL_GPU_TEXTURETYPE_2D;
+                TextureInfo.format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+                TextureInfo.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+                TextureInfo.width = Size;
+                TextureInfo.height = Size;
+                TextureInfo.layer_count_or_depth = 1;
+                TextureInfo.num_levels = 1;
+                Set.Textures[Index] = CreateGpuTexture(&State.Resources, GpuCategory_Streaming, "streamed texture",
+                                                       &TextureInfo, EvictStreamedTexture, &Set);
+
+                SDL_GPUTextureTransferInfo Source = {};
+                Source.transfer_buffer = Staging;
+
+                SDL_GPUTextureRegion Dest = {};
+                Dest.texture = Set.Textures[Index];
+                Dest.w = Size;
+                Dest.h = Size;
+                Dest.d = 1;
+                SDL_UploadToGPUTexture(CopyPass, &Source, &Dest, false);
+                Loads++;
+            }
+
+            SDL_EndGPUCopyPass(CopyPass);
+            MaxPending = SDL_max(MaxPending, State.Resources.PendingCount);
+            SubmitGpuFrame(&State.Resources, CommandBuffer);
+        }
+        WaitForGpuFrames(&State.Resources);
+        f64 Time = GetSeconds() - Start;
+
+        gpu_category_stats *Stats = State.Resources.Categories + GpuCategory_Streaming;
+        printf("  window %2u x 256 KB, budget %.0f MB | %5u loads | %5llu evictions | peak %5.2f MB | "
+               "max %2u releases pending | %6.3f ms/frame\n",
+               Window, Budget / (1024.0 * 1024.0), Loads,
+               (unsigned long long) (Stats->Evictions - EvictionsBefore), Stats->PeakBytes / (1024.0 * 1024.0),
+               MaxPending, Time * 1000 / FrameCount);
+
+        for (u32 I = 0; I < STREAMED_TEXTURE_COUNT; ++I)
+        {
+            ReleaseGpuResource(&State.Resources, Set.Textures[I]);
+        }
+        FlushGpuResources(&State.Resources);
+    }
+
+    ReleaseGpuResource(&State.Resources, Staging);
+    SetGpuBudget(&State.Resources, GpuCategory_Streaming, DefaultGpuBudgets[GpuCategory_Streaming]);
+    SDL_free(Pixels);
+}
+
+void RunGpuBenchmarks()
+{
+    SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+    SDL_Init(SDL_INIT_VIDEO);
+
+    State.Device = SDL_CreateGPUDevice(SDL_GPU_SHADERFORMAT_SPIRV, false, NULL);
+    if (!State.Device)
+    {
+        printf("No GPU device: %s\n", SDL_GetError());
+        SDL_Quit();
+        return;
+    }
+
+    printf("gpu driver: %s\n", SDL_GetGPUDeviceDriver(State.Device));
+    InitGpuRegistry(&State.Resources, State.Device);
+    BenchmarkShaderVariants();
+    BenchmarkInstancing();
+    BenchmarkResourceBudgets();
+
+    // Peaks over all benchmarks, anything left over shows up as a leak.
+    ReportGpuResources(&State.Resources);
+    ShutdownGpuRegistry(&State.Resources);
+    SDL_DestroyGPUDevice(State.Device);
+    State.Device = NULL;
+    SDL_Quit();
+}
@@ -0,0 +1,562 @@
+// Frustum culling over a 4-wide bounding volume hierarchy.
+//
+// Every node stores the boxes of its (up to) four children as structure of
+// arrays, so one SSE instruction tests all four against a frustum plane.
+// Children that are completely inside the frustum get their whole subtree
+// accepted without any more plane tests.
+// Items are whatever the caller has bounds for (water tiles, meshes,
+// floating objects), the result is a list of item indices.
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define CULLING_SSE2 1
+#endif
+
+#define CULL_WIDTH 4
+#define CULL_STACK_SIZE 256
+
+// Frames between culling stats in the log.
+#define CULL_REPORT_FRAMES 120
+
+// Child references: a node index, an item index with CULL_LEAF set, or empty.
+#define CULL_LEAF 0x80000000
+#define CULL_EMPTY 0xFFFFFFFF
+
+// Marks stack entries whose box is already known to be fully visible.
+#define CULL_INSIDE 0x80000000
+
+struct aabb
+{
+    v3 Min;
+    v3 Max;
+};
+
+aabb MeshBounds(vertex *Vertices, u32 VertexCount)
+{
+    aabb Result = {};
+    if (!VertexCount)
+    {
+        return Result;
+    }
+
+    Result.Min = Vertices[0].Position;
+    Result.Max = Vertices[0].Position;
+    for (u32 I = 1; I < VertexCount; ++I)
+    {
+        v3 P = Vertices[I].Position;
+        Result.Min = V3(SDL_min(Result.Min.X, P.X), SDL_min(Result.Min.Y, P.Y), SDL_min(Result.Min.Z, P.Z));
+        Result.Max = V3(SDL_max(Result.Max.X, P.X), SDL_max(Result.Max.Y, P.Y), SDL_max(Result.Max.Z, P.Z));
+    }
+
+    return Result;
+}
+
+// Box around the transformed box (Arvo's method).
+aabb TransformBounds(mat4 Transform, aabb Bounds)
+{
+    f32 Min[3] = { Bounds.Min.X, Bounds.Min.Y, Bounds.Min.Z };
+    f32 Max[3] = { Bounds.Max.X, Bounds.Max.Y, Bounds.Max.Z };
+    f32 ResultMin[3];
+    f32 ResultMax[3];
+
+    for (u32 Row = 0; Row < 3; ++Row)
+    {
+        ResultMin[Row] = Transform.V[12 + Row];
+        ResultMax[Row] = Transform.V[12 + Row];
+        for (u32 Column = 0; Column < 3; ++Column)
+        {
+            f32 A = Transform.V[Column * 4 + Row] * Min[Column];
+            f32 B = Transform.V[Column * 4 + Row] * Max[Column];
+            ResultMin[Row] += SDL_min(A, B);
+            ResultMax[Row] += SDL_max(A, B);
+        }
+    }
+
+    aabb Result;
+    Result.Min = V3(ResultMin[0], ResultMin[1], ResultMin[2]);
+    Result.Max = V3(ResultMax[0], ResultMax[1], ResultMax[2]);
+    return Result;
+}
+
+aabb InflateBounds(aabb Bounds, v3 Amount)
+{
+    aabb Result;
+    Result.Min = V3(Bounds.Min.X - Amount.X, Bounds.Min.Y - Amount.Y, Bounds.Min.Z - Amount.Z);
+    Result.Max = V3(Bounds.Max.X + Amount.X, Bounds.Max.Y + Amount.Y, Bounds.Max.Z + Amount.Z);
+    return Result;
+}
+
+// Largest |WaterHeight| the vertex shader can produce: every NoiseLayer adds
+// at most 0.2 / Value, so 0.375 for four octaves.
+f32 MaxWaterDisplacement(u32 OctaveCount)
+{
+    f32 Result = 0;
+    f32 Value = 1;
+    for (u32 Octave = 0; Octave < OctaveCount; ++Octave)
+    {
+        Result += 0.2f / Value;
+        Value *= 2;
+    }
+    return Result;
+}
+
+// Planes point inwards: a point P is inside when Dot(N, P) + W >= 0 for all six.
+struct frustum
+{
+    v4 Planes[6];
+};
+
+// Gribb/Hartmann plane extraction. Expects depth in [0, 1] like Perspective.
+frustum ExtractFrustum(mat4 ViewProjection)
+{
+    v4 Rows[4];
+    for (u32 Row = 0; Row < 4; ++Row)
+    {
+        Rows[Row] = V4(ViewProjection.V[Row], ViewProjection.V[4 + Row],
+                       ViewProjection.V[8 + Row], ViewProjection.V[12 + Row]);
+    }
+
+    frustum Result;
+    for (u32 Plane = 0; Plane < 6; ++Plane)
+    {
+        v4 R = Rows[3];
+        v4 A = Rows[Plane / 2];
+        f32 Sign = (Plane & 1) ? -1.0f : 1.0f;
+
+        v4 P;
+        if (Plane == 4)
+        {
+            // Near plane is z >= 0, not z >= -w.
+            P = Rows[2];
+        }
+        else
+        {
+            P = V4(R.X + Sign * A.X, R.Y + Sign * A.Y, R.Z + Sign * A.Z, R.W + Sign * A.W);
+        }
+
+        f32 Length = sqrtf(P.X * P.X + P.Y * P.Y + P.Z * P.Z);
+        Result.Planes[Plane] = V4(P.X / Length, P.Y / Length, P.Z / Length, P.W / Length);
+    }
+
+    return Result;
+}
+
+struct cull_node
+{
+    f32 MinX[CULL_WIDTH];
+    f32 MinY[CULL_WIDTH];
+    f32 MinZ[CULL_WIDTH];
+    f32 MaxX[CULL_WIDTH];
+    f32 MaxY[CULL_WIDTH];
+    f32 MaxZ[CULL_WIDTH];
+    u32 Children[CULL_WIDTH];
+};
+
+struct cull_bvh
+{
+    cull_node *Nodes;
+    u32 NodeCount;
+    u32 ItemCount;
+
+    // Build scratch
+    aabb *Bounds;
+    v3 *Centers;
+    u32 *Items;
+};
+
+struct cull_stats
+{
+    u32 Visible;
+    u32 Culled;
+    u32 NodesVisited;
+    f64 Seconds;
+};
+
+aabb ItemRangeBounds(cull_bvh *Bvh, u32 Start, u32 End)
+{
+    aabb Result = Bvh->Bounds[Bvh->Items[Start]];
+    for (u32 I = Start + 1; I < End; ++I)
+    {
+        aabb B = Bvh->Bounds[Bvh->Items[I]];
+        Result.Min = V3(SDL_min(Result.Min.X, B.Min.X), SDL_min(Result.Min.Y, B.Min.Y), SDL_min(Result.Min.Z, B.Min.Z));
+        Result.Max = V3(SDL_max(Result.Max.X, B.Max.X), SDL_max(Result.Max.Y, B.Max.Y), SDL_max(Result.Max.Z, B.Max.Z));
+    }
+    return Result;
+}
+
+inline f32 CenterAxis(v3 Center, u32 Axis)
+{
+    return Axis == 0 ? Center.X : (Axis == 1 ? Center.Y : Center.Z);
+}
+
+// Reorders Items[Start, End) so that Items[Middle] is where it would be if
+// the range was sorted by center along Axis (quickselect).
+void PartitionItems(cull_bvh *Bvh, u32 Start, u32 End, u32 Middle, u32 Axis)
+{
+    u32 *Items = Bvh->Items;
+    while (End - Start > 1)
+    {
+        f32 Pivot = CenterAxis(Bvh->Centers[Items[(Start + End) / 2]], Axis);
+        u32 Low = Start;
+        u32 High = End - 1;
+        while (Low <= High)
+        {
+            while (CenterAxis(Bvh->Centers[Items[Low]], Axis) < Pivot)
+            {
+                Low++;
+            }
+            while (CenterAxis(Bvh->Centers[Items[High]], Axis) > Pivot)
+            {
+                High--;
+            }
+            if (Low <= High)
+            {
+                u32 Swap = Items[Low];
+                Items[Low] = Items[High];
+                Items[High] = Swap;
+                Low++;
+                if (High == 0)
+                {
+                    break;
+                }
+                High--;
+            }
+        }
+
+        if (Middle <= High)
+        {
+            End = High + 1;
+        }
+        else if (Middle >= Low)
+        {
+            Start = Low;
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+// Median split along the longest axis of the centers.
+u32 SplitItems(cull_bvh *Bvh, u32 Start, u32 End)
+{
+    v3 Min = Bvh->Centers[Bvh->Items[Start]];
+    v3 Max = Min;
+    for (u32 I = Start + 1; I < End; ++I)
+    {
+        v3 C = Bvh->Centers[Bvh->Items[I]];
+        Min = V3(SDL_min(Min.X, C.X), SDL_min(Min.Y, C.Y), SDL_min(Min.Z, C.Z));
+        Max = V3(SDL_max(Max.X, C.X), SDL_max(Max.Y, C.Y), SDL_max(Max.Z, C.Z));
+    }
+
+    v3 Extent = V3(Max.X - Min.X, Max.Y - Min.Y, Max.Z - Min.Z);
+    u32 Axis = 0;
+    if (Extent.Y > Extent.X && Extent.Y >= Extent.Z)
+    {
+        Axis = 1;
+    }
+    else if (Extent.Z > Extent.X)
+    {
+        Axis = 2;
+    }
+
+    u32 Middle = Start + (End - Start) / 2;
+    PartitionItems(Bvh, Start, End, Middle, Axis);
+    return Middle;
+}
+
+void SetNodeChild(cull_node *Node, u32 Slot, aabb Bounds, u32 Child)
+{
+    Node->MinX[Slot] = Bounds.Min.X;
+    Node->MinY[Slot] = Bounds.Min.Y;
+    Node->MinZ[Slot] = Bounds.Min.Z;
+    Node->MaxX[Slot] = Bounds.Max.X;
+    Node->MaxY[Slot] = Bounds.Max.Y;
+    Node->MaxZ[Slot] = Bounds.Max.Z;
+    Node->Children[Slot] = Child;
+}
+
+u32 BuildCullNode(cull_bvh *Bvh, u32 Start, u32 End)
+{
+    u32 NodeIndex = Bvh->NodeCount++;
+    cull_node *Node = Bvh->Nodes + NodeIndex;
+    *Node = {};
+    for (u32 Slot = 0; Slot < CULL_WIDTH; ++Slot)
+    {
+        Node->Children[Slot] = CULL_EMPTY;
+    }
+
+    u32 Count = End - Start;
+    if (Count <= CULL_WIDTH)
+    {
+        for (u32 Slot = 0; Slot < Count; ++Slot)
+        {
+            u32 Item = Bvh->Items[Start + Slot];
+            SetNodeChild(Node, Slot, Bvh->Bounds[Item], Item | CULL_LEAF);
+        }
+        return NodeIndex;
+    }
+
+    // Two levels of binary splits give the four children.
+    u32 Middle = SplitItems(Bvh, Start, End);
+    u32 Ranges[5] = { Start, 0, Middle, 0, End };
+    Ranges[1] = SplitItems(Bvh, Start, Middle);
+    Ranges[3] = SplitItems(Bvh, Middle, End);
+
+    for (u32 Slot = 0; Slot < CULL_WIDTH; ++Slot)
+    {
+        u32 ChildStart = Ranges[Slot];
+        u32 ChildEnd = Ranges[Slot + 1];
+        aabb Bounds = ItemRangeBounds(Bvh, ChildStart, ChildEnd);
+        u32 Child;
+        if (ChildEnd - ChildStart == 1)
+        {
+            Child = Bvh->Items[ChildStart] | CULL_LEAF;
+        }
+        else
+        {
+            Child = BuildCullNode(Bvh, ChildStart, ChildEnd);
+        }
+        SetNodeChild(Node, Slot, Bounds, Child);
+    }
+
+    return NodeIndex;
+}
+
+// Bounds are copied, the caller can throw them away afterwards.
+void BuildCullBvh(cull_bvh *Bvh, aabb *Bounds, u32 Count)
+{
+    assert(Count < CULL_LEAF);
+
+    *Bvh = {};
+    Bvh->ItemCount = Count;
+    if (!Count)
+    {
+        return;
+    }
+
+    // Every inner node has at least two children, so Count nodes are enough.
+    Bvh->Nodes = (cull_node *) SDL_malloc(sizeof(cull_node) * Count);
+    Bvh->Bounds = Bounds;
+    Bvh->Centers = (v3 *) SDL_malloc(sizeof(v3) * Count);
+    Bvh->Items = (u32 *) SDL_malloc(sizeof(u32) * Count);
+    for (u32 I = 0; I < Count; ++I)
+    {
+        Bvh->Centers[I] = V3((Bounds[I].Min.X + Bounds[I].Max.X) * 0.5f,
+                             (Bounds[I].Min.Y + Bounds[I].Max.Y) * 0.5f,
+                             (Bounds[I].Min.Z + Bounds[I].Max.Z) * 0.5f);
+        Bvh->Items[I] = I;
+    }
+
+    BuildCullNode(Bvh, 0, Count);
+    assert(Bvh->NodeCount <= Count);
+
+    SDL_free(Bvh->Items);
+    SDL_free(Bvh->Centers);
+    Bvh->Items = NULL;
+    Bvh->Centers = NULL;
+    Bvh->Bounds = NULL;
+}
+
+void FreeCullBvh(cull_bvh *Bvh)
+{
+    SDL_free(Bvh->Nodes);
+    *Bvh = {};
+}
+
+// Bit I of *Inside is set when child I is completely inside the frustum,
+// the return value has bit I set when child I is at least partly inside.
+u32 CullNodeChildren(cull_node *Node, frustum *Frustum, u32 *Inside)
+{
+#if CULLING_SSE2
+    __m128 MinX = _mm_loadu_ps(Node->MinX);
+    __m128 MinY = _mm_loadu_ps(Node->MinY);
+    __m128 MinZ = _mm_loadu_ps(Node->MinZ);
+    __m128 MaxX = _mm_loadu_ps(Node->MaxX);
+    __m128 MaxY = _mm_loadu_ps(Node->MaxY);
+    __m128 MaxZ = _mm_loadu_ps(Node->MaxZ);
+
+    __m128 Zero = _mm_setzero_ps();
+    __m128 Outside = Zero;
+    __m128 Straddle = Zero;
+    for (u32 Plane = 0; Plane < 6; ++Plane)
+    {
+        v4 P = Frustum->Planes[Plane];
+        __m128 NX = _mm_set1_ps(P.X);
+        __m128 NY = _mm_set1_ps(P.Y);
+        __m128 NZ = _mm_set1_ps(P.Z);
+
+        // The corner furthest along the normal decides if the box is outside,
+        // the nearest one if it's completely inside.
+        __m128 AX = _mm_mul_ps(NX, MinX);
+        __m128 BX = _mm_mul_ps(NX, MaxX);
+        __m128 AY = _mm_mul_ps(NY, MinY);
+        __m128 BY = _mm_mul_ps(NY, MaxY);
+        __m128 AZ = _mm_mul_ps(NZ, MinZ);
+        __m128 BZ = _mm_mul_ps(NZ, MaxZ);
+
+        __m128 Far = _mm_add_ps(_mm_add_ps(_mm_max_ps(AX, BX), _mm_max_ps(AY, BY)),
+                                _mm_add_ps(_mm_max_ps(AZ, BZ), _mm_set1_ps(P.W)));
+        __m128 Near = _mm_add_ps(_mm_add_ps(_mm_min_ps(AX, BX), _mm_min_ps(AY, BY)),
+                                 _mm_add_ps(_mm_min_ps(AZ, BZ), _mm_set1_ps(P.W)));
+
+        Outside = _mm_or_ps(Outside, _mm_cmplt_ps(Far, Zero));
+        Straddle = _mm_or_ps(Straddle, _mm_cmplt_ps(Near, Zero));
+    }
+
+    u32 OutsideMask = _mm_movemask_ps(Outside);
+    u32 StraddleMask = _mm_movemask_ps(Straddle);
+#else
+    u32 OutsideMask = 0;
+    u32 StraddleMask = 0;
+    for (u32 Slot = 0; Slot < CULL_WIDTH; ++Slot)
+    {
+        for (u32 Plane = 0; Plane < 6; ++Plane)
+        {
+            v4 P = Frustum->Planes[Plane];
+            f32 AX = P.X * Node->MinX[Slot], BX = P.X * Node->MaxX[Slot];
+            f32 AY = P.Y * Node->MinY[Slot], BY = P.Y * Node->MaxY[Slot];
+            f32 AZ = P.Z * Node->MinZ[Slot], BZ = P.Z * Node->MaxZ[Slot];
+            f32 Far = SDL_max(AX, BX) + SDL_max(AY, BY) + SDL_max(AZ, BZ) + P.W;
+            f32 Near = SDL_min(AX, BX) + SDL_min(AY, BY) + SDL_min(AZ, BZ) + P.W;
+            OutsideMask |= (Far < 0) << Slot;
+            StraddleMask |= (Near < 0) << Slot;
+        }
+    }
+#endif
+
+    u32 ValidMask = 0;
+    for (u32 Slot = 0; Slot < CULL_WIDTH; ++Slot)
+    {
+        ValidMask |= (Node->Children[Slot] != CULL_EMPTY) << Slot;
+    }
+
+    u32 Visible = ~OutsideMask & ValidMask;
+    *Inside = Visible & ~StraddleMask;
+    return Visible;
+}
+
+// Writes the indices of all items that may be visible to Visible, which needs
+// room for ItemCount entries. The order follows the tree, not the items.
+u32 CullBvh(cull_bvh *Bvh, frustum *Frustum, u32 *Visible, cull_stats *Stats)
+{
+    u32 VisibleCount = 0;
+    u32 NodesVisited = 0;
+
+    u32 Stack[CULL_STACK_SIZE];
+    u32 StackCount = 0;
+    if (Bvh->NodeCount)
+    {
+        Stack[StackCount++] = 0;
+    }
+
+    while (StackCount)
+    {
+        u32 Entry = Stack[--StackCount];
+        cull_node *Node = Bvh->Nodes + (Entry & ~CULL_INSIDE);
+        NodesVisited++;
+
+        u32 VisibleMask;
+        u32 InsideMask;
+        if (Entry & CULL_INSIDE)
+        {
+            // Parent was fully inside, so is everything below it.
+            VisibleMask = 0;
+            for (u32 Slot = 0; Slot < CULL_WIDTH; ++Slot)
+            {
+                VisibleMask |= (Node->Children[Slot] != CULL_EMPTY) << Slot;
+            }
+            InsideMask = VisibleMask;
+        }
+        else
+        {
+            VisibleMask = CullNodeChildren(Node, Frustum, &InsideMask);
+        }
+
+        for (u32 Slot = 0; Slot < CULL_WIDTH; ++Slot)
+        {
+            if (!(VisibleMask & (1 << Slot)))
+            {
+                continue;
+            }
+
+            u32 Child = Node->Children[Slot];
+            if (Child & CULL_LEAF)
+            {
+                Visible[VisibleCount++] = Child & ~CULL_LEAF;
+            }
+            else
+            {
+                assert(StackCount < CULL_STACK_SIZE);
+                Stack[StackCount++] = Child | ((InsideMask & (1 << Slot)) ? CULL_INSIDE : 0);
+            }
+        }
+    }
+
+    if (Stats)
+    {
+        Stats->Visible = VisibleCount;
+        Stats->Culled = Bvh->ItemCount - VisibleCount;
+        Stats->NodesVisited = NodesVisited;
+    }
+
+    return VisibleCount;
+}
+
+// One box at a time, no hierarchy. Reference for CullBvh.
+u32 CullBoxes(aabb *Bounds, u32 Count, frustum *Frustum, u32 *Visible)
+{
+    u32 VisibleCount = 0;
+    for (u32 I = 0; I < Count; ++I)
+    {
+        bool Outside = false;
+        for (u32 Plane = 0; Plane < 6 && !Outside; ++Plane)
+        {
+            v4 P = Frustum->Planes[Plane];
+            f32 Far = P.W;
+            Far += P.X * (P.X > 0 ? Bounds[I].Max.X : Bounds[I].Min.X);
+            Far += P.Y * (P.Y > 0 ? Bounds[I].Max.Y : Bounds[I].Min.Y);
+            Far += P.Z * (P.Z > 0 ? Bounds[I].Max.Z : Bounds[I].Min.Z);
+            Outside = Far < 0;
+        }
+
+        if (!Outside)
+        {
+            Visible[VisibleCount++] = I;
+        }
+    }
+
+    return VisibleCount;
+}
+
+int CompareU32(const void *A, const void *B)
+{
+    u32 X = *(u32 *) A;
+    u32 Y = *(u32 *) B;
+    return (X > Y) - (X < Y);
+}
+
+// Sorts the visible list so consecutive items can be drawn as one instance
+// range. Returns the number of ranges written to Starts/Counts.
+u32 VisibleRanges(u32 *Visible, u32 VisibleCount, u32 *Starts, u32 *Counts)
+{
+    SDL_qsort(Visible, VisibleCount, sizeof(u32), CompareU32);
+
+    u32 RangeCount = 0;
+    for (u32 I = 0; I < VisibleCount; ++I)
+    {
+        if (RangeCount && Starts[RangeCount - 1] + Counts[RangeCount - 1] == Visible[I])
+        {
+            Counts[RangeCount - 1]++;
+        }
+        else
+        {
+            Starts[RangeCount] = Visible[I];
+            Counts[RangeCount] = 1;
+            RangeCount++;
+        }
+    }
+
+    return RangeCount;
+}
@@ -0,0 +1,469 @@
+// Entity storage for floating objects (buoys, boats, debris...).
+//
+// Every archetype keeps its components as separate, tightly packed f32
+// columns, so a system only touches the columns it actually reads. Rows are
+// kept dense by swap-removing on destroy. Handles go through a slot table with
+// generation counters, so they stay valid when rows move and go stale once the
+// entity is destroyed.
+
+#define ENTITY_CHUNK_SIZE 4096
+#define NULL_SLOT 0xFFFFFFFF
+
+enum entity_field
+{
+    Field_PositionX,
+    Field_PositionY,
+    Field_PositionZ,
+    Field_Yaw,
+    Field_Scale,
+    Field_RotationX,
+    Field_RotationY,
+    Field_RotationZ,
+    Field_RotationW,
+
+    Field_VelocityY,
+    Field_Draft,
+    Field_SlopeX,
+    Field_SlopeZ,
+
+    Field_VelocityX,
+    Field_VelocityZ,
+
+    Field_Count
+};
+
+#define FIELD_BIT(Field) (1u << (Field))
+
+#define COMPONENT_TRANSFORM (FIELD_BIT(Field_PositionX) | FIELD_BIT(Field_PositionY) | FIELD_BIT(Field_PositionZ) | \
+                             FIELD_BIT(Field_Yaw) | FIELD_BIT(Field_Scale) | \
+                             FIELD_BIT(Field_RotationX) | FIELD_BIT(Field_RotationY) | \
+                             FIELD_BIT(Field_RotationZ) | FIELD_BIT(Field_RotationW))
+#define COMPONENT_BUOYANCY (FIELD_BIT(Field_VelocityY) | FIELD_BIT(Field_Draft) | \
+                            FIELD_BIT(Field_SlopeX) | FIELD_BIT(Field_SlopeZ))
+#define COMPONENT_DRIFT (FIELD_BIT(Field_VelocityX) | FIELD_BIT(Field_VelocityZ))
+
+enum archetype_kind
+{
+    Archetype_Buoy,
+    Archetype_Boat,
+    Archetype_Debris,
+
+    Archetype_Count
+};
+
+struct archetype
+{
+    u32 Components;
+    u32 Count;
+    u32 Capacity;
+    f32 *Columns[Field_Count];
+
+    // Slot that owns each row, needed to patch the slot when a row moves.
+    u32 *Slots;
+};
+
+struct entity_handle
+{
+    u32 Index;
+    u32 Generation;
+};
+
+struct entity_slot
+{
+    u32 Generation;
+    u32 Archetype;
+    u32 Row;
+    u32 NextFree;
+};
+
+struct entity_store
+{
+    archetype Archetypes[Archetype_Count];
+
+    u32 SlotCount;
+    u32 SlotCapacity;
+    u32 FreeSlot;
+    entity_slot *Slots;
+
+    u32 EntityCount;
+};
+
+// What the renderer needs per object, filled from the transform columns.
+struct entity_instance
+{
+    v3 Position;
+    f32 Scale;
+    v4 Rotation;
+};
+
+void InitEntityStore(entity_store *Store)
+{
+    *Store = {};
+    Store->FreeSlot = NULL_SLOT;
+
+    Store->Archetypes[Archetype_Buoy].Components = COMPONENT_TRANSFORM | COMPONENT_BUOYANCY;
+    Store->Archetypes[Archetype_Boat].Components = COMPONENT_TRANSFORM | COMPONENT_BUOYANCY | COMPONENT_DRIFT;
+    Store->Archetypes[Archetype_Debris].Components = COMPONENT_TRANSFORM | COMPONENT_BUOYANCY | COMPONENT_DRIFT;
+}
+
+void FreeEntityStore(entity_store *Store)
+{
+    for (u32 Kind = 0; Kind < Archetype_Count; ++Kind)
+    {
+        archetype *Archetype = Store->Archetypes + Kind;
+        for (u32 Field = 0; Field < Field_Count; ++Field)
+        {
+            SDL_aligned_free(Archetype->Columns[Field]);
+        }
+        SDL_free(Archetype->Slots);
+    }
+
+    SDL_free(Store->Slots);
+    *Store = {};
+}
+
+void GrowArchetype(archetype *Archetype)
+{
+    u32 NewCapacity = Archetype->Capacity ? Archetype->Capacity * 2 : ENTITY_CHUNK_SIZE;
+
+    for (u32 Field = 0; Field < Field_Count; ++Field)
+    {
+        if (Archetype->Components & FIELD_BIT(Field))
+        {
+            f32 *Column = (f32 *) SDL_aligned_alloc(64, sizeof(f32) * NewCapacity);
+            assert(Column);
+            if (Archetype->Columns[Field])
+            {
+                SDL_memcpy(Column, Archetype->Columns[Field], sizeof(f32) * Archetype->Count);
+                SDL_aligned_free(Archetype->Columns[Field]);
+            }
+            Archetype->Columns[Field] = Column;
+        }
+    }
+
+    Archetype->Slots = (u32 *) SDL_realloc(Archetype->Slots, sizeof(u32) * NewCapacity);
+    assert(Archetype->Slots);
+    Archetype->Capacity = NewCapacity;
+}
+
+entity_handle CreateEntity(entity_store *Store, archetype_kind Kind)
+{
+    u32 Index = Store->FreeSlot;
+    if (Index != NULL_SLOT)
+    {
+        Store->FreeSlot = Store->Slots[Index].NextFree;
+    }
+    else
+    {
+        if (Store->SlotCount == Store->SlotCapacity)
+        {
+            Store->SlotCapacity = Store->SlotCapacity ? Store->SlotCapacity * 2 : ENTITY_CHUNK_SIZE;
+            Store->Slots = (entity_slot *) SDL_realloc(Store->Slots, sizeof(entity_slot) * Store->SlotCapacity);
+            assert(Store->Slots);
+        }
+
+        Index = Store->SlotCount++;
+        Store->Slots[Index].Generation = 0;
+    }
+
+    archetype *Archetype = Store->Archetypes + Kind;
+    if (Archetype->Count == Archetype->Capacity)
+    {
+        GrowArchetype(Archetype);
+    }
+
+    u32 Row = Archetype->Count++;
+    for (u32 Field = 0; Field < Field_Count; ++Field)
+    {
+        if (Archetype->Columns[Field])
+        {
+            Archetype->Columns[Field][Row] = 0;
+        }
+    }
+    Archetype->Columns[Field_Scale][Row] = 1;
+    Archetype->Columns[Field_RotationW][Row] = 1;
+    Archetype->Slots[Row] = Index;
+
+    entity_slot *Slot = Store->Slots + Index;
+    // NOTE: Generation 0 is never handed out, so a zeroed handle is always invalid.
+    Slot->Generation++;
+    Slot->Archetype = Kind;
+    Slot->Row = Row;
+    Slot->NextFree = NULL_SLOT;
+
+    Store->EntityCount++;
+
+    return { Index, Slot->Generation };
+}
+
+bool IsEntityAlive(entity_store *Store, entity_handle Handle)
+{
+    return Handle.Index < Store->SlotCount &&
+           Store->Slots[Handle.Index].Generation == Handle.Generation &&
+           Store->Slots[Handle.Index].NextFree == NULL_SLOT;
+}
+
+void DestroyEntity(entity_store *Store, entity_handle Handle)
+{
+    if (!IsEntityAlive(Store, Handle))
+    {
+        return;
+    }
+
+    entity_slot *Slot = Store->Slots + Handle.Index;
+    archetype *Archetype = Store->Archetypes + Slot->Archetype;
+
+    // Move the last row into the hole to keep the columns dense.
+    u32 Last = --Archetype->Count;
+    if (Slot->Row != Last)
+    {
+        for (u32 Field = 0; Field < Field_Count; ++Field)
+        {
+            if (Archetype->Columns[Field])
+            {
+                Archetype->Columns[Field][Slot->Row] = Archetype->Columns[Field][Last];
+            }
+        }
+
+        u32 MovedSlot = Archetype->Slots[Last];
+        Archetype->Slots[Slot->Row] = MovedSlot;
+        Store->Slots[MovedSlot].Row = Slot->Row;
+    }
+
+    Slot->Generation++;
+    Slot->NextFree = Store->FreeSlot;
+    Store->FreeSlot = Handle.Index;
+
+    Store->EntityCount--;
+}
+
+// Pointer to one component value of a live entity, or NULL if the entity is
+// dead or its archetype doesn't have that field.
+f32 *GetEntityField(entity_store *Store, entity_handle Handle, entity_field Field)
+{
+    if (!IsEntityAlive(Store, Handle))
+    {
+        return NULL;
+    }
+
+    entity_slot *Slot = Store->Slots + Handle.Index;
+    f32 *Column = Store->Archetypes[Slot->Archetype].Columns[Field];
+    return Column ? Column + Slot->Row : NULL;
+}
+
+void SpawnEntities(entity_store *Store, u32 Count, f32 Extent, u32 *Random)
+{
+    for (u32 I = 0; I < Count; ++I)
+    {
+        u32 Pick = RandomNext(Random) % 8;
+        archetype_kind Kind = Archetype_Debris;
+        if (Pick == 0)
+        {
+            Kind = Archetype_Boat;
+        }
+        else if (Pick < 3)
+        {
+            Kind = Archetype_Buoy;
+        }
+
+        entity_handle Entity = CreateEntity(Store, Kind);
+        *GetEntityField(Store, Entity, Field_PositionX) = RandomBilateral(Random) * Extent;
+        *GetEntityField(Store, Entity, Field_PositionZ) = RandomBilateral(Random) * Extent;
+        *GetEntityField(Store, Entity, Field_Yaw) = RandomUnilateral(Random) * 2 * PI;
+
+        if (Kind == Archetype_Boat)
+        {
+            *GetEntityField(Store, Entity, Field_Scale) = 0.05f;
+            *GetEntityField(Store, Entity, Field_Draft) = 0.01f;
+            *GetEntityField(Store, Entity, Field_VelocityX) = RandomBilateral(Random) * 0.05f;
+            *GetEntityField(Store, Entity, Field_VelocityZ) = RandomBilateral(Random) * 0.05f;
+        }
+        else if (Kind == Archetype_Buoy)
+        {
+            *GetEntityField(Store, Entity, Field_Scale) = 0.02f;
+            *GetEntityField(Store, Entity, Field_Draft) = 0.005f;
+        }
+        else
+        {
+            *GetEntityField(Store, Entity, Field_Scale) = 0.01f + RandomUnilateral(Random) * 0.01f;
+            *GetEntityField(Store, Entity, Field_VelocityX) = RandomBilateral(Random) * 0.01f;
+            *GetEntityField(Store, Entity, Field_VelocityZ) = RandomBilateral(Random) * 0.01f;
+        }
+    }
+}
+
+// Systems...
+//
+struct entity_system_data
+{
+    archetype *Archetype;
+    u8 *NoiseData;
+    u32 OctaveCount;
+    f32 Time;
+    f32 Delta;
+    entity_instance *Instances;
+};
+
+void DriftJob(void *Data, u32 Start, u32 End)
+{
+    entity_system_data *System = (entity_system_data *) Data;
+    f32 *PositionX = System->Archetype->Columns[Field_PositionX];
+    f32 *PositionZ = System->Archetype->Columns[Field_PositionZ];
+    f32 *VelocityX = System->Archetype->Columns[Field_VelocityX];
+    f32 *VelocityZ = System->Archetype->Columns[Field_VelocityZ];
+    f32 Delta = System->Delta;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        PositionX[I] += VelocityX[I] * Delta;
+        PositionZ[I] += VelocityZ[I] * Delta;
+    }
+}
+
+// Springs every object towards the water surface and records the surface
+// slope under it for the transform update.
+void BuoyancyJob(void *Data, u32 Start, u32 End)
+{
+    entity_system_data *System = (entity_system_data *) Data;
+    f32 *PositionX = System->Archetype->Columns[Field_PositionX];
+    f32 *PositionY = System->Archetype->Columns[Field_PositionY];
+    f32 *PositionZ = System->Archetype->Columns[Field_PositionZ];
+    f32 *VelocityY = System->Archetype->Columns[Field_VelocityY];
+    f32 *Draft = System->Archetype->Columns[Field_Draft];
+    f32 *SlopeX = System->Archetype->Columns[Field_SlopeX];
+    f32 *SlopeZ = System->Archetype->Columns[Field_SlopeZ];
+    u8 *NoiseData = System->NoiseData;
+    u32 OctaveCount = System->OctaveCount;
+    f32 Time = System->Time;
+    f32 Delta = System->Delta;
+
+    f32 Stiffness = 40.0f;
+    f32 Damping = 6.0f;
+    f32 Epsilon = 0.01f;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        f32 X = PositionX[I];
+        f32 Z = PositionZ[I];
+        f32 Height = WaterHeight(NoiseData, OctaveCount, X, Z, Time);
+        f32 HeightX = WaterHeight(NoiseData, OctaveCount, X + Epsilon, Z, Time);
+        f32 HeightZ = WaterHeight(NoiseData, OctaveCount, X, Z + Epsilon, Time);
+
+        f32 Target = Height - Draft[I];
+        VelocityY[I] += ((Target - PositionY[I]) * Stiffness - VelocityY[I] * Damping) * Delta;
+        PositionY[I] += VelocityY[I] * Delta;
+
+        SlopeX[I] = (HeightX - Height) / Epsilon;
+        SlopeZ[I] = (HeightZ - Height) / Epsilon;
+    }
+}
+
+// Rotation = tilt onto the surface normal * yaw around Y.
+void TransformJob(void *Data, u32 Start, u32 End)
+{
+    entity_system_data *System = (entity_system_data *) Data;
+    f32 *Yaw = System->Archetype->Columns[Field_Yaw];
+    f32 *SlopeX = System->Archetype->Columns[Field_SlopeX];
+    f32 *SlopeZ = System->Archetype->Columns[Field_SlopeZ];
+    f32 *RotationX = System->Archetype->Columns[Field_RotationX];
+    f32 *RotationY = System->Archetype->Columns[Field_RotationY];
+    f32 *RotationZ = System->Archetype->Columns[Field_RotationZ];
+    f32 *RotationW = System->Archetype->Columns[Field_RotationW];
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        f32 TiltX = 0;
+        f32 TiltZ = 0;
+        f32 TiltW = 1;
+        if (SlopeX)
+        {
+            // Shortest arc from (0, 1, 0) to the normal (-SlopeX, 1, -SlopeZ)
+            f32 InvLength = 1.0f / sqrtf(SlopeX[I] * SlopeX[I] + 1 + SlopeZ[I] * SlopeZ[I]);
+            f32 NormalX = -SlopeX[I] * InvLength;
+            f32 NormalY = InvLength;
+            f32 NormalZ = -SlopeZ[I] * InvLength;
+
+            TiltX = NormalZ;
+            TiltZ = -NormalX;
+            TiltW = 1 + NormalY;
+            f32 InvTilt = 1.0f / sqrtf(TiltX * TiltX + TiltZ * TiltZ + TiltW * TiltW);
+            TiltX *= InvTilt;
+            TiltZ *= InvTilt;
+            TiltW *= InvTilt;
+        }
+
+        f32 YawY = sinf(Yaw[I] * 0.5f);
+        f32 YawW = cosf(Yaw[I] * 0.5f);
+
+        RotationX[I] = TiltX * YawW - TiltZ * YawY;
+        RotationY[I] = TiltW * YawY;
+        RotationZ[I] = TiltZ * YawW + TiltX * YawY;
+        RotationW[I] = TiltW * YawW;
+    }
+}
+
+void InstanceFillJob(void *Data, u32 Start, u32 End)
+{
+    entity_system_data *System = (entity_system_data *) Data;
+    f32 **Columns = System->Archetype->Columns;
+    entity_instance *Instances = System->Instances;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        entity_instance *Instance = Instances + I;
+        Instance->Position = V3(Columns[Field_PositionX][I], Columns[Field_PositionY][I], Columns[Field_PositionZ][I]);
+        Instance->Scale = Columns[Field_Scale][I];
+        Instance->Rotation = V4(Columns[Field_RotationX][I], Columns[Field_RotationY][I],
+                                Columns[Field_RotationZ][I], Columns[Field_RotationW][I]);
+    }
+}
+
+void UpdateEntities(entity_store *Store, u8 *NoiseData, u32 OctaveCount, f32 Time, f32 Delta)
+{
+    for (u32 Kind = 0; Kind < Archetype_Count; ++Kind)
+    {
+        archetype *Archetype = Store->Archetypes + Kind;
+
+        entity_system_data System = {};
+        System.Archetype = Archetype;
+        System.NoiseData = NoiseData;
+        System.OctaveCount = OctaveCount;
+        System.Time = Time;
+        System.Delta = Delta;
+
+        if ((Archetype->Components & COMPONENT_DRIFT) == COMPONENT_DRIFT)
+        {
+            ParallelFor(Archetype->Count, ENTITY_CHUNK_SIZE, DriftJob, &System);
+        }
+
+        if ((Archetype->Components & COMPONENT_BUOYANCY) == COMPONENT_BUOYANCY)
+        {
+            ParallelFor(Archetype->Count, ENTITY_CHUNK_SIZE, BuoyancyJob, &System);
+        }
+
+        ParallelFor(Archetype->Count, ENTITY_CHUNK_SIZE, TransformJob, &System);
+    }
+}
+
+// Writes all instances grouped by archetype. Offsets receives where each
+// archetype's instances start. Returns the total instance count.
+u32 FillEntityInstances(entity_store *Store, entity_instance *Instances, u32 *Offsets)
+{
+    u32 Count = 0;
+    for (u32 Kind = 0; Kind < Archetype_Count; ++Kind)
+    {
+        entity_system_data System = {};
+        System.Archetype = Store->Archetypes + Kind;
+        System.Instances = Instances + Count;
+
+        if (Offsets)
+        {
+            Offsets[Kind] = Count;
+        }
+
+        ParallelFor(System.Archetype->Count, ENTITY_CHUNK_SIZE, InstanceFillJob, &System);
+        Count += System.Archetype->Count;
+    }
+
+    return Count;
+}
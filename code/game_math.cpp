@@ -46,6 +46,19 @@ inline v2 V2(f32 X, f32 Y)
     return {X, Y};
 }
 
+struct v4
+{
+    f32 X;
+    f32 Y;
+    f32 Z;
+    f32 W;
+};
+
+inline v4 V4(f32 X, f32 Y, f32 Z, f32 W)
+{
+    return {X, Y, Z, W};
+}
+
 v3 Norm(v3 A)
 {
     f32 Len = Length(A);
@@ -128,3 +141,62 @@ mat4 Perspective(f32 Fov, f32 Aspect, f32 NearPlane, f32 FarPlane)
 
     return Res;
 }
+
+mat4 Identity()
+{
+    mat4 Res = {};
+    Res.V[0] = 1;
+    Res.V[5] = 1;
+    Res.V[10] = 1;
+    Res.V[15] = 1;
+    return Res;
+}
+
+mat4 Translation(v3 Offset)
+{
+    mat4 Res = Identity();
+    Res.V[12] = Offset.X;
+    Res.V[13] = Offset.Y;
+    Res.V[14] = Offset.Z;
+    return Res;
+}
+
+// Column major like everything above, so Multiply(A, B) applies B first.
+mat4 Multiply(mat4 A, mat4 B)
+{
+    mat4 Res = {};
+    for (u32 Column = 0; Column < 4; ++Column)
+    {
+        for (u32 Row = 0; Row < 4; ++Row)
+        {
+            f32 Sum = 0;
+            for (u32 K = 0; K < 4; ++K)
+            {
+                Sum += A.V[K * 4 + Row] * B.V[Column * 4 + K];
+            }
+            Res.V[Column * 4 + Row] = Sum;
+        }
+    }
+    return Res;
+}
+
+// xorshift32, State must not be zero
+inline u32 RandomNext(u32 *State)
+{
+    u32 X = *State;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    *State = X;
+    return X;
+}
+
+inline f32 RandomUnilateral(u32 *State)
+{
+    return (f32) (RandomNext(State) >> 8) / (f32) (1 << 24);
+}
+
+inline f32 RandomBilateral(u32 *State)
+{
+    return RandomUnilateral(State) * 2 - 1;
+}
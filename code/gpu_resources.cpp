@@ -0,0 +1,637 @@
+// GPU resource registry.
+//
+// Every buffer, texture, transfer buffer, sampler and pipeline goes through
+// the Create* functions here, which record its size, usage and category and
+// the frame it was last used in. Categories have budgets. Creating something
+// in a category that's over budget first evicts the least recently used
+// streamable resources of that category (the ones created with an evict
+// callback) that weren't used this frame. Nothing else ever gets evicted, a
+// category full of resident resources just goes over budget and says so.
+//
+// Releases are deferred: the handle leaves the registry right away, but the
+// SDL object is only released once the fence of the frame it was released in
+// has signaled. SubmitGpuFrame submits with a fence for that.
+
+#define GPU_REGISTRY_SLOTS 4096
+#define GPU_MAX_PENDING_RELEASES 1024
+#define GPU_FRAMES_IN_FLIGHT 3
+
+enum gpu_category
+{
+    GpuCategory_Geometry,
+    GpuCategory_Textures,
+    GpuCategory_Targets,
+    GpuCategory_Streaming,
+    // Buffers rewritten every frame (object data, instances).
+    GpuCategory_Dynamic,
+    GpuCategory_Upload,
+    // Pipelines and samplers, these don't have a size.
+    GpuCategory_State,
+
+    GpuCategory_Count,
+};
+
+const char *GpuCategoryNames[GpuCategory_Count] = {
+    "geometry",
+    "textures",
+    "targets",
+    "streaming",
+    "dynamic",
+    "upload",
+    "state",
+};
+
+// Defaults, SetGpuBudget changes them. 0 is unlimited.
+u64 DefaultGpuBudgets[GpuCategory_Count] = {
+    256 * 1024 * 1024,
+    256 * 1024 * 1024,
+    128 * 1024 * 1024,
+    256 * 1024 * 1024,
+    64 * 1024 * 1024,
+    128 * 1024 * 1024,
+    0,
+};
+
+enum gpu_resource_kind
+{
+    GpuResource_Buffer,
+    GpuResource_Texture,
+    GpuResource_TransferBuffer,
+    GpuResource_Sampler,
+    GpuResource_Pipeline,
+};
+
+// Called when a streamable resource gets evicted, the owner has to forget the
+// handle. Runs with the registry locked, don't call back into it.
+typedef void gpu_evict_func(void *Data, void *Handle);
+
+struct gpu_resource
+{
+    // NULL for an empty slot.
+    void *Handle;
+    gpu_resource_kind Kind;
+    gpu_category Category;
+    const char *Name;
+
+    // SDL_GPU*USAGE flags as passed to SDL.
+    u32 Usage;
+    u64 Size;
+    u64 CreatedFrame;
+    u64 LastUsedFrame;
+
+    gpu_evict_func *Evict;
+    void *EvictData;
+};
+
+struct gpu_pending_release
+{
+    void *Handle;
+    gpu_resource_kind Kind;
+    gpu_category Category;
+    u64 Size;
+    // Safe to release once this frame is done on the GPU.
+    u64 Frame;
+};
+
+struct gpu_category_stats
+{
+    u64 Budget;
+    u64 Bytes;
+    u64 PeakBytes;
+    u32 Count;
+
+    // Released, waiting for the GPU.
+    u64 PendingBytes;
+
+    u64 Evictions;
+    u64 EvictedBytes;
+    bool OverBudget;
+};
+
+struct gpu_registry
+{
+    SDL_GPUDevice *Device;
+    SDL_Mutex *Lock;
+
+    // Frame being recorded. Every frame up to CompletedFrame is done on the GPU.
+    u64 Frame;
+    u64 CompletedFrame;
+    SDL_GPUFence *Fences[GPU_FRAMES_IN_FLIGHT];
+    u64 FenceFrames[GPU_FRAMES_IN_FLIGHT];
+
+    // Open addressing on the handle.
+    u32 Count;
+    gpu_resource Resources[GPU_REGISTRY_SLOTS];
+
+    u32 PendingCount;
+    gpu_pending_release Pending[GPU_MAX_PENDING_RELEASES];
+
+    gpu_category_stats Categories[GpuCategory_Count];
+};
+
+void InitGpuRegistry(gpu_registry *Registry, SDL_GPUDevice *Device)
+{
+    SDL_memset(Registry, 0, sizeof(*Registry));
+    Registry->Device = Device;
+    Registry->Lock = SDL_CreateMutex();
+    Registry->Frame = 1;
+    for (u32 Category = 0; Category < GpuCategory_Count; ++Category)
+    {
+        Registry->Categories[Category].Budget = DefaultGpuBudgets[Category];
+    }
+}
+
+inline u32 GpuResourceSlot(void *Handle)
+{
+    u64 Key = (u64) (uintptr_t) Handle;
+    Key ^= Key >> 33;
+    Key *= 0xFF51AFD7ED558CCDull;
+    Key ^= Key >> 33;
+    return (u32) Key & (GPU_REGISTRY_SLOTS - 1);
+}
+
+gpu_resource *FindGpuResource(gpu_registry *Registry, void *Handle)
+{
+    for (u32 Slot = GpuResourceSlot(Handle); ; Slot = (Slot + 1) & (GPU_REGISTRY_SLOTS - 1))
+    {
+        gpu_resource *Resource = Registry->Resources + Slot;
+        if (Resource->Handle == Handle)
+        {
+            return Resource;
+        }
+        if (!Resource->Handle)
+        {
+            return NULL;
+        }
+    }
+}
+
+// Backward shift deletion, so lookups never need tombstones.
+void RemoveGpuResource(gpu_registry *Registry, gpu_resource *Resource)
+{
+    u32 Hole = (u32) (Resource - Registry->Resources);
+    u32 Slot = Hole;
+    while (true)
+    {
+        Slot = (Slot + 1) & (GPU_REGISTRY_SLOTS - 1);
+        gpu_resource *Next = Registry->Resources + Slot;
+        if (!Next->Handle)
+        {
+            break;
+        }
+
+        // Only move entries whose home slot isn't between the hole and them.
+        u32 Home = GpuResourceSlot(Next->Handle);
+        if (((Slot - Home) & (GPU_REGISTRY_SLOTS - 1)) >= ((Slot - Hole) & (GPU_REGISTRY_SLOTS - 1)))
+        {
+            Registry->Resources[Hole] = *Next;
+            Hole = Slot;
+        }
+    }
+
+    Registry->Resources[Hole] = {};
+    Registry->Count--;
+}
+
+void ReleaseGpuHandle(SDL_GPUDevice *Device, gpu_resource_kind Kind, void *Handle)
+{
+    switch (Kind)
+    {
+        case GpuResource_Buffer: {
+            SDL_ReleaseGPUBuffer(Device, (SDL_GPUBuffer *) Handle);
+            break;
+        }
+        case GpuResource_Texture: {
+            SDL_ReleaseGPUTexture(Device, (SDL_GPUTexture *) Handle);
+            break;
+        }
+        case GpuResource_TransferBuffer: {
+            SDL_ReleaseGPUTransferBuffer(Device, (SDL_GPUTransferBuffer *) Handle);
+            break;
+        }
+        case GpuResource_Sampler: {
+            SDL_ReleaseGPUSampler(Device, (SDL_GPUSampler *) Handle);
+            break;
+        }
+        case GpuResource_Pipeline: {
+            SDL_ReleaseGPUGraphicsPipeline(Device, (SDL_GPUGraphicsPipeline *) Handle);
+            break;
+        }
+    }
+}
+
+// Releases everything whose last frame is done. Registry has to be locked.
+void ReleaseCompletedGpuResources(gpu_registry *Registry)
+{
+    u32 Kept = 0;
+    for (u32 I = 0; I < Registry->PendingCount; ++I)
+    {
+        gpu_pending_release *Release = Registry->Pending + I;
+        if (Release->Frame <= Registry->CompletedFrame)
+        {
+            ReleaseGpuHandle(Registry->Device, Release->Kind, Release->Handle);
+            Registry->Categories[Release->Category].PendingBytes -= Release->Size;
+        }
+        else
+        {
+            Registry->Pending[Kept++] = *Release;
+        }
+    }
+    Registry->PendingCount = Kept;
+}
+
+// Waits for every submitted frame. Registry has to be locked.
+void WaitForGpuFramesLocked(gpu_registry *Registry)
+{
+    for (u32 I = 0; I < GPU_FRAMES_IN_FLIGHT; ++I)
+    {
+        if (Registry->Fences[I])
+        {
+            SDL_WaitForGPUFences(Registry->Device, true, Registry->Fences + I, 1);
+            SDL_ReleaseGPUFence(Registry->Device, Registry->Fences[I]);
+            Registry->CompletedFrame = SDL_max(Registry->CompletedFrame, Registry->FenceFrames[I]);
+            Registry->Fences[I] = NULL;
+        }
+    }
+}
+
+// Takes the handle out of the registry, the SDL object goes once the GPU is
+// done with it. Registry has to be locked.
+void ReleaseGpuResourceLocked(gpu_registry *Registry, gpu_resource *Resource)
+{
+    // Pending stays sorted by frame. Only wait if that frees something, the
+    // ones from this frame can't complete before it's submitted.
+    if (Registry->PendingCount == GPU_MAX_PENDING_RELEASES && Registry->Pending[0].Frame < Registry->Frame)
+    {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "GPU registry: too many pending releases, waiting for the GPU");
+        WaitForGpuFramesLocked(Registry);
+        ReleaseCompletedGpuResources(Registry);
+    }
+
+    gpu_category_stats *Stats = Registry->Categories + Resource->Category;
+    Stats->Bytes -= Resource->Size;
+    Stats->Count--;
+
+    if (Registry->PendingCount == GPU_MAX_PENDING_RELEASES)
+    {
+        // Everything still pending was released this frame, so let SDL have
+        // this one right away. It keeps objects alive until the command
+        // buffers using them are done anyway, we only lose the pending
+        // accounting for it.
+        ReleaseGpuHandle(Registry->Device, Resource->Kind, Resource->Handle);
+    }
+    else
+    {
+        // NOTE: Not LastUsedFrame. Not every bind touches, and commands recorded
+        // this frame may still reference it.
+        gpu_pending_release *Release = Registry->Pending + Registry->PendingCount++;
+        Release->Handle = Resource->Handle;
+        Release->Kind = Resource->Kind;
+        Release->Category = Resource->Category;
+        Release->Size = Resource->Size;
+        Release->Frame = Registry->Frame;
+        Stats->PendingBytes += Resource->Size;
+    }
+
+    RemoveGpuResource(Registry, Resource);
+}
+
+// Evicts least recently used streamables in Category until Size more bytes
+// fit. Registry has to be locked.
+void MakeRoomInCategory(gpu_registry *Registry, gpu_category Category, u64 Size)
+{
+    gpu_category_stats *Stats = Registry->Categories + Category;
+    if (!Stats->Budget)
+    {
+        return;
+    }
+
+    while (Stats->Bytes + Size > Stats->Budget)
+    {
+        // NOTE: A linear scan, the registry holds a few hundred resources at most.
+        gpu_resource *Oldest = NULL;
+        for (u32 Slot = 0; Slot < GPU_REGISTRY_SLOTS; ++Slot)
+        {
+            gpu_resource *Resource = Registry->Resources + Slot;
+            if (Resource->Handle && Resource->Category == Category && Resource->Evict &&
+                Resource->LastUsedFrame < Registry->Frame &&
+                (!Oldest || Resource->LastUsedFrame < Oldest->LastUsedFrame))
+            {
+                Oldest = Resource;
+            }
+        }
+
+        if (!Oldest)
+        {
+            if (!Stats->OverBudget)
+            {
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "GPU registry: %s over budget (%.1f of %.1f MB)",
+                            GpuCategoryNames[Category], (Stats->Bytes + Size) / (1024.0 * 1024.0),
+                            Stats->Budget / (1024.0 * 1024.0));
+                Stats->OverBudget = true;
+            }
+            return;
+        }
+
+        Stats->Evictions++;
+        Stats->EvictedBytes += Oldest->Size;
+        Oldest->Evict(Oldest->EvictData, Oldest->Handle);
+        ReleaseGpuResourceLocked(Registry, Oldest);
+    }
+
+    Stats->OverBudget = false;
+}
+
+// Evicts before creating, so the new resource fits.
+void ReserveGpuResource(gpu_registry *Registry, gpu_category Category, u64 Size)
+{
+    SDL_LockMutex(Registry->Lock);
+    MakeRoomInCategory(Registry, Category, Size);
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+void RegisterGpuResource(gpu_registry *Registry, void *Handle, gpu_resource_kind Kind, gpu_category Category,
+                         const char *Name, u32 Usage, u64 Size, gpu_evict_func *Evict, void *EvictData)
+{
+    if (!Handle)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "GPU registry: creating %s failed: %s", Name, SDL_GetError());
+        return;
+    }
+
+    SDL_LockMutex(Registry->Lock);
+    assert(Registry->Count < GPU_REGISTRY_SLOTS * 3 / 4);
+
+    gpu_resource *Resource = Registry->Resources + GpuResourceSlot(Handle);
+    while (Resource->Handle)
+    {
+        assert(Resource->Handle != Handle);
+        Resource = Registry->Resources + ((Resource - Registry->Resources + 1) & (GPU_REGISTRY_SLOTS - 1));
+    }
+
+    Resource->Handle = Handle;
+    Resource->Kind = Kind;
+    Resource->Category = Category;
+    Resource->Name = Name;
+    Resource->Usage = Usage;
+    Resource->Size = Size;
+    Resource->CreatedFrame = Registry->Frame;
+    Resource->LastUsedFrame = Registry->Frame;
+    Resource->Evict = Evict;
+    Resource->EvictData = EvictData;
+    Registry->Count++;
+
+    gpu_category_stats *Stats = Registry->Categories + Category;
+    Stats->Bytes += Size;
+    Stats->PeakBytes = SDL_max(Stats->PeakBytes, Stats->Bytes);
+    Stats->Count++;
+
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+u64 GpuTextureSize(SDL_GPUTextureCreateInfo *Info)
+{
+    u64 Size = 0;
+    for (u32 Level = 0; Level < Info->num_levels; ++Level)
+    {
+        u32 Width = SDL_max(Info->width >> Level, 1u);
+        u32 Height = SDL_max(Info->height >> Level, 1u);
+        Size += SDL_CalculateGPUTextureFormatSize(Info->format, Width, Height, Info->layer_count_or_depth);
+    }
+
+    // SDL_GPU_SAMPLECOUNT_1 is 0, every step doubles.
+    return Size << Info->sample_count;
+}
+
+// Creation...
+//
+// Pass Evict to make a resource streamable.
+SDL_GPUBuffer *CreateGpuBuffer(gpu_registry *Registry, gpu_category Category, const char *Name,
+                               SDL_GPUBufferCreateInfo *Info, gpu_evict_func *Evict = NULL, void *EvictData = NULL)
+{
+    ReserveGpuResource(Registry, Category, Info->size);
+    SDL_GPUBuffer *Buffer = SDL_CreateGPUBuffer(Registry->Device, Info);
+    RegisterGpuResource(Registry, Buffer, GpuResource_Buffer, Category, Name, Info->usage, Info->size, Evict, EvictData);
+    return Buffer;
+}
+
+SDL_GPUTexture *CreateGpuTexture(gpu_registry *Registry, gpu_category Category, const char *Name,
+                                 SDL_GPUTextureCreateInfo *Info, gpu_evict_func *Evict = NULL, void *EvictData = NULL)
+{
+    u64 Size = GpuTextureSize(Info);
+    ReserveGpuResource(Registry, Category, Size);
+    SDL_GPUTexture *Texture = SDL_CreateGPUTexture(Registry->Device, Info);
+    RegisterGpuResource(Registry, Texture, GpuResource_Texture, Category, Name, Info->usage, Size, Evict, EvictData);
+    return Texture;
+}
+
+SDL_GPUTransferBuffer *CreateGpuTransferBuffer(gpu_registry *Registry, const char *Name,
+                                               SDL_GPUTransferBufferCreateInfo *Info)
+{
+    ReserveGpuResource(Registry, GpuCategory_Upload, Info->size);
+    SDL_GPUTransferBuffer *Buffer = SDL_CreateGPUTransferBuffer(Registry->Device, Info);
+    RegisterGpuResource(Registry, Buffer, GpuResource_TransferBuffer, GpuCategory_Upload, Name, Info->usage,
+                        Info->size, NULL, NULL);
+    return Buffer;
+}
+
+SDL_GPUSampler *CreateGpuSampler(gpu_registry *Registry, const char *Name, SDL_GPUSamplerCreateInfo *Info)
+{
+    SDL_GPUSampler *Sampler = SDL_CreateGPUSampler(Registry->Device, Info);
+    RegisterGpuResource(Registry, Sampler, GpuResource_Sampler, GpuCategory_State, Name, 0, 0, NULL, NULL);
+    return Sampler;
+}
+
+SDL_GPUGraphicsPipeline *CreateGpuPipeline(gpu_registry *Registry, const char *Name,
+                                           SDL_GPUGraphicsPipelineCreateInfo *Info)
+{
+    SDL_GPUGraphicsPipeline *Pipeline = SDL_CreateGPUGraphicsPipeline(Registry->Device, Info);
+    RegisterGpuResource(Registry, Pipeline, GpuResource_Pipeline, GpuCategory_State, Name, 0, 0, NULL, NULL);
+    return Pipeline;
+}
+
+// Use and release...
+//
+// Call for whatever gets bound this frame. Keeps streamables from being
+// evicted and their release from happening before the GPU is done.
+void TouchGpuResource(gpu_registry *Registry, void *Handle)
+{
+    SDL_LockMutex(Registry->Lock);
+    gpu_resource *Resource = FindGpuResource(Registry, Handle);
+    if (Resource)
+    {
+        Resource->LastUsedFrame = Registry->Frame;
+    }
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+// NULL and unknown handles are ignored, so owners can release unconditionally.
+void ReleaseGpuResource(gpu_registry *Registry, void *Handle)
+{
+    if (!Handle)
+    {
+        return;
+    }
+
+    SDL_LockMutex(Registry->Lock);
+    gpu_resource *Resource = FindGpuResource(Registry, Handle);
+    if (Resource)
+    {
+        ReleaseGpuResourceLocked(Registry, Resource);
+    }
+    else
+    {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "GPU registry: releasing unknown resource %p", Handle);
+    }
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+void SetGpuBudget(gpu_registry *Registry, gpu_category Category, u64 Budget)
+{
+    SDL_LockMutex(Registry->Lock);
+    Registry->Categories[Category].Budget = Budget;
+    MakeRoomInCategory(Registry, Category, 0);
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+// Frames...
+//
+// Submits the frame's command buffer with a fence and starts the next frame.
+// Keeps at most GPU_FRAMES_IN_FLIGHT fences, waiting for the oldest if needed.
+void SubmitGpuFrame(gpu_registry *Registry, SDL_GPUCommandBuffer *CommandBuffer)
+{
+    SDL_GPUFence *Fence = SDL_SubmitGPUCommandBufferAndAcquireFence(CommandBuffer);
+
+    SDL_LockMutex(Registry->Lock);
+    u32 Slot = Registry->Frame % GPU_FRAMES_IN_FLIGHT;
+    if (Registry->Fences[Slot])
+    {
+        SDL_WaitForGPUFences(Registry->Device, true, Registry->Fences + Slot, 1);
+        SDL_ReleaseGPUFence(Registry->Device, Registry->Fences[Slot]);
+        Registry->CompletedFrame = SDL_max(Registry->CompletedFrame, Registry->FenceFrames[Slot]);
+    }
+    Registry->Fences[Slot] = Fence;
+    Registry->FenceFrames[Slot] = Registry->Frame;
+
+    // Frames finish in order, the newest signaled fence covers all before it.
+    for (u32 I = 0; I < GPU_FRAMES_IN_FLIGHT; ++I)
+    {
+        if (Registry->Fences[I] && SDL_QueryGPUFence(Registry->Device, Registry->Fences[I]))
+        {
+            SDL_ReleaseGPUFence(Registry->Device, Registry->Fences[I]);
+            Registry->CompletedFrame = SDL_max(Registry->CompletedFrame, Registry->FenceFrames[I]);
+            Registry->Fences[I] = NULL;
+        }
+    }
+
+    ReleaseCompletedGpuResources(Registry);
+    Registry->Frame++;
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+// For frames that got cancelled instead of submitted.
+void SkipGpuFrame(gpu_registry *Registry)
+{
+    SDL_LockMutex(Registry->Lock);
+    Registry->Frame++;
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+// Waits until the GPU is done with everything submitted so far and releases
+// what was waiting on it.
+void WaitForGpuFrames(gpu_registry *Registry)
+{
+    SDL_LockMutex(Registry->Lock);
+    WaitForGpuFramesLocked(Registry);
+    ReleaseCompletedGpuResources(Registry);
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+// Waits for the whole device, for code that submits without SubmitGpuFrame
+// (uploads, benchmarks). Everything released so far is gone afterwards.
+void FlushGpuResources(gpu_registry *Registry)
+{
+    SDL_WaitForGPUIdle(Registry->Device);
+
+    SDL_LockMutex(Registry->Lock);
+    WaitForGpuFramesLocked(Registry);
+    Registry->CompletedFrame = Registry->Frame;
+    ReleaseCompletedGpuResources(Registry);
+    Registry->Frame++;
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+// Reporting...
+//
+void ReportGpuResources(gpu_registry *Registry)
+{
+    SDL_LockMutex(Registry->Lock);
+
+    u64 TotalBytes = 0;
+    u32 TotalCount = 0;
+    printf("GPU memory (frame %llu):\n", (unsigned long long) Registry->Frame);
+    for (u32 Category = 0; Category < GpuCategory_Count; ++Category)
+    {
+        gpu_category_stats *Stats = Registry->Categories + Category;
+        TotalBytes += Stats->Bytes;
+        TotalCount += Stats->Count;
+
+        char Budget[32] = "unlimited";
+        if (Stats->Budget)
+        {
+            SDL_snprintf(Budget, sizeof(Budget), "%.1f MB", Stats->Budget / (1024.0 * 1024.0));
+        }
+        printf("  %-9s | %4u | %9.2f MB | peak %9.2f MB | budget %-9s | pending %7.2f MB | %5llu evictions%s\n",
+               GpuCategoryNames[Category], Stats->Count, Stats->Bytes / (1024.0 * 1024.0),
+               Stats->PeakBytes / (1024.0 * 1024.0), Budget, Stats->PendingBytes / (1024.0 * 1024.0),
+               (unsigned long long) Stats->Evictions, Stats->OverBudget ? " | OVER BUDGET" : "");
+    }
+    printf("  total     | %4u | %9.2f MB | %u releases pending\n", TotalCount, TotalBytes / (1024.0 * 1024.0),
+           Registry->PendingCount);
+
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+// One line for the periodic log.
+void LogGpuResources(gpu_registry *Registry)
+{
+    SDL_LockMutex(Registry->Lock);
+
+    char Line[512];
+    u32 Length = SDL_snprintf(Line, sizeof(Line), "GPU memory:");
+    u64 TotalBytes = 0;
+    for (u32 Category = 0; Category < GpuCategory_Count; ++Category)
+    {
+        gpu_category_stats *Stats = Registry->Categories + Category;
+        TotalBytes += Stats->Bytes;
+        if (Stats->Count && Length < sizeof(Line))
+        {
+            Length += SDL_snprintf(Line + Length, sizeof(Line) - Length, " %s %.1f MB,", GpuCategoryNames[Category],
+                                   Stats->Bytes / (1024.0 * 1024.0));
+        }
+    }
+    SDL_Log("%s total %.1f MB in %u resources, %u releases pending", Line, TotalBytes / (1024.0 * 1024.0),
+            Registry->Count, Registry->PendingCount);
+
+    SDL_UnlockMutex(Registry->Lock);
+}
+
+// Whatever is still registered leaked, it gets logged and released.
+void ShutdownGpuRegistry(gpu_registry *Registry)
+{
+    FlushGpuResources(Registry);
+
+    for (u32 Slot = 0; Slot < GPU_REGISTRY_SLOTS; ++Slot)
+    {
+        gpu_resource *Resource = Registry->Resources + Slot;
+        if (Resource->Handle)
+        {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "GPU registry: %s (%s, %llu bytes) was never released",
+                        Resource->Name, GpuCategoryNames[Resource->Category], (unsigned long long) Resource->Size);
+            ReleaseGpuHandle(Registry->Device, Resource->Kind, Resource->Handle);
+        }
+    }
+
+    SDL_DestroyMutex(Registry->Lock);
+    SDL_memset(Registry, 0, sizeof(*Registry));
+}
@@ -0,0 +1,925 @@
+// Out-of-core heightfield streaming.
+//
+// A heightfield file holds a square height map of 16 bit samples as a mip
+// pyramid of fixed size tiles. Every tile is stored with a one sample border
+// taken from its neighbours, so a tile can be copied into any page of the
+// atlas texture on its own and bilinear filtering still works at the edges.
+// The file is memory mapped and tiles are copied straight out of the mapping.
+//
+// The streamer keeps a square of tiles around the camera resident on every
+// level and evicts the least recently used pages when the atlas (the memory
+// budget) is full. The coarsest level is a single tile that never leaves.
+// Shaders look tiles up through the page table, a texture with one mip per
+// level where every texel names the atlas page to sample. A tile that isn't
+// resident points at the closest resident tile above it.
+
+#define HEIGHTFIELD_MAGIC 0x444C4648
+#define HEIGHTFIELD_VERSION 1
+#define HEIGHTFIELD_TILE_SIZE 128
+#define HEIGHTFIELD_BORDER 1
+#define HEIGHTFIELD_PAGE_SIZE (HEIGHTFIELD_TILE_SIZE + 2 * HEIGHTFIELD_BORDER)
+#define HEIGHTFIELD_PAGE_BYTES (HEIGHTFIELD_PAGE_SIZE * HEIGHTFIELD_PAGE_SIZE * sizeof(u16))
+#define MAX_HEIGHTFIELD_LEVELS 16
+#define HEIGHTFIELD_NO_PAGE 0xFFFFFFFF
+
+// Feature size of the coarsest generated octave, in level 0 samples.
+#define HEIGHTFIELD_MAX_FEATURE 4096
+
+// The terrain grid covers TERRAIN_GRID_EXTENT level 0 samples on each side of
+// the camera. World units per sample, so the terrain fits the water scene.
+#define TERRAIN_GRID_SEGMENTS 64
+#define TERRAIN_GRID_EXTENT 1024
+#define TERRAIN_WORLD_SCALE 0.05f
+
+struct heightfield_header
+{
+    u32 Magic;
+    u32 Version;
+
+    // Samples per side on level 0, HEIGHTFIELD_TILE_SIZE times a power of two.
+    u32 Size;
+    u32 LevelCount;
+
+    // World units between level 0 samples and world height of the largest sample.
+    f32 SampleSpacing;
+    f32 HeightScale;
+
+    // Tiles per side and where the first one starts. Tiles are row major.
+    u32 LevelTiles[MAX_HEIGHTFIELD_LEVELS];
+    u64 LevelOffsets[MAX_HEIGHTFIELD_LEVELS];
+};
+
+// Generation...
+//
+// Octaves of the baked noise, finest first dropped on the coarser levels so
+// every level is band limited for its sample spacing instead of aliasing.
+//
+// Heights for Count samples of one row, starting at level sample X, Y. Same
+// filtering as SampleNoise, with everything that only depends on the row
+// pulled out of the inner loop.
+void GenerateHeightRow(u8 *NoiseData, u32 Level, u32 X, u32 Y, u32 Count, f32 *Heights)
+{
+    f32 Footprint = (f32) (1 << Level);
+    for (u32 I = 0; I < Count; ++I)
+    {
+        Heights[I] = 0;
+    }
+
+    f32 Constant = 0;
+    f32 Amplitude = 0.5f;
+    f32 Total = 0;
+    u32 Octave = 0;
+    for (f32 Feature = HEIGHTFIELD_MAX_FEATURE; Feature >= 8; Feature *= 0.5f)
+    {
+        if (Feature >= 4 * Footprint)
+        {
+            // The noise texture has 16 features per repeat, shift every octave
+            // so they don't line up. Samples are taken at the center of their
+            // footprint in level 0 samples.
+            f32 Scale = Footprint / (Feature * 16) * NOISE_SIZE;
+            f32 TexelY = (Y + 0.5f) * Scale + Octave * 0.61f * NOISE_SIZE - 0.5f;
+            f32 FloorY = floorf(TexelY);
+            f32 TY = TexelY - FloorY;
+            u8 *Row0 = NoiseData + NOISE_SIZE * ((u32) (i32) FloorY & (NOISE_SIZE - 1));
+            u8 *Row1 = NoiseData + NOISE_SIZE * (((u32) (i32) FloorY + 1) & (NOISE_SIZE - 1));
+
+            // Along the row the filter is linear inside a texel, so the
+            // vertical lerp only happens once per texel.
+            f32 Weight = Amplitude / 255.0f;
+            f32 FirstTexelX = (X + 0.5f) * Scale + Octave * 0.37f * NOISE_SIZE - 0.5f;
+            u32 I = 0;
+            while (I < Count)
+            {
+                f32 FloorX = floorf(FirstTexelX + I * Scale);
+                u32 X0 = (u32) (i32) FloorX & (NOISE_SIZE - 1);
+                u32 X1 = (X0 + 1) & (NOISE_SIZE - 1);
+                f32 Left = Row0[X0] + (Row1[X0] - Row0[X0]) * TY;
+                f32 Right = Row0[X1] + (Row1[X1] - Row0[X1]) * TY;
+
+                // NOTE: The first sample always goes in, TX can round up to 1
+                // just below zero.
+                u32 First = I;
+                do
+                {
+                    f32 TX = FirstTexelX + I * Scale - FloorX;
+                    if (TX >= 1 && I != First)
+                    {
+                        break;
+                    }
+                    Heights[I] += (Left + (Right - Left) * TX) * Weight;
+                } while (++I < Count);
+            }
+        }
+        else
+        {
+            Constant += 0.5f * Amplitude;
+        }
+
+        Total += Amplitude;
+        Amplitude *= 0.5f;
+        Octave++;
+    }
+
+    for (u32 I = 0; I < Count; ++I)
+    {
+        Heights[I] = (Heights[I] + Constant) / Total;
+    }
+}
+
+inline u16 QuantizeHeight(f32 Height)
+{
+    return (u16) (SDL_clamp(Height, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+struct heightfield_job_data
+{
+    u8 *NoiseData;
+    u32 Size;
+    u32 Level;
+    u32 TileY;
+    u8 *Output;
+};
+
+void GenerateTileJob(void *Data, u32 Start, u32 End)
+{
+    heightfield_job_data *Job = (heightfield_job_data *) Data;
+    i32 LevelSize = (i32) (Job->Size >> Job->Level);
+
+    for (u32 TileX = Start; TileX < End; ++TileX)
+    {
+        u16 *Page = (u16 *) (Job->Output + (u64) TileX * HEIGHTFIELD_PAGE_BYTES);
+
+        // The border is clamped at the edges of the map.
+        i32 FirstX = (i32) (TileX * HEIGHTFIELD_TILE_SIZE) - HEIGHTFIELD_BORDER;
+        i32 ClampedFirstX = SDL_max(FirstX, 0);
+        u32 Count = (u32) (SDL_min(FirstX + HEIGHTFIELD_PAGE_SIZE, LevelSize) - ClampedFirstX);
+
+        for (u32 Y = 0; Y < HEIGHTFIELD_PAGE_SIZE; ++Y)
+        {
+            i32 SampleY = SDL_clamp((i32) (Job->TileY * HEIGHTFIELD_TILE_SIZE + Y) - HEIGHTFIELD_BORDER, 0, LevelSize - 1);
+
+            f32 Heights[HEIGHTFIELD_PAGE_SIZE];
+            GenerateHeightRow(Job->NoiseData, Job->Level, ClampedFirstX, SampleY, Count, Heights);
+            for (u32 X = 0; X < HEIGHTFIELD_PAGE_SIZE; ++X)
+            {
+                i32 Index = SDL_clamp(FirstX + (i32) X, 0, LevelSize - 1) - ClampedFirstX;
+                Page[Y * HEIGHTFIELD_PAGE_SIZE + X] = QuantizeHeight(Heights[Index]);
+            }
+        }
+    }
+}
+
+inline bool IsHeightfieldSize(u32 Size)
+{
+    return Size >= HEIGHTFIELD_TILE_SIZE && (Size & (Size - 1)) == 0;
+}
+
+// Writes a procedural heightfield with Size samples per side. Returns the
+// file size, 0 if it couldn't be written, a partial file is removed again.
+u64 WriteHeightfield(const char *Path, u32 Size, u32 Seed, f32 SampleSpacing, f32 HeightScale)
+{
+    assert(IsHeightfieldSize(Size));
+
+    heightfield_header Header = {};
+    Header.Magic = HEIGHTFIELD_MAGIC;
+    Header.Version = HEIGHTFIELD_VERSION;
+    Header.Size = Size;
+    Header.SampleSpacing = SampleSpacing;
+    Header.HeightScale = HeightScale;
+
+    u64 Offset = sizeof(heightfield_header);
+    for (u32 Tiles = Size / HEIGHTFIELD_TILE_SIZE; ; Tiles /= 2)
+    {
+        assert(Header.LevelCount < MAX_HEIGHTFIELD_LEVELS);
+        Header.LevelTiles[Header.LevelCount] = Tiles;
+        Header.LevelOffsets[Header.LevelCount] = Offset;
+        Header.LevelCount++;
+        Offset += (u64) Tiles * Tiles * HEIGHTFIELD_PAGE_BYTES;
+        if (Tiles == 1)
+        {
+            break;
+        }
+    }
+
+    SDL_IOStream *Stream = SDL_IOFromFile(Path, "wb");
+    if (!Stream)
+    {
+        return 0;
+    }
+
+    u8 *NoiseData = (u8 *) SDL_malloc(NOISE_SIZE * NOISE_SIZE);
+    BakeNoise(NoiseData, Seed);
+
+    bool Written = SDL_WriteIO(Stream, &Header, sizeof(Header)) == sizeof(Header);
+
+    // One row of tiles at a time.
+    u32 MaxTiles = Header.LevelTiles[0];
+    u8 *Row = (u8 *) SDL_malloc((u64) MaxTiles * HEIGHTFIELD_PAGE_BYTES);
+    for (u32 Level = 0; Level < Header.LevelCount && Written; ++Level)
+    {
+        u32 Tiles = Header.LevelTiles[Level];
+        for (u32 TileY = 0; TileY < Tiles && Written; ++TileY)
+        {
+            heightfield_job_data Job = {};
+            Job.NoiseData = NoiseData;
+            Job.Size = Size;
+            Job.Level = Level;
+            Job.TileY = TileY;
+            Job.Output = Row;
+            ParallelFor(Tiles, 1, GenerateTileJob, &Job);
+
+            u64 RowBytes = (u64) Tiles * HEIGHTFIELD_PAGE_BYTES;
+            Written = SDL_WriteIO(Stream, Row, RowBytes) == RowBytes;
+        }
+    }
+
+    SDL_free(Row);
+    SDL_free(NoiseData);
+    Written = SDL_CloseIO(Stream) && Written;
+    if (!Written)
+    {
+        SDL_RemovePath(Path);
+    }
+
+    return Written ? Offset : 0;
+}
+
+// Streaming...
+//
+struct heightfield_page
+{
+    u32 Level;
+    u32 TileX;
+    u32 TileY;
+    u64 LastUsedFrame;
+
+    // LRU list, head is the most recently used. Pinned pages aren't in it.
+    u32 Prev;
+    u32 Next;
+};
+
+struct heightfield_stats
+{
+    u64 Requests;
+    u64 Faults;
+    u64 Loads;
+    u64 Evictions;
+
+    // Faults that had to wait for a later frame (upload limit or full budget).
+    u64 Deferred;
+    u64 BytesStreamed;
+    u64 StreamNS;
+};
+
+struct heightfield_streamer
+{
+    mapped_file File;
+    heightfield_header *Header;
+
+    // Tiles kept around the camera on every level: (2 * Radius + 1)^2.
+    u32 Radius;
+    u32 MaxLoadsPerFrame;
+    u64 Frame;
+
+    u32 AtlasPages;
+    u32 PageCount;
+    heightfield_page *Pages;
+    u32 FreePageCount;
+    u32 *FreePages;
+    u32 LruHead;
+    u32 LruTail;
+
+    // Page index for every tile of every level, or HEIGHTFIELD_NO_PAGE.
+    u32 *Residency;
+    u32 ResidencyOffsets[MAX_HEIGHTFIELD_LEVELS];
+
+    // RGBA8 per tile: atlas page x, page y, level of that page, 255.
+    u32 *PageTable;
+    u32 PageTableTexels;
+    bool PageTableDirty;
+
+    // Loads of the current frame.
+    u32 LoadCount;
+    u32 *LoadPages;
+
+    // GPU side, all NULL when streaming without a device (benchmarks).
+    SDL_GPUTexture *Atlas;
+    SDL_GPUTexture *PageTableTexture;
+    SDL_GPUTransferBuffer *Staging;
+    u8 *CpuStaging;
+
+    heightfield_stats Stats;
+};
+
+inline u32 *TileResidency(heightfield_streamer *Streamer, u32 Level, u32 TileX, u32 TileY)
+{
+    return Streamer->Residency + Streamer->ResidencyOffsets[Level] + TileY * Streamer->Header->LevelTiles[Level] + TileX;
+}
+
+inline u8 *TileData(heightfield_streamer *Streamer, u32 Level, u32 TileX, u32 TileY)
+{
+    u64 Tile = (u64) TileY * Streamer->Header->LevelTiles[Level] + TileX;
+    return Streamer->File.Data + Streamer->Header->LevelOffsets[Level] + Tile * HEIGHTFIELD_PAGE_BYTES;
+}
+
+void LruRemove(heightfield_streamer *Streamer, u32 Index)
+{
+    heightfield_page *Page = Streamer->Pages + Index;
+    if (Page->Prev != HEIGHTFIELD_NO_PAGE)
+    {
+        Streamer->Pages[Page->Prev].Next = Page->Next;
+    }
+    else
+    {
+        Streamer->LruHead = Page->Next;
+    }
+
+    if (Page->Next != HEIGHTFIELD_NO_PAGE)
+    {
+        Streamer->Pages[Page->Next].Prev = Page->Prev;
+    }
+    else
+    {
+        Streamer->LruTail = Page->Prev;
+    }
+}
+
+void LruPushFront(heightfield_streamer *Streamer, u32 Index)
+{
+    heightfield_page *Page = Streamer->Pages + Index;
+    Page->Prev = HEIGHTFIELD_NO_PAGE;
+    Page->Next = Streamer->LruHead;
+    if (Streamer->LruHead != HEIGHTFIELD_NO_PAGE)
+    {
+        Streamer->Pages[Streamer->LruHead].Prev = Index;
+    }
+    else
+    {
+        Streamer->LruTail = Index;
+    }
+    Streamer->LruHead = Index;
+}
+
+// The atlas is BudgetBytes rounded down to whole pages. Device may be NULL,
+// tiles then only get copied to CPU memory.
+bool OpenHeightfield(heightfield_streamer *Streamer, const char *Path, u64 BudgetBytes, u32 Radius, u32 MaxLoadsPerFrame)
+{
+    *Streamer = {};
+    Streamer->Radius = Radius;
+    Streamer->MaxLoadsPerFrame = MaxLoadsPerFrame;
+    Streamer->LruHead = HEIGHTFIELD_NO_PAGE;
+    Streamer->LruTail = HEIGHTFIELD_NO_PAGE;
+
+    if (!MapFile(&Streamer->File, Path, true))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't open heightfield %s", Path);
+        return false;
+    }
+
+    heightfield_header *Header = (heightfield_header *) Streamer->File.Data;
+    bool Valid = Streamer->File.Size >= sizeof(heightfield_header) && Header->Magic == HEIGHTFIELD_MAGIC &&
+                 Header->Version == HEIGHTFIELD_VERSION && Header->LevelCount > 0 &&
+                 Header->LevelCount <= MAX_HEIGHTFIELD_LEVELS;
+    if (Valid)
+    {
+        // The finest level has to be a power of two tiles across and every
+        // level exactly half the one below, the page table is laid out that
+        // way. Levels have to lie inside the file, the streamer reads tiles
+        // straight out of the mapping. Catches files that were cut short while
+        // being written. Positions get divided by the spacing.
+        u32 FirstTiles = Header->LevelTiles[0];
+        Valid = FirstTiles > 0 && (FirstTiles & (FirstTiles - 1)) == 0 &&
+                (FirstTiles >> (Header->LevelCount - 1)) == 1 &&
+                (u64) FirstTiles * HEIGHTFIELD_TILE_SIZE == Header->Size &&
+                Header->SampleSpacing > 0 && isfinite(Header->SampleSpacing) && isfinite(Header->HeightScale);
+        for (u32 Level = 0; Valid && Level < Header->LevelCount; ++Level)
+        {
+            u64 Tiles = Header->LevelTiles[Level];
+            u64 Offset = Header->LevelOffsets[Level];
+            u64 LevelBytes = Tiles * Tiles * HEIGHTFIELD_PAGE_BYTES;
+            Valid = Tiles == (FirstTiles >> Level) && Offset >= sizeof(heightfield_header) &&
+                    Offset <= Streamer->File.Size && LevelBytes <= Streamer->File.Size - Offset;
+        }
+    }
+
+    if (!Valid)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s is not a heightfield", Path);
+        UnmapFile(&Streamer->File);
+        return false;
+    }
+    Streamer->Header = Header;
+
+    // Square atlas, at least big enough for what one frame can ask for.
+    u32 Requested = Header->LevelCount * (2 * Radius + 1) * (2 * Radius + 1) + 1;
+    u32 AtlasPages = 1;
+    while ((u64) (AtlasPages + 1) * (AtlasPages + 1) * HEIGHTFIELD_PAGE_BYTES <= BudgetBytes)
+    {
+        AtlasPages++;
+    }
+    while (AtlasPages * AtlasPages < Requested)
+    {
+        AtlasPages++;
+    }
+    // Page coordinates have to fit in 8 bits of the page table.
+    AtlasPages = SDL_min(AtlasPages, 256u);
+
+    Streamer->AtlasPages = AtlasPages;
+    Streamer->PageCount = AtlasPages * AtlasPages;
+    Streamer->Pages = (heightfield_page *) SDL_calloc(Streamer->PageCount, sizeof(heightfield_page));
+    Streamer->FreePages = (u32 *) SDL_malloc(sizeof(u32) * Streamer->PageCount);
+    for (u32 I = 0; I < Streamer->PageCount; ++I)
+    {
+        Streamer->FreePages[I] = Streamer->PageCount - 1 - I;
+    }
+    Streamer->FreePageCount = Streamer->PageCount;
+
+    u32 TileCount = 0;
+    for (u32 Level = 0; Level < Header->LevelCount; ++Level)
+    {
+        Streamer->ResidencyOffsets[Level] = TileCount;
+        TileCount += Header->LevelTiles[Level] * Header->LevelTiles[Level];
+    }
+    Streamer->Residency = (u32 *) SDL_malloc(sizeof(u32) * TileCount);
+    SDL_memset(Streamer->Residency, 0xFF, sizeof(u32) * TileCount);
+    Streamer->PageTable = (u32 *) SDL_calloc(TileCount, sizeof(u32));
+    Streamer->PageTableTexels = TileCount;
+    Streamer->LoadPages = (u32 *) SDL_malloc(sizeof(u32) * MaxLoadsPerFrame);
+
+    u32 StagingSize = MaxLoadsPerFrame * HEIGHTFIELD_PAGE_BYTES + TileCount * sizeof(u32);
+    if (State.Device)
+    {
+        SDL_GPUTextureCreateInfo TextureInfo = {};
+        TextureInfo.type = SDL_GPU_TEXTURETYPE_2D;
+        TextureInfo.format = SDL_GPU_TEXTUREFORMAT_R16_UNORM;
+        TextureInfo.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+        TextureInfo.width = AtlasPages * HEIGHTFIELD_PAGE_SIZE;
+        TextureInfo.height = AtlasPages * HEIGHTFIELD_PAGE_SIZE;
+        TextureInfo.layer_count_or_depth = 1;
+        TextureInfo.num_levels = 1;
+        Streamer->Atlas = CreateGpuTexture(&State.Resources, GpuCategory_Streaming, "heightfield atlas", &TextureInfo);
+
+        TextureInfo.format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+        TextureInfo.width = Header->LevelTiles[0];
+        TextureInfo.height = Header->LevelTiles[0];
+        TextureInfo.num_levels = Header->LevelCount;
+        Streamer->PageTableTexture = CreateGpuTexture(&State.Resources, GpuCategory_Streaming, "page table", &TextureInfo);
+
+        SDL_GPUTransferBufferCreateInfo StagingInfo = {};
+        StagingInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+        StagingInfo.size = StagingSize;
+        Streamer->Staging = CreateGpuTransferBuffer(&State.Resources, "heightfield staging", &StagingInfo);
+    }
+    else
+    {
+        Streamer->CpuStaging = (u8 *) SDL_malloc(StagingSize);
+    }
+
+    SDL_Log("Heightfield %s: %u^2 samples, %u levels, %.1f MB, atlas %u^2 pages (%.1f MB)", Path,
+            Header->Size, Header->LevelCount, Streamer->File.Size / (1024.0 * 1024.0),
+            AtlasPages, Streamer->PageCount * (f64) HEIGHTFIELD_PAGE_BYTES / (1024.0 * 1024.0));
+
+    return true;
+}
+
+void CloseHeightfield(heightfield_streamer *Streamer)
+{
+    if (State.Device)
+    {
+        ReleaseGpuResource(&State.Resources, Streamer->Staging);
+        ReleaseGpuResource(&State.Resources, Streamer->PageTableTexture);
+        ReleaseGpuResource(&State.Resources, Streamer->Atlas);
+    }
+
+    SDL_free(Streamer->CpuStaging);
+    SDL_free(Streamer->LoadPages);
+    SDL_free(Streamer->PageTable);
+    SDL_free(Streamer->Residency);
+    SDL_free(Streamer->FreePages);
+    SDL_free(Streamer->Pages);
+    UnmapFile(&Streamer->File);
+    *Streamer = {};
+}
+
+// Hands out a page for a new tile: a free one, or the least recently used one
+// that wasn't needed this frame. HEIGHTFIELD_NO_PAGE if the budget is used up.
+u32 AllocatePage(heightfield_streamer *Streamer)
+{
+    if (Streamer->FreePageCount)
+    {
+        return Streamer->FreePages[--Streamer->FreePageCount];
+    }
+
+    u32 Index = Streamer->LruTail;
+    if (Index == HEIGHTFIELD_NO_PAGE || Streamer->Pages[Index].LastUsedFrame == Streamer->Frame)
+    {
+        return HEIGHTFIELD_NO_PAGE;
+    }
+
+    heightfield_page *Page = Streamer->Pages + Index;
+    LruRemove(Streamer, Index);
+    *TileResidency(Streamer, Page->Level, Page->TileX, Page->TileY) = HEIGHTFIELD_NO_PAGE;
+    Streamer->Stats.Evictions++;
+    Streamer->PageTableDirty = true;
+
+    return Index;
+}
+
+void LoadTile(heightfield_streamer *Streamer, u32 Level, u32 TileX, u32 TileY, bool Pinned)
+{
+    u32 Index = AllocatePage(Streamer);
+    if (Index == HEIGHTFIELD_NO_PAGE)
+    {
+        Streamer->Stats.Deferred++;
+        return;
+    }
+
+    heightfield_page *Page = Streamer->Pages + Index;
+    Page->Level = Level;
+    Page->TileX = TileX;
+    Page->TileY = TileY;
+    Page->LastUsedFrame = Streamer->Frame;
+    if (!Pinned)
+    {
+        LruPushFront(Streamer, Index);
+    }
+
+    *TileResidency(Streamer, Level, TileX, TileY) = Index;
+    Streamer->LoadPages[Streamer->LoadCount++] = Index;
+    Streamer->PageTableDirty = true;
+}
+
+// Every tile points at its own page, or at whatever its parent points at.
+void RebuildPageTable(heightfield_streamer *Streamer)
+{
+    heightfield_header *Header = Streamer->Header;
+    for (i32 Level = Header->LevelCount - 1; Level >= 0; --Level)
+    {
+        u32 Tiles = Header->LevelTiles[Level];
+        u32 *Entries = Streamer->PageTable + Streamer->ResidencyOffsets[Level];
+        u32 *Parents = Streamer->PageTable + Streamer->ResidencyOffsets[SDL_min(Level + 1, (i32) Header->LevelCount - 1)];
+        u32 ParentTiles = Header->LevelTiles[SDL_min(Level + 1, (i32) Header->LevelCount - 1)];
+
+        for (u32 TileY = 0; TileY < Tiles; ++TileY)
+        {
+            for (u32 TileX = 0; TileX < Tiles; ++TileX)
+            {
+                u32 Index = *TileResidency(Streamer, Level, TileX, TileY);
+                u32 Entry;
+                if (Index != HEIGHTFIELD_NO_PAGE)
+                {
+                    u32 PageX = Index % Streamer->AtlasPages;
+                    u32 PageY = Index / Streamer->AtlasPages;
+                    Entry = PageX | (PageY << 8) | ((u32) Level << 16) | (0xFFu << 24);
+                }
+                else
+                {
+                    Entry = Parents[(TileY / 2) * ParentTiles + TileX / 2];
+                }
+                Entries[TileY * Tiles + TileX] = Entry;
+            }
+        }
+    }
+
+    Streamer->PageTableDirty = false;
+}
+
+// Requests the tiles around the camera (world X/Z) on every level, coarsest
+// first, and streams in what's missing. With a command buffer the new pages
+// and the page table get uploaded, which has to happen before the render pass.
+void UpdateHeightfield(heightfield_streamer *Streamer, f32 CameraX, f32 CameraZ, SDL_GPUCommandBuffer *CommandBuffer)
+{
+    heightfield_header *Header = Streamer->Header;
+    u64 Start = SDL_GetTicksNS();
+
+    Streamer->Frame++;
+    Streamer->LoadCount = 0;
+
+    u32 TopLevel = Header->LevelCount - 1;
+    if (*TileResidency(Streamer, TopLevel, 0, 0) == HEIGHTFIELD_NO_PAGE)
+    {
+        LoadTile(Streamer, TopLevel, 0, 0, true);
+    }
+
+    // Touch everything that's wanted first, so none of it gets evicted for
+    // another tile of the same frame.
+    i32 Radius = (i32) Streamer->Radius;
+    for (i32 Pass = 0; Pass < 2; ++Pass)
+    {
+        for (i32 Level = TopLevel - 1; Level >= 0; --Level)
+        {
+            i32 Tiles = (i32) Header->LevelTiles[Level];
+            f32 TileWorldSize = Header->SampleSpacing * HEIGHTFIELD_TILE_SIZE * (f32) (1 << Level);
+            // Clamped before the cast, far outside the terrain is all the same.
+            f32 Margin = (f32) (Radius + 1);
+            i32 CenterX = (i32) SDL_clamp(floorf(CameraX / TileWorldSize), -Margin, Tiles + Margin);
+            i32 CenterY = (i32) SDL_clamp(floorf(CameraZ / TileWorldSize), -Margin, Tiles + Margin);
+
+            for (i32 TileY = SDL_max(CenterY - Radius, 0); TileY <= SDL_min(CenterY + Radius, Tiles - 1); ++TileY)
+            {
+                for (i32 TileX = SDL_max(CenterX - Radius, 0); TileX <= SDL_min(CenterX + Radius, Tiles - 1); ++TileX)
+                {
+                    u32 Index = *TileResidency(Streamer, Level, TileX, TileY);
+                    if (Pass == 0)
+                    {
+                        Streamer->Stats.Requests++;
+                        if (Index != HEIGHTFIELD_NO_PAGE)
+                        {
+                            Streamer->Pages[Index].LastUsedFrame = Streamer->Frame;
+                            LruRemove(Streamer, Index);
+                            LruPushFront(Streamer, Index);
+                        }
+                        else
+                        {
+                            Streamer->Stats.Faults++;
+                        }
+                    }
+                    else if (Index == HEIGHTFIELD_NO_PAGE)
+                    {
+                        if (Streamer->LoadCount < Streamer->MaxLoadsPerFrame)
+                        {
+                            LoadTile(Streamer, Level, TileX, TileY, false);
+                        }
+                        else
+                        {
+                            Streamer->Stats.Deferred++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    bool Upload = Streamer->LoadCount || Streamer->PageTableDirty;
+    if (Streamer->PageTableDirty)
+    {
+        RebuildPageTable(Streamer);
+    }
+
+    if (Upload)
+    {
+        u8 *StagingData = Streamer->CpuStaging;
+        if (Streamer->Staging)
+        {
+            StagingData = (u8 *) SDL_MapGPUTransferBuffer(State.Device, Streamer->Staging, true);
+        }
+
+        for (u32 I = 0; I < Streamer->LoadCount; ++I)
+        {
+            heightfield_page *Page = Streamer->Pages + Streamer->LoadPages[I];
+            SDL_memcpy(StagingData + I * HEIGHTFIELD_PAGE_BYTES, TileData(Streamer, Page->Level, Page->TileX, Page->TileY),
+                       HEIGHTFIELD_PAGE_BYTES);
+        }
+        u32 PageTableOffset = Streamer->MaxLoadsPerFrame * HEIGHTFIELD_PAGE_BYTES;
+        SDL_memcpy(StagingData + PageTableOffset, Streamer->PageTable, sizeof(u32) * Streamer->PageTableTexels);
+
+        if (Streamer->Staging)
+        {
+            SDL_UnmapGPUTransferBuffer(State.Device, Streamer->Staging);
+        }
+
+        if (Streamer->Staging && CommandBuffer)
+        {
+            SDL_GPUCopyPass *CopyPass = SDL_BeginGPUCopyPass(CommandBuffer);
+            for (u32 I = 0; I < Streamer->LoadCount; ++I)
+            {
+                u32 Index = Streamer->LoadPages[I];
+
+                SDL_GPUTextureTransferInfo Source = {};
+                Source.transfer_buffer = Streamer->Staging;
+                Source.offset = I * HEIGHTFIELD_PAGE_BYTES;
+
+                SDL_GPUTextureRegion Dest = {};
+                Dest.texture = Streamer->Atlas;
+                Dest.x = (Index % Streamer->AtlasPages) * HEIGHTFIELD_PAGE_SIZE;
+                Dest.y = (Index / Streamer->AtlasPages) * HEIGHTFIELD_PAGE_SIZE;
+                Dest.w = HEIGHTFIELD_PAGE_SIZE;
+                Dest.h = HEIGHTFIELD_PAGE_SIZE;
+                Dest.d = 1;
+                SDL_UploadToGPUTexture(CopyPass, &Source, &Dest, false);
+            }
+
+            for (u32 Level = 0; Level < Header->LevelCount; ++Level)
+            {
+                SDL_GPUTextureTransferInfo Source = {};
+                Source.transfer_buffer = Streamer->Staging;
+                Source.offset = PageTableOffset + sizeof(u32) * Streamer->ResidencyOffsets[Level];
+
+                SDL_GPUTextureRegion Dest = {};
+                Dest.texture = Streamer->PageTableTexture;
+                Dest.mip_level = Level;
+                Dest.w = Header->LevelTiles[Level];
+                Dest.h = Header->LevelTiles[Level];
+                Dest.d = 1;
+                SDL_UploadToGPUTexture(CopyPass, &Source, &Dest, false);
+            }
+            SDL_EndGPUCopyPass(CopyPass);
+        }
+    }
+
+    Streamer->Stats.Loads += Streamer->LoadCount;
+    Streamer->Stats.BytesStreamed += (u64) Streamer->LoadCount * HEIGHTFIELD_PAGE_BYTES;
+    Streamer->Stats.StreamNS += SDL_GetTicksNS() - Start;
+}
+
+// Height in world units from the resident pages, the same page table lookup
+// terrain.vert does, minus the filtering. Lets the CPU check what the GPU sees.
+f32 SampleHeightfield(heightfield_streamer *Streamer, f32 WorldX, f32 WorldZ, u32 Level)
+{
+    heightfield_header *Header = Streamer->Header;
+    Level = SDL_min(Level, Header->LevelCount - 1);
+
+    f32 X = WorldX / (Header->SampleSpacing * HEIGHTFIELD_TILE_SIZE * (f32) (1 << Level));
+    f32 Y = WorldZ / (Header->SampleSpacing * HEIGHTFIELD_TILE_SIZE * (f32) (1 << Level));
+    u32 Tiles = Header->LevelTiles[Level];
+    u32 TileX = (u32) SDL_clamp(floorf(X), 0.0f, (f32) (Tiles - 1));
+    u32 TileY = (u32) SDL_clamp(floorf(Y), 0.0f, (f32) (Tiles - 1));
+
+    u32 Entry = Streamer->PageTable[Streamer->ResidencyOffsets[Level] + TileY * Tiles + TileX];
+    u32 Index = (Entry & 0xFF) + ((Entry >> 8) & 0xFF) * Streamer->AtlasPages;
+    u32 ResidentLevel = (Entry >> 16) & 0xFF;
+    heightfield_page *Page = Streamer->Pages + Index;
+
+    // Position inside the resident tile, in samples.
+    f32 Scale = 1.0f / (f32) (1 << (ResidentLevel - Level));
+    f32 SampleX = SDL_clamp((X * Scale - Page->TileX) * HEIGHTFIELD_TILE_SIZE, 0.0f, HEIGHTFIELD_TILE_SIZE - 1.0f);
+    f32 SampleY = SDL_clamp((Y * Scale - Page->TileY) * HEIGHTFIELD_TILE_SIZE, 0.0f, HEIGHTFIELD_TILE_SIZE - 1.0f);
+
+    u16 *Samples = (u16 *) TileData(Streamer, ResidentLevel, Page->TileX, Page->TileY);
+    u32 SX = (u32) SampleX + HEIGHTFIELD_BORDER;
+    u32 SY = (u32) SampleY + HEIGHTFIELD_BORDER;
+    return Samples[SY * HEIGHTFIELD_PAGE_SIZE + SX] / 65535.0f * Header->HeightScale;
+}
+
+// Rendering...
+//
+// Matches TerrainUniform in terrain.vert.
+struct terrain_uniforms
+{
+    // Terrain position (in samples) under the world origin, world height of
+    // zero, tiles kept around the camera.
+    v4 Origin;
+    // World units per sample, world height of the largest sample, atlas pages
+    // per side, level count.
+    v4 Params;
+    // Grid extent and spacing in samples.
+    v4 Grid;
+};
+
+struct terrain_renderer
+{
+    SDL_GPUGraphicsPipeline *Pipeline;
+    SDL_GPUSampler *Sampler;
+    SDL_GPUBuffer *VertexBuffer;
+    SDL_GPUBuffer *IndexBuffer;
+    u32 IndexCount;
+};
+
+// Takes ownership of the shaders.
+SDL_GPUGraphicsPipeline *CreateTerrainPipeline(SDL_GPUShader *Vertex, SDL_GPUShader *Fragment,
+                                               SDL_GPUTextureFormat ColorFormat, SDL_GPUTextureFormat DepthFormat)
+{
+    SDL_GPUVertexBufferDescription BufferDescription = {};
+    BufferDescription.slot = 0;
+    BufferDescription.pitch = sizeof(vertex);
+    BufferDescription.input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX;
+
+    // Only the grid position, the height comes from the atlas.
+    SDL_GPUVertexAttribute VertexAttribute = { 0, 0, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3, offsetof(vertex, Position) };
+
+    SDL_GPUColorTargetDescription SwapchainTargetDescription = {};
+    SwapchainTargetDescription.format = ColorFormat;
+
+    SDL_GPUGraphicsPipelineCreateInfo PipelineInfo = {};
+    PipelineInfo.vertex_shader = Vertex;
+    PipelineInfo.fragment_shader = Fragment;
+    PipelineInfo.vertex_input_state.vertex_buffer_descriptions = &BufferDescription;
+    PipelineInfo.vertex_input_state.num_vertex_buffers = 1;
+    PipelineInfo.vertex_input_state.vertex_attributes = &VertexAttribute;
+    PipelineInfo.vertex_input_state.num_vertex_attributes = 1;
+
+    PipelineInfo.depth_stencil_state.enable_depth_test = true;
+    PipelineInfo.depth_stencil_state.enable_depth_write = true;
+    PipelineInfo.depth_stencil_state.compare_op = SDL_GPU_COMPAREOP_LESS;
+
+    PipelineInfo.target_info.color_target_descriptions = &SwapchainTargetDescription;
+    PipelineInfo.target_info.num_color_targets = 1;
+    PipelineInfo.target_info.has_depth_stencil_target = true;
+    PipelineInfo.target_info.depth_stencil_format = DepthFormat;
+
+    SDL_GPUGraphicsPipeline *Pipeline = CreateGpuPipeline(&State.Resources, "terrain", &PipelineInfo);
+    assert(Pipeline);
+
+    SDL_ReleaseGPUShader(State.Device, Vertex);
+    SDL_ReleaseGPUShader(State.Device, Fragment);
+
+    return Pipeline;
+}
+
+// Returns false if the shaders haven't been built.
+bool InitTerrainRenderer(terrain_renderer *Renderer, SDL_GPUTextureFormat ColorFormat, SDL_GPUTextureFormat DepthFormat)
+{
+    *Renderer = {};
+
+    const char *VertexPath = "assets/terrain.vert.spv";
+    const char *FragmentPath = "assets/terrain.frag.spv";
+    if (!SDL_GetPathInfo(VertexPath, NULL) || !SDL_GetPathInfo(FragmentPath, NULL))
+    {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%s missing, no terrain. Run make!", VertexPath);
+        return false;
+    }
+
+    SDL_GPUShader *Vertex = LoadShader(VertexPath, 2, 0, 2, false);
+    SDL_GPUShader *Fragment = LoadShader(FragmentPath, 0, 0, 1, true);
+    Renderer->Pipeline = CreateTerrainPipeline(Vertex, Fragment, ColorFormat, DepthFormat);
+
+    // Pages have their own border, clamping only matters at the atlas edge.
+    SDL_GPUSamplerCreateInfo SamplerInfo = {};
+    SamplerInfo.min_filter = SDL_GPU_FILTER_LINEAR;
+    SamplerInfo.mag_filter = SDL_GPU_FILTER_LINEAR;
+    SamplerInfo.mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_NEAREST;
+    SamplerInfo.address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+    SamplerInfo.address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+    SamplerInfo.address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+    Renderer->Sampler = CreateGpuSampler(&State.Resources, "terrain", &SamplerInfo);
+
+    u32 VertexCount = (2 * TERRAIN_GRID_SEGMENTS + 1) * (2 * TERRAIN_GRID_SEGMENTS + 1);
+    u32 IndexCapacity = 2 * TERRAIN_GRID_SEGMENTS * 2 * TERRAIN_GRID_SEGMENTS * 6;
+    vertex *Vertices = (vertex *) SDL_malloc(sizeof(vertex) * VertexCount);
+    u32 *Indices = (u32 *) SDL_malloc(sizeof(u32) * IndexCapacity);
+    BuildPlane(TERRAIN_GRID_SEGMENTS, Vertices, &VertexCount, Indices, &Renderer->IndexCount);
+
+    SDL_GPUBufferCreateInfo BufferInfo = {};
+    BufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
+    BufferInfo.size = sizeof(vertex) * VertexCount;
+    Renderer->VertexBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Geometry, "terrain grid", &BufferInfo);
+    CopyToBuffer(Renderer->VertexBuffer, Vertices, sizeof(vertex) * VertexCount);
+
+    BufferInfo.usage = SDL_GPU_BUFFERUSAGE_INDEX;
+    BufferInfo.size = sizeof(u32) * Renderer->IndexCount;
+    Renderer->IndexBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Geometry, "terrain grid", &BufferInfo);
+    CopyToBuffer(Renderer->IndexBuffer, Indices, sizeof(u32) * Renderer->IndexCount);
+
+    SDL_free(Indices);
+    SDL_free(Vertices);
+
+    return true;
+}
+
+void FreeTerrainRenderer(terrain_renderer *Renderer)
+{
+    if (Renderer->Pipeline)
+    {
+        ReleaseGpuResource(&State.Resources, Renderer->VertexBuffer);
+        ReleaseGpuResource(&State.Resources, Renderer->IndexBuffer);
+        ReleaseGpuResource(&State.Resources, Renderer->Sampler);
+        ReleaseGpuResource(&State.Resources, Renderer->Pipeline);
+    }
+    *Renderer = {};
+}
+
+// Draws the grid around TerrainX/Z (terrain world units, the same position
+// that was passed to UpdateHeightfield this frame), which sits at the world
+// origin.
+void DrawTerrain(terrain_renderer *Renderer, heightfield_streamer *Streamer, SDL_GPURenderPass *RenderPass,
+                 SDL_GPUCommandBuffer *CommandBuffer, global_uniforms *GlobalUniforms,
+                 fragment_uniforms *FragmentUniforms, f32 TerrainX, f32 TerrainZ)
+{
+    if (!Renderer->Pipeline)
+    {
+        return;
+    }
+
+    heightfield_header *Header = Streamer->Header;
+    f32 WorldHeight = Header->HeightScale * TERRAIN_WORLD_SCALE;
+
+    terrain_uniforms TerrainUniforms = {};
+    TerrainUniforms.Origin = V4(TerrainX / Header->SampleSpacing, TerrainZ / Header->SampleSpacing,
+                                -0.6f * WorldHeight, (f32) Streamer->Radius);
+    TerrainUniforms.Params = V4(TERRAIN_WORLD_SCALE, WorldHeight, (f32) Streamer->AtlasPages, (f32) Header->LevelCount);
+    TerrainUniforms.Grid = V4(TERRAIN_GRID_EXTENT, (f32) TERRAIN_GRID_EXTENT / TERRAIN_GRID_SEGMENTS, 0, 0);
+
+    SDL_BindGPUGraphicsPipeline(RenderPass, Renderer->Pipeline);
+
+    SDL_GPUBufferBinding VertexBufferBinding = {};
+    VertexBufferBinding.buffer = Renderer->VertexBuffer;
+    SDL_BindGPUVertexBuffers(RenderPass, 0, &VertexBufferBinding, 1);
+
+    SDL_GPUBufferBinding IndexBufferBinding = {};
+    IndexBufferBinding.buffer = Renderer->IndexBuffer;
+    SDL_BindGPUIndexBuffer(RenderPass, &IndexBufferBinding, SDL_GPU_INDEXELEMENTSIZE_32BIT);
+
+    SDL_GPUTextureSamplerBinding SamplerBindings[2] = {};
+    SamplerBindings[0].texture = Streamer->Atlas;
+    SamplerBindings[0].sampler = Renderer->Sampler;
+    SamplerBindings[1].texture = Streamer->PageTableTexture;
+    SamplerBindings[1].sampler = Renderer->Sampler;
+    SDL_BindGPUVertexSamplers(RenderPass, 0, SamplerBindings, 2);
+    TouchGpuResource(&State.Resources, Streamer->Atlas);
+    TouchGpuResource(&State.Resources, Streamer->PageTableTexture);
+
+    SDL_PushGPUVertexUniformData(CommandBuffer, 0, GlobalUniforms, sizeof(global_uniforms));
+    SDL_PushGPUVertexUniformData(CommandBuffer, 1, &TerrainUniforms, sizeof(TerrainUniforms));
+    SDL_PushGPUFragmentUniformData(CommandBuffer, 0, FragmentUniforms, sizeof(fragment_uniforms));
+    SDL_DrawGPUIndexedPrimitives(RenderPass, Renderer->IndexCount, 1, 0, 0, 0);
+}
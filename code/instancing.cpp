@@ -0,0 +1,367 @@
+// Hardware instancing for repeated meshes (boats, buoys, debris...).
+//
+// Instances are pushed with a mesh and a material every frame, in any order.
+// Building the batches is a counting sort by (mesh, material) that writes the
+// instances straight into a mapped transfer buffer, so every batch ends up as
+// one contiguous range and one draw call. The instance data goes to the
+// shader through a second vertex buffer with SDL_GPU_VERTEXINPUTRATE_INSTANCE,
+// 32 bytes per instance (entity_instance).
+//
+// The transfer buffer is a ring of INSTANCE_RING_FRAMES segments, one per
+// uploading frame. SDL keeps up to three frames in flight (MAX_FRAMES_IN_FLIGHT
+// in SDL 3.1.6), and acquiring the swapchain texture for frame n waits for
+// frame n-3, or outside vsync hands out no texture until it's done. Uploads
+// only happen after that acquire, so the segment we map was last read by a
+// finished frame. Headless runs wait for the GPU every frame. Keep the ring
+// at least as long as SDL's frames in flight.
+
+#define INSTANCE_RING_FRAMES 3
+#define MAX_INSTANCE_MESHES 8
+#define MAX_INSTANCE_MATERIALS 8
+#define MAX_INSTANCE_BATCHES (MAX_INSTANCE_MESHES * MAX_INSTANCE_MATERIALS)
+
+struct instance_mesh
+{
+    SDL_GPUBuffer *VertexBuffer;
+    SDL_GPUBuffer *IndexBuffer;
+    u32 IndexCount;
+};
+
+// Matches InstanceMaterial in instance.frag.
+struct instance_material
+{
+    v4 Color;
+};
+
+struct instance_batch
+{
+    u32 Mesh;
+    u32 Material;
+    u32 FirstInstance;
+    u32 InstanceCount;
+};
+
+struct instance_renderer
+{
+    SDL_GPUGraphicsPipeline *Pipeline;
+
+    u32 MeshCount;
+    instance_mesh Meshes[MAX_INSTANCE_MESHES];
+    u32 MaterialCount;
+    instance_material Materials[MAX_INSTANCE_MATERIALS];
+
+    // Everything pushed this frame, unsorted. Key is Mesh * MAX_INSTANCE_MATERIALS + Material.
+    u32 Capacity;
+    u32 Count;
+    u8 *Keys;
+    entity_instance *Instances;
+
+    u32 BatchCount;
+    instance_batch Batches[MAX_INSTANCE_BATCHES];
+
+    SDL_GPUTransferBuffer *Ring;
+    u32 RingFrame;
+    SDL_GPUBuffer *InstanceBuffer;
+};
+
+SDL_GPUGraphicsPipeline *CreateInstancePipeline(SDL_GPUShader *Vertex, SDL_GPUShader *Fragment,
+                                                SDL_GPUTextureFormat ColorFormat, SDL_GPUTextureFormat DepthFormat)
+{
+    SDL_GPUVertexBufferDescription BufferDescriptions[2] = {};
+    BufferDescriptions[0].slot = 0;
+    BufferDescriptions[0].pitch = sizeof(vertex);
+    BufferDescriptions[0].input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX;
+    BufferDescriptions[1].slot = 1;
+    BufferDescriptions[1].pitch = sizeof(entity_instance);
+    BufferDescriptions[1].input_rate = SDL_GPU_VERTEXINPUTRATE_INSTANCE;
+
+    SDL_GPUVertexAttribute VertexAttributes[5] = {};
+    VertexAttributes[0] = { 0, 0, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3, offsetof(vertex, Position) };
+    VertexAttributes[1] = { 1, 0, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3, offsetof(vertex, Normal) };
+    VertexAttributes[2] = { 2, 0, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT2, offsetof(vertex, UV) };
+    // Position and scale share one attribute.
+    VertexAttributes[3] = { 3, 1, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT4, offsetof(entity_instance, Position) };
+    VertexAttributes[4] = { 4, 1, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT4, offsetof(entity_instance, Rotation) };
+
+    SDL_GPUColorTargetDescription SwapchainTargetDescription = {};
+    SwapchainTargetDescription.format = ColorFormat;
+
+    SDL_GPUGraphicsPipelineCreateInfo PipelineInfo = {};
+    PipelineInfo.vertex_shader = Vertex;
+    PipelineInfo.fragment_shader = Fragment;
+    PipelineInfo.vertex_input_state.vertex_buffer_descriptions = BufferDescriptions;
+    PipelineInfo.vertex_input_state.num_vertex_buffers = 2;
+    PipelineInfo.vertex_input_state.vertex_attributes = VertexAttributes;
+    PipelineInfo.vertex_input_state.num_vertex_attributes = 5;
+
+    PipelineInfo.depth_stencil_state.enable_depth_test = true;
+    PipelineInfo.depth_stencil_state.enable_depth_write = true;
+    PipelineInfo.depth_stencil_state.compare_op = SDL_GPU_COMPAREOP_LESS;
+
+    PipelineInfo.target_info.color_target_descriptions = &SwapchainTargetDescription;
+    PipelineInfo.target_info.num_color_targets = 1;
+    PipelineInfo.target_info.has_depth_stencil_target = true;
+    PipelineInfo.target_info.depth_stencil_format = DepthFormat;
+
+    SDL_GPUGraphicsPipeline *Pipeline = CreateGpuPipeline(&State.Resources, "instance", &PipelineInfo);
+    assert(Pipeline);
+
+    SDL_ReleaseGPUShader(State.Device, Vertex);
+    SDL_ReleaseGPUShader(State.Device, Fragment);
+
+    return Pipeline;
+}
+
+// CPU side only, enough for building batches.
+void InitInstanceBatches(instance_renderer *Renderer, u32 Capacity)
+{
+    *Renderer = {};
+    Renderer->Capacity = Capacity;
+    Renderer->Keys = (u8 *) SDL_malloc(Capacity);
+    Renderer->Instances = (entity_instance *) SDL_malloc(sizeof(entity_instance) * Capacity);
+}
+
+// Returns false if the shaders haven't been built, the renderer then draws nothing.
+bool InitInstanceRenderer(instance_renderer *Renderer, u32 Capacity,
+                          SDL_GPUTextureFormat ColorFormat, SDL_GPUTextureFormat DepthFormat)
+{
+    InitInstanceBatches(Renderer, Capacity);
+
+    const char *VertexPath = "assets/instance.vert.spv";
+    const char *FragmentPath = "assets/instance.frag.spv";
+    if (!SDL_GetPathInfo(VertexPath, NULL) || !SDL_GetPathInfo(FragmentPath, NULL))
+    {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%s missing, no instanced objects. Run make!", VertexPath);
+        return false;
+    }
+
+    SDL_GPUShader *Vertex = LoadShader(VertexPath, 0, 0, 1, false);
+    SDL_GPUShader *Fragment = LoadShader(FragmentPath, 0, 0, 2, true);
+    Renderer->Pipeline = CreateInstancePipeline(Vertex, Fragment, ColorFormat, DepthFormat);
+
+    SDL_GPUTransferBufferCreateInfo RingInfo = {};
+    RingInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+    RingInfo.size = sizeof(entity_instance) * Capacity * INSTANCE_RING_FRAMES;
+    Renderer->Ring = CreateGpuTransferBuffer(&State.Resources, "instance ring", &RingInfo);
+
+    SDL_GPUBufferCreateInfo BufferInfo = {};
+    BufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
+    BufferInfo.size = sizeof(entity_instance) * Capacity;
+    Renderer->InstanceBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Dynamic, "instances", &BufferInfo);
+
+    return true;
+}
+
+void FreeInstanceRenderer(instance_renderer *Renderer)
+{
+    if (Renderer->Pipeline)
+    {
+        for (u32 I = 0; I < Renderer->MeshCount; ++I)
+        {
+            ReleaseGpuResource(&State.Resources, Renderer->Meshes[I].VertexBuffer);
+            ReleaseGpuResource(&State.Resources, Renderer->Meshes[I].IndexBuffer);
+        }
+        ReleaseGpuResource(&State.Resources, Renderer->InstanceBuffer);
+        ReleaseGpuResource(&State.Resources, Renderer->Ring);
+        ReleaseGpuResource(&State.Resources, Renderer->Pipeline);
+    }
+
+    SDL_free(Renderer->Instances);
+    SDL_free(Renderer->Keys);
+    *Renderer = {};
+}
+
+u32 AddInstanceMesh(instance_renderer *Renderer, vertex *Vertices, u32 VertexCount, u32 *Indices, u32 IndexCount)
+{
+    assert(Renderer->MeshCount < MAX_INSTANCE_MESHES);
+
+    instance_mesh *Mesh = Renderer->Meshes + Renderer->MeshCount;
+    Mesh->IndexCount = IndexCount;
+    if (Renderer->Pipeline)
+    {
+        SDL_GPUBufferCreateInfo BufferInfo = {};
+        BufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
+        BufferInfo.size = sizeof(vertex) * VertexCount;
+        Mesh->VertexBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Geometry, "instance mesh", &BufferInfo);
+        CopyToBuffer(Mesh->VertexBuffer, Vertices, sizeof(vertex) * VertexCount);
+
+        BufferInfo.usage = SDL_GPU_BUFFERUSAGE_INDEX;
+        BufferInfo.size = sizeof(u32) * IndexCount;
+        Mesh->IndexBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Geometry, "instance mesh", &BufferInfo);
+        CopyToBuffer(Mesh->IndexBuffer, Indices, sizeof(u32) * IndexCount);
+    }
+
+    return Renderer->MeshCount++;
+}
+
+u32 AddInstanceMaterial(instance_renderer *Renderer, v4 Color)
+{
+    assert(Renderer->MaterialCount < MAX_INSTANCE_MATERIALS);
+    Renderer->Materials[Renderer->MaterialCount].Color = Color;
+    return Renderer->MaterialCount++;
+}
+
+void BeginInstances(instance_renderer *Renderer)
+{
+    Renderer->Count = 0;
+    Renderer->BatchCount = 0;
+}
+
+// Instances past the capacity are dropped.
+void PushInstances(instance_renderer *Renderer, u32 Mesh, u32 Material, entity_instance *Instances, u32 Count)
+{
+    assert(Mesh < MAX_INSTANCE_MESHES && Material < MAX_INSTANCE_MATERIALS);
+
+    Count = SDL_min(Count, Renderer->Capacity - Renderer->Count);
+    u8 Key = (u8) (Mesh * MAX_INSTANCE_MATERIALS + Material);
+    SDL_memset(Renderer->Keys + Renderer->Count, Key, Count);
+    SDL_memcpy(Renderer->Instances + Renderer->Count, Instances, sizeof(entity_instance) * Count);
+    Renderer->Count += Count;
+}
+
+// Counting sort by key into Destination, one batch per key that was used.
+void BuildInstanceBatches(instance_renderer *Renderer, entity_instance *Destination)
+{
+    u32 Offsets[MAX_INSTANCE_BATCHES] = {};
+    for (u32 I = 0; I < Renderer->Count; ++I)
+    {
+        Offsets[Renderer->Keys[I]]++;
+    }
+
+    Renderer->BatchCount = 0;
+    u32 Total = 0;
+    for (u32 Key = 0; Key < MAX_INSTANCE_BATCHES; ++Key)
+    {
+        u32 Count = Offsets[Key];
+        if (Count)
+        {
+            instance_batch *Batch = Renderer->Batches + Renderer->BatchCount++;
+            Batch->Mesh = Key / MAX_INSTANCE_MATERIALS;
+            Batch->Material = Key % MAX_INSTANCE_MATERIALS;
+            Batch->FirstInstance = Total;
+            Batch->InstanceCount = Count;
+        }
+        Offsets[Key] = Total;
+        Total += Count;
+    }
+
+    for (u32 I = 0; I < Renderer->Count; ++I)
+    {
+        Destination[Offsets[Renderer->Keys[I]]++] = Renderer->Instances[I];
+    }
+}
+
+// Builds the batches into this frame's ring segment and copies them to the
+// instance buffer. Has to be recorded before the render pass.
+void UploadInstances(instance_renderer *Renderer, SDL_GPUCommandBuffer *CommandBuffer)
+{
+    if (!Renderer->Pipeline || !Renderer->Count)
+    {
+        Renderer->BatchCount = 0;
+        return;
+    }
+
+    u32 SegmentSize = sizeof(entity_instance) * Renderer->Capacity;
+    u32 Offset = SegmentSize * Renderer->RingFrame;
+    Renderer->RingFrame = (Renderer->RingFrame + 1) % INSTANCE_RING_FRAMES;
+
+    // NOTE: No cycling, the ring takes care of not writing what the GPU still reads.
+    u8 *RingData = (u8 *) SDL_MapGPUTransferBuffer(State.Device, Renderer->Ring, false);
+    BuildInstanceBatches(Renderer, (entity_instance *) (RingData + Offset));
+    SDL_UnmapGPUTransferBuffer(State.Device, Renderer->Ring);
+
+    SDL_GPUCopyPass *CopyPass = SDL_BeginGPUCopyPass(CommandBuffer);
+
+    SDL_GPUTransferBufferLocation Source = {};
+    Source.transfer_buffer = Renderer->Ring;
+    Source.offset = Offset;
+
+    SDL_GPUBufferRegion Dest = {};
+    Dest.buffer = Renderer->InstanceBuffer;
+    Dest.size = sizeof(entity_instance) * Renderer->Count;
+
+    // The last frame may still be drawing from the instance buffer.
+    SDL_UploadToGPUBuffer(CopyPass, &Source, &Dest, true);
+    SDL_EndGPUCopyPass(CopyPass);
+}
+
+// One draw per batch. Returns the number of draw calls.
+u32 DrawInstances(instance_renderer *Renderer, SDL_GPURenderPass *RenderPass, SDL_GPUCommandBuffer *CommandBuffer,
+                  global_uniforms *GlobalUniforms, fragment_uniforms *FragmentUniforms)
+{
+    if (!Renderer->BatchCount)
+    {
+        return 0;
+    }
+
+    SDL_BindGPUGraphicsPipeline(RenderPass, Renderer->Pipeline);
+    SDL_PushGPUVertexUniformData(CommandBuffer, 0, GlobalUniforms, sizeof(global_uniforms));
+    SDL_PushGPUFragmentUniformData(CommandBuffer, 0, FragmentUniforms, sizeof(fragment_uniforms));
+
+    u32 BoundMesh = MAX_INSTANCE_MESHES;
+    for (u32 I = 0; I < Renderer->BatchCount; ++I)
+    {
+        instance_batch *Batch = Renderer->Batches + I;
+        instance_mesh *Mesh = Renderer->Meshes + Batch->Mesh;
+
+        // Batches are sorted by mesh first, so this only rebinds per mesh.
+        if (Batch->Mesh != BoundMesh)
+        {
+            SDL_GPUBufferBinding VertexBufferBindings[2] = {};
+            VertexBufferBindings[0].buffer = Mesh->VertexBuffer;
+            VertexBufferBindings[1].buffer = Renderer->InstanceBuffer;
+            SDL_BindGPUVertexBuffers(RenderPass, 0, VertexBufferBindings, 2);
+
+            SDL_GPUBufferBinding IndexBufferBinding = {};
+            IndexBufferBinding.buffer = Mesh->IndexBuffer;
+            SDL_BindGPUIndexBuffer(RenderPass, &IndexBufferBinding, SDL_GPU_INDEXELEMENTSIZE_32BIT);
+            BoundMesh = Batch->Mesh;
+        }
+
+        SDL_PushGPUFragmentUniformData(CommandBuffer, 1, Renderer->Materials + Batch->Material, sizeof(instance_material));
+        SDL_DrawGPUIndexedPrimitives(RenderPass, Mesh->IndexCount, Batch->InstanceCount, 0, 0, Batch->FirstInstance);
+    }
+
+    return Renderer->BatchCount;
+}
+
+// Axis aligned box around the origin, 24 vertices so the faces stay flat.
+void BuildBox(v3 HalfSize, vertex *Vertices, u32 *VertexCount, u32 *Indices, u32 *IndexCount)
+{
+    *VertexCount = 0;
+    *IndexCount = 0;
+
+    for (u32 Face = 0; Face < 6; ++Face)
+    {
+        u32 Axis = Face / 2;
+        f32 Sign = (Face & 1) ? -1.0f : 1.0f;
+
+        f32 N[3] = {};
+        N[Axis] = Sign;
+        // Two axes spanning the face, ordered so the winding faces out.
+        f32 U[3] = {};
+        f32 V[3] = {};
+        U[(Axis + 1) % 3] = 1;
+        V[(Axis + 2) % 3] = Sign;
+
+        u32 Base = *VertexCount;
+        for (u32 Corner = 0; Corner < 4; ++Corner)
+        {
+            f32 SU = (Corner == 1 || Corner == 2) ? 1.0f : -1.0f;
+            f32 SV = (Corner >= 2) ? 1.0f : -1.0f;
+
+            vertex *Vertex = Vertices + (*VertexCount)++;
+            Vertex->Position = V3((N[0] + SU * U[0] + SV * V[0]) * HalfSize.X,
+                                  (N[1] + SU * U[1] + SV * V[1]) * HalfSize.Y,
+                                  (N[2] + SU * U[2] + SV * V[2]) * HalfSize.Z);
+            Vertex->Normal = V3(N[0], N[1], N[2]);
+            Vertex->UV = V2(SU * 0.5f + 0.5f, SV * 0.5f + 0.5f);
+        }
+
+        u32 Quad[6] = { 0, 1, 2, 0, 2, 3 };
+        for (u32 I = 0; I < 6; ++I)
+        {
+            Indices[(*IndexCount)++] = Base + Quad[I];
+        }
+    }
+}
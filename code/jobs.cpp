@@ -0,0 +1,188 @@
+// Small job system. Workers pull jobs from one shared ring buffer. A thread
+// waiting on a counter helps out by running queued jobs itself, so nested
+// ParallelFor calls can't deadlock.
+
+#define JOB_QUEUE_SIZE 4096
+#define MAX_WORKER_COUNT 64
+
+typedef void job_func(void *Data, u32 Start, u32 End);
+
+struct job
+{
+    job_func *Func;
+    void *Data;
+    u32 Start;
+    u32 End;
+    SDL_AtomicInt *Counter;
+};
+
+struct job_system
+{
+    SDL_Mutex *Mutex;
+    SDL_Semaphore *Available;
+    SDL_AtomicInt Running;
+
+    u32 Head;
+    u32 Tail;
+    job Queue[JOB_QUEUE_SIZE];
+
+    u32 WorkerCount;
+    SDL_Thread *Workers[MAX_WORKER_COUNT];
+};
+
+job_system Jobs = {};
+
+bool PopJob(job *Job)
+{
+    bool Result = false;
+
+    SDL_LockMutex(Jobs.Mutex);
+    if (Jobs.Head != Jobs.Tail)
+    {
+        *Job = Jobs.Queue[Jobs.Tail % JOB_QUEUE_SIZE];
+        Jobs.Tail++;
+        Result = true;
+    }
+    SDL_UnlockMutex(Jobs.Mutex);
+
+    return Result;
+}
+
+void RunJob(job *Job)
+{
+    Job->Func(Job->Data, Job->Start, Job->End);
+    SDL_AddAtomicInt(Job->Counter, -1);
+}
+
+i32 JobWorker(void *Unused)
+{
+    while (true)
+    {
+        SDL_WaitSemaphore(Jobs.Available);
+        if (!SDL_GetAtomicInt(&Jobs.Running))
+        {
+            break;
+        }
+
+        job Job;
+        if (PopJob(&Job))
+        {
+            RunJob(&Job);
+        }
+    }
+
+    return 0;
+}
+
+// NOTE: The counter must be incremented by the caller before pushing, so a
+// waiter never sees it drop to zero while jobs are still being queued.
+void PushJob(job_func *Func, void *Data, u32 Start, u32 End, SDL_AtomicInt *Counter)
+{
+    job Job = { Func, Data, Start, End, Counter };
+
+    bool Queued = false;
+    if (Jobs.WorkerCount)
+    {
+        SDL_LockMutex(Jobs.Mutex);
+        if (Jobs.Head - Jobs.Tail < JOB_QUEUE_SIZE)
+        {
+            Jobs.Queue[Jobs.Head % JOB_QUEUE_SIZE] = Job;
+            Jobs.Head++;
+            Queued = true;
+        }
+        SDL_UnlockMutex(Jobs.Mutex);
+    }
+
+    if (Queued)
+    {
+        SDL_SignalSemaphore(Jobs.Available);
+    }
+    else
+    {
+        // No workers or the queue is full, just do it here.
+        RunJob(&Job);
+    }
+}
+
+void WaitForCounter(SDL_AtomicInt *Counter)
+{
+    while (SDL_GetAtomicInt(Counter) > 0)
+    {
+        job Job;
+        if (PopJob(&Job))
+        {
+            RunJob(&Job);
+        }
+        else
+        {
+            SDL_CPUPauseInstruction();
+        }
+    }
+}
+
+// Splits [0, Count) into chunks of ChunkSize and runs them on all workers
+// plus the calling thread. Returns once every chunk is done.
+void ParallelFor(u32 Count, u32 ChunkSize, job_func *Func, void *Data)
+{
+    if (Count == 0)
+    {
+        return;
+    }
+
+    if (ChunkSize == 0)
+    {
+        ChunkSize = 1;
+    }
+
+    u32 ChunkCount = (Count + ChunkSize - 1) / ChunkSize;
+    if (ChunkCount == 1 || Jobs.WorkerCount == 0)
+    {
+        Func(Data, 0, Count);
+        return;
+    }
+
+    SDL_AtomicInt Counter = {};
+    SDL_SetAtomicInt(&Counter, ChunkCount);
+
+    for (u32 Chunk = 0; Chunk < ChunkCount; ++Chunk)
+    {
+        u32 Start = Chunk * ChunkSize;
+        u32 End = SDL_min(Start + ChunkSize, Count);
+        PushJob(Func, Data, Start, End, &Counter);
+    }
+
+    WaitForCounter(&Counter);
+}
+
+void InitJobs()
+{
+    Jobs.Mutex = SDL_CreateMutex();
+    Jobs.Available = SDL_CreateSemaphore(0);
+    SDL_SetAtomicInt(&Jobs.Running, 1);
+
+    i32 CoreCount = SDL_GetNumLogicalCPUCores();
+    Jobs.WorkerCount = SDL_clamp(CoreCount - 1, 0, MAX_WORKER_COUNT);
+
+    for (u32 I = 0; I < Jobs.WorkerCount; ++I)
+    {
+        Jobs.Workers[I] = SDL_CreateThread(JobWorker, "Worker", NULL);
+    }
+}
+
+void ShutdownJobs()
+{
+    SDL_SetAtomicInt(&Jobs.Running, 0);
+    for (u32 I = 0; I < Jobs.WorkerCount; ++I)
+    {
+        SDL_SignalSemaphore(Jobs.Available);
+    }
+
+    for (u32 I = 0; I < Jobs.WorkerCount; ++I)
+    {
+        SDL_WaitThread(Jobs.Workers[I], NULL);
+    }
+
+    SDL_DestroySemaphore(Jobs.Available);
+    SDL_DestroyMutex(Jobs.Mutex);
+    Jobs = {};
+}
@@ -2,19 +2,26 @@
 #include <stdint.h>
 #include <assert.h>
 #include <stddef.h>
+#include <string.h>
 #include <math.h>
 
 #include <SDL3/SDL.h>
 
 typedef int32_t i32;
 typedef uint8_t u8;
+typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
 typedef float f32;
+typedef double f64;
 
 #define STB_PERLIN_IMPLEMENTATION
 #include "stb_perlin.h"
 #include "game_math.cpp"
+#include "jobs.cpp"
+#include "water.cpp"
+#include "entity.cpp"
+#include "texture_compress.cpp"
 
 i32 WindowWidth = 1280;
 i32 WindowHeight = 720;
@@ -26,22 +33,46 @@ struct vertex
     v2 UV;
 };
 
-struct state
+struct global_uniforms
 {
-    SDL_GPUDevice *Device;
+    mat4 ViewProjection;
     f32 Time;
 };
 
-struct global_uniforms
+struct fragment_uniforms
 {
-    mat4 Projection;
-    mat4 View;
+    v4 SunDirection;
+    v4 SunColor;
+    v4 CameraPosition;
+};
+
+#include "replay.cpp"
+#include "mesh.cpp"
+#include "mesh_import.cpp"
+#include "culling.cpp"
+#include "gpu_resources.cpp"
+
+// Half the water tiles per side, the surface is (2 * radius + 1)^2 tiles.
+#define WATER_TILE_RADIUS 8
+
+struct state
+{
+    SDL_GPUDevice *Device;
+    gpu_registry Resources;
     f32 Time;
+    u32 Seed;
+
+    u8 NoiseData[NOISE_SIZE * NOISE_SIZE];
+
+    entity_store Entities;
+    entity_instance *EntityInstances;
+
+    replay Replay;
 };
 
 state State = {};
 
-SDL_GPUShader *LoadShader(const char *Path, u32 SamplerCount, u32 UniformBufferCount, bool Fragment)
+SDL_GPUShader *LoadShader(const char *Path, u32 SamplerCount, u32 StorageBufferCount, u32 UniformBufferCount, bool Fragment)
 {
     SDL_GPUShaderStage Stage = SDL_GPU_SHADERSTAGE_VERTEX;
     if (Fragment)
@@ -61,6 +92,7 @@ SDL_GPUShader *LoadShader(const char *Path, u32 SamplerCount, u32 UniformBufferC
     ShaderInfo.stage = Stage;
     ShaderInfo.num_uniform_buffers = UniformBufferCount;
     ShaderInfo.num_samplers = SamplerCount;
+    ShaderInfo.num_storage_buffers = StorageBufferCount;
 
     SDL_GPUShader *Shader = SDL_CreateGPUShader(State.Device, &ShaderInfo);
     assert(Shader);
@@ -70,12 +102,14 @@ SDL_GPUShader *LoadShader(const char *Path, u32 SamplerCount, u32 UniformBufferC
     return Shader;
 }
 
+#include "shader_variants.cpp"
+
 void CopyToBuffer(SDL_GPUBuffer *Buffer, void *Data, u32 Bytes)
 {
     SDL_GPUTransferBufferCreateInfo TransferBufferInfo = {};
     TransferBufferInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
     TransferBufferInfo.size = Bytes;
-    SDL_GPUTransferBuffer *TransferBuffer = SDL_CreateGPUTransferBuffer(State.Device, &TransferBufferInfo);
+    SDL_GPUTransferBuffer *TransferBuffer = CreateGpuTransferBuffer(&State.Resources, "upload", &TransferBufferInfo);
 
     void *TransferData = SDL_MapGPUTransferBuffer(State.Device, TransferBuffer, false);
     SDL_memcpy(TransferData, Data, Bytes);
@@ -95,17 +129,17 @@ void CopyToBuffer(SDL_GPUBuffer *Buffer, void *Data, u32 Bytes)
 
 	SDL_EndGPUCopyPass(CopyPass);
 	SDL_SubmitGPUCommandBuffer(UploadCommandBuffer);
-	SDL_ReleaseGPUTransferBuffer(State.Device, TransferBuffer);
+	ReleaseGpuResource(&State.Resources, TransferBuffer);
 }
 
-void CopyToTexture(SDL_GPUTexture *Texture, void *Data, u32 Width, u32 Height, u32 BytesPerPixel)
+void CopyToTexture(SDL_GPUTexture *Texture, SDL_GPUTextureFormat Format, void *Data, u32 Width, u32 Height)
 {
-    u32 Bytes = Width * Height * BytesPerPixel;
+    u32 Bytes = SDL_CalculateGPUTextureFormatSize(Format, Width, Height, 1);
 
     SDL_GPUTransferBufferCreateInfo TransferBufferInfo = {};
     TransferBufferInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
     TransferBufferInfo.size = Bytes;
-    SDL_GPUTransferBuffer *TransferBuffer = SDL_CreateGPUTransferBuffer(State.Device, &TransferBufferInfo);
+    SDL_GPUTransferBuffer *TransferBuffer = CreateGpuTransferBuffer(&State.Resources, "upload", &TransferBufferInfo);
 
     void *TransferData = SDL_MapGPUTransferBuffer(State.Device, TransferBuffer, false);
     SDL_memcpy(TransferData, Data, Bytes);
@@ -127,7 +161,98 @@ void CopyToTexture(SDL_GPUTexture *Texture, void *Data, u32 Width, u32 Height, u
 
 	SDL_EndGPUCopyPass(CopyPass);
 	SDL_SubmitGPUCommandBuffer(UploadCommandBuffer);
-	SDL_ReleaseGPUTransferBuffer(State.Device, TransferBuffer);
+	ReleaseGpuResource(&State.Resources, TransferBuffer);
+}
+
+// Decodes straight into one mapped transfer buffer: vertices first, indices
+// after all the room OpenMeshFile asked for, then copies both regions out.
+// With a WeldDistance the mesh gets cleaned up first, which has to read it
+// back, so then it decodes into normal memory and gets copied over after.
+bool UploadMeshFile(const char *Path, f32 WeldDistance, SDL_GPUBuffer **VertexBuffer, SDL_GPUBuffer **IndexBuffer,
+                    u32 *IndexCount, aabb *Bounds)
+{
+    mesh_file File;
+    if (!OpenMeshFile(&File, Path))
+    {
+        CloseMeshFile(&File);
+        return false;
+    }
+
+    u32 IndexOffset = sizeof(vertex) * File.VertexCount;
+
+    SDL_GPUTransferBufferCreateInfo TransferBufferInfo = {};
+    TransferBufferInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+    TransferBufferInfo.size = IndexOffset + sizeof(u32) * File.IndexCount;
+    SDL_GPUTransferBuffer *TransferBuffer = CreateGpuTransferBuffer(&State.Resources, "upload", &TransferBufferInfo);
+
+    u8 *Scratch = (u8 *) SDL_aligned_alloc(MESH_SCRATCH_ALIGN, SDL_max(File.ScratchSize, 1));
+    u8 *TransferData = (u8 *) SDL_MapGPUTransferBuffer(State.Device, TransferBuffer, false);
+    u8 *DecodeData = WeldDistance > 0 ? (u8 *) SDL_malloc(TransferBufferInfo.size) : TransferData;
+    mesh Mesh;
+    bool Decoded = DecodeMeshFile(&File, (vertex *) DecodeData, (u32 *) (DecodeData + IndexOffset), Scratch, &Mesh);
+    if (Decoded)
+    {
+        // Welding only ever moves vertices onto others, so the bounds still hold.
+        Bounds->Min = File.Bounds.Min;
+        Bounds->Max = File.Bounds.Max;
+    }
+    if (Decoded && DecodeData != TransferData)
+    {
+        u32 Welded = WeldVertices(&Mesh, WeldDistance);
+        u32 Degenerates = RemoveDegenerateTriangles(&Mesh, 0);
+        RecomputeNormals(&Mesh);
+        SDL_Log("Welded %u vertices, removed %u degenerate triangles", Welded, Degenerates);
+
+        SDL_memcpy(TransferData, Mesh.Vertices, sizeof(vertex) * Mesh.VertexCount);
+        SDL_memcpy(TransferData + IndexOffset, Mesh.Indices, sizeof(u32) * Mesh.IndexCount);
+    }
+    if (DecodeData != TransferData)
+    {
+        SDL_free(DecodeData);
+    }
+    SDL_UnmapGPUTransferBuffer(State.Device, TransferBuffer);
+    SDL_aligned_free(Scratch);
+    CloseMeshFile(&File);
+
+    if (!Decoded)
+    {
+        ReleaseGpuResource(&State.Resources, TransferBuffer);
+        return false;
+    }
+
+    SDL_Log("Loaded %s: %u vertices, %u triangles", Path, Mesh.VertexCount, Mesh.IndexCount / 3);
+
+    SDL_GPUBufferCreateInfo BufferInfo = {};
+    BufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
+    BufferInfo.size = sizeof(vertex) * Mesh.VertexCount;
+    *VertexBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Geometry, Path, &BufferInfo);
+
+    BufferInfo.usage = SDL_GPU_BUFFERUSAGE_INDEX;
+    BufferInfo.size = sizeof(u32) * Mesh.IndexCount;
+    *IndexBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Geometry, Path, &BufferInfo);
+
+    SDL_GPUCommandBuffer *UploadCommandBuffer = SDL_AcquireGPUCommandBuffer(State.Device);
+    SDL_GPUCopyPass *CopyPass = SDL_BeginGPUCopyPass(UploadCommandBuffer);
+
+    SDL_GPUTransferBufferLocation Source = {};
+    Source.transfer_buffer = TransferBuffer;
+
+    SDL_GPUBufferRegion Dest = {};
+    Dest.buffer = *VertexBuffer;
+    Dest.size = sizeof(vertex) * Mesh.VertexCount;
+    SDL_UploadToGPUBuffer(CopyPass, &Source, &Dest, false);
+
+    Source.offset = IndexOffset;
+    Dest.buffer = *IndexBuffer;
+    Dest.size = sizeof(u32) * Mesh.IndexCount;
+    SDL_UploadToGPUBuffer(CopyPass, &Source, &Dest, false);
+
+    SDL_EndGPUCopyPass(CopyPass);
+    SDL_SubmitGPUCommandBuffer(UploadCommandBuffer);
+    ReleaseGpuResource(&State.Resources, TransferBuffer);
+
+    *IndexCount = Mesh.IndexCount;
+    return true;
 }
 
 inline u32 PlaneVertexAt(i32 X, i32 Z, i32 Segements)
@@ -135,29 +260,45 @@ inline u32 PlaneVertexAt(i32 X, i32 Z, i32 Segements)
     return X * (Segements * 2 + 1) + Z;
 }
 
-i32 main()
+void BuildPlane(i32 Segments, vertex *Vertices, u32 *VertexCount, u32 *Indices, u32 *IndexCount)
 {
-    SDL_Init(SDL_INIT_VIDEO);
+    *VertexCount = 0;
+    *IndexCount = 0;
 
-    SDL_SetLogPriorities(SDL_LOG_PRIORITY_DEBUG);
+    for (i32 I = -Segments; I <= Segments; ++I)
+    {
+        for (i32 J = -Segments; J <= Segments; ++J)
+        {
+            f32 X = (f32) I / (f32) Segments;
+            f32 Z = (f32) J / (f32) Segments;
 
-    SDL_Window *Window =  SDL_CreateWindow("My game", WindowWidth, WindowHeight, SDL_WINDOW_RESIZABLE | SDL_WINDOW_VULKAN);
-    State.Device = SDL_CreateGPUDevice(SDL_GPU_SHADERFORMAT_SPIRV, true, NULL);
+            vertex *Vertex = Vertices + (*VertexCount)++;
+            Vertex->Position = V3(X, 0, Z);
+            Vertex->Normal = V3(0, 1, 0);
+            Vertex->UV = V2((f32) I / (2 * Segments) + 0.5, (f32) J / (2 * Segments) + 0.5);
+        }
+    }
 
-    if (!SDL_ClaimWindowForGPUDevice(State.Device, Window))
+    for (i32 I = 0; I < 2 * Segments; ++I)
     {
-        printf("Failed to assign device to window\n");
-        return 1;
-    }
+        for (i32 J = 0; J < 2 * Segments; ++J)
+        {
+            Indices[*IndexCount + 0] = PlaneVertexAt(I, J, Segments);
+            Indices[*IndexCount + 1] = PlaneVertexAt(I + 1, J, Segments);
+            Indices[*IndexCount + 2] = PlaneVertexAt(I + 1, J + 1, Segments);
 
-    SDL_GPUShader *FragmentShader = LoadShader("assets/default.frag.spv", 1, 1, true);
-    SDL_GPUShader *VertexShader = LoadShader("assets/default.vert.spv", 1, 1, false);
+            Indices[*IndexCount + 3] = PlaneVertexAt(I, J, Segments);
+            Indices[*IndexCount + 4] = PlaneVertexAt(I + 1, J + 1, Segments);
+            Indices[*IndexCount + 5] = PlaneVertexAt(I, J + 1, Segments);
 
-    // TODO: Make sure this format is actually available. Use fallback then!
-    SDL_GPUTextureFormat DepthFormat = SDL_GPU_TEXTUREFORMAT_D32_FLOAT;
+            *IndexCount += 6;
+        }
+    }
+}
 
-    // Pipeline...
-    //
+// Takes ownership of the shaders.
+SDL_GPUGraphicsPipeline *CreateWaterPipeline(water_shaders Shaders, SDL_GPUTextureFormat ColorFormat, SDL_GPUTextureFormat DepthFormat)
+{
     SDL_GPUVertexBufferDescription BufferDescription = {};
     BufferDescription.slot = 0;
     BufferDescription.pitch = sizeof(vertex);
@@ -184,11 +325,11 @@ i32 main()
     SDL_GPUVertexAttribute VertexAttributes[3] = { AttributePosition, AttributeNormal, AttributeUV };
 
     SDL_GPUColorTargetDescription SwapchainTargetDescription = {};
-    SwapchainTargetDescription.format = SDL_GetGPUSwapchainTextureFormat(State.Device, Window);
+    SwapchainTargetDescription.format = ColorFormat;
 
     SDL_GPUGraphicsPipelineCreateInfo PipelineInfo = {};
-    PipelineInfo.vertex_shader = VertexShader;
-    PipelineInfo.fragment_shader = FragmentShader;
+    PipelineInfo.vertex_shader = Shaders.Vertex;
+    PipelineInfo.fragment_shader = Shaders.Fragment;
     PipelineInfo.vertex_input_state.vertex_buffer_descriptions = &BufferDescription;
     PipelineInfo.vertex_input_state.num_vertex_buffers = 1;
     PipelineInfo.vertex_input_state.vertex_attributes = VertexAttributes;
@@ -205,124 +346,755 @@ i32 main()
 
     // PipelineInfo.rasterizer_state.fill_mode = SDL_GPU_FILLMODE_LINE;
 
-    SDL_GPUGraphicsPipeline *Pipeline =  SDL_CreateGPUGraphicsPipeline(State.Device, &PipelineInfo);
+    SDL_GPUGraphicsPipeline *Pipeline = CreateGpuPipeline(&State.Resources, "water", &PipelineInfo);
     assert(Pipeline);
 
-    SDL_ReleaseGPUShader(State.Device, VertexShader);
-	SDL_ReleaseGPUShader(State.Device, FragmentShader);
+    SDL_ReleaseGPUShader(State.Device, Shaders.Vertex);
+	SDL_ReleaseGPUShader(State.Device, Shaders.Fragment);
+
+    return Pipeline;
+}
+
+// Uploads 8 bit pixels (1 channel or RGBA). Block compressed if the device
+// can sample the format, uncompressed otherwise. When compressed, Pixels is
+// overwritten with the decoded result, so CPU side lookups see the same
+// values the GPU does.
+SDL_GPUTexture *CreateBakedTexture(u8 *Pixels, u32 Width, u32 Height, u32 Channels)
+{
+    SDL_GPUTextureCreateInfo TextureInfo = {};
+    TextureInfo.type = SDL_GPU_TEXTURETYPE_2D;
+    TextureInfo.width = Width;
+    TextureInfo.height = Height;
+    TextureInfo.layer_count_or_depth = 1;
+    TextureInfo.num_levels = 1;
+    TextureInfo.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+
+    texture_codec Candidates[2] = { Codec_BC4, Codec_BC4 };
+    SDL_GPUTextureFormat CandidateFormats[2] = { SDL_GPU_TEXTUREFORMAT_BC4_R_UNORM, SDL_GPU_TEXTUREFORMAT_BC4_R_UNORM };
+    u32 CandidateCount = 1;
+    SDL_GPUTextureFormat UncompressedFormat = SDL_GPU_TEXTUREFORMAT_R8_UNORM;
+    if (Channels == 4)
+    {
+        Candidates[0] = Codec_BC7;
+        Candidates[1] = Codec_BC1;
+        CandidateFormats[0] = SDL_GPU_TEXTUREFORMAT_BC7_RGBA_UNORM;
+        CandidateFormats[1] = SDL_GPU_TEXTUREFORMAT_BC1_RGBA_UNORM;
+        CandidateCount = 2;
+        UncompressedFormat = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+    }
+
+    TextureInfo.format = UncompressedFormat;
+    void *Data = Pixels;
+    u8 *Blocks = NULL;
+
+    // NOTE: Block compressed textures need to be a multiple of the block size.
+    if (Width % 4 == 0 && Height % 4 == 0)
+    {
+        for (u32 I = 0; I < CandidateCount; ++I)
+        {
+            if (SDL_GPUTextureSupportsFormat(State.Device, CandidateFormats[I], TextureInfo.type, TextureInfo.usage))
+            {
+                Blocks = (u8 *) SDL_malloc(CompressedSize(Candidates[I], Width, Height));
+                CompressTexture(Candidates[I], Pixels, Width, Height, Blocks);
+                DecompressTexture(Candidates[I], Blocks, Width, Height, Pixels);
+
+                TextureInfo.format = CandidateFormats[I];
+                Data = Blocks;
+                break;
+            }
+        }
+    }
+
+	SDL_GPUTexture *Texture = CreateGpuTexture(&State.Resources, GpuCategory_Textures, "baked texture", &TextureInfo);
+    CopyToTexture(Texture, TextureInfo.format, Data, Width, Height);
+
+    SDL_free(Blocks);
+
+    return Texture;
+}
+
+SDL_GPUTexture *CreateNoiseTexture(u8 *NoiseData)
+{
+    return CreateBakedTexture(NoiseData, NOISE_SIZE, NOISE_SIZE, 1);
+}
+
+SDL_GPUSampler *CreateWrapSampler()
+{
+    SDL_GPUSamplerCreateInfo PointWrapSamplerInfo = {};
+    PointWrapSamplerInfo.min_filter = SDL_GPU_FILTER_LINEAR;
+    PointWrapSamplerInfo.mag_filter = SDL_GPU_FILTER_LINEAR;
+    PointWrapSamplerInfo.mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_NEAREST;
+    PointWrapSamplerInfo.address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_REPEAT;
+    PointWrapSamplerInfo.address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_REPEAT;
+    PointWrapSamplerInfo.address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_REPEAT;
+    return CreateGpuSampler(&State.Resources, "wrap", &PointWrapSamplerInfo);
+}
+
+fragment_uniforms DefaultFragmentUniforms(v3 CameraPosition)
+{
+    v3 SunDirection = Norm(V3(1, 2, 3));
+
+    fragment_uniforms Result = {};
+    Result.SunDirection = V4(SunDirection.X, SunDirection.Y, SunDirection.Z, 0);
+    Result.SunColor = V4(1.2, 1.2, 1.2, 0);
+    Result.CameraPosition = V4(CameraPosition.X, CameraPosition.Y, CameraPosition.Z, 1);
+    return Result;
+}
+
+#include "uniforms.cpp"
+#include "instancing.cpp"
+#include "heightfield.cpp"
+#include "benchmark.cpp"
+#include "present.cpp"
+#include "startup.cpp"
+
+struct options
+{
+    bool Benchmark;
+    bool GpuBenchmark;
+    u32 HeightfieldBenchmarkSize;
+    bool Headless;
+    const char *CapturePath;
+    const char *ReplayPath;
+    const char *MeshPath;
+    f32 WeldDistance;
+    const char *HeightfieldPath;
+    const char *WriteHeightfieldPath;
+    u32 WriteHeightfieldSize;
+    u32 Seed;
+    bool HasQuality;
+    quality_tier Quality;
+    SDL_GPUPresentMode PresentMode;
+    u32 FrameLimit;
+};
+
+bool ParseOptions(options *Options, i32 ArgCount, char **Args)
+{
+    *Options = {};
+
+    for (i32 I = 1; I < ArgCount; ++I)
+    {
+        const char *Arg = Args[I];
+        bool HasValue = I + 1 < ArgCount;
+
+        if (SDL_strcmp(Arg, "--bench") == 0)
+        {
+            Options->Benchmark = true;
+        }
+        else if (SDL_strcmp(Arg, "--bench-gpu") == 0)
+        {
+            Options->GpuBenchmark = true;
+        }
+        else if (SDL_strcmp(Arg, "--bench-heightfield") == 0 && HasValue)
+        {
+            Options->HeightfieldBenchmarkSize = SDL_strtoul(Args[++I], NULL, 0);
+        }
+        else if (SDL_strcmp(Arg, "--headless") == 0)
+        {
+            Options->Headless = true;
+        }
+        else if (SDL_strcmp(Arg, "--capture") == 0 && HasValue)
+        {
+            Options->CapturePath = Args[++I];
+        }
+        else if (SDL_strcmp(Arg, "--replay") == 0 && HasValue)
+        {
+            Options->ReplayPath = Args[++I];
+        }
+        else if (SDL_strcmp(Arg, "--mesh") == 0 && HasValue)
+        {
+            Options->MeshPath = Args[++I];
+        }
+        else if (SDL_strcmp(Arg, "--weld") == 0 && HasValue)
+        {
+            Options->WeldDistance = (f32) SDL_strtod(Args[++I], NULL);
+        }
+        else if (SDL_strcmp(Arg, "--heightfield") == 0 && HasValue)
+        {
+            Options->HeightfieldPath = Args[++I];
+        }
+        else if (SDL_strcmp(Arg, "--write-heightfield") == 0 && I + 2 < ArgCount)
+        {
+            Options->WriteHeightfieldPath = Args[++I];
+            Options->WriteHeightfieldSize = SDL_strtoul(Args[++I], NULL, 0);
+        }
+        else if (SDL_strcmp(Arg, "--seed") == 0 && HasValue)
+        {
+            Options->Seed = SDL_strtoul(Args[++I], NULL, 0);
+        }
+        else if (SDL_strcmp(Arg, "--quality") == 0 && HasValue && ParseQualityTier(Args[I + 1], &Options->Quality))
+        {
+            Options->HasQuality = true;
+            ++I;
+        }
+        else if (SDL_strcmp(Arg, "--present") == 0 && HasValue && ParsePresentMode(Args[I + 1], &Options->PresentMode))
+        {
+            ++I;
+        }
+        else if (SDL_strcmp(Arg, "--fps") == 0 && HasValue)
+        {
+            Options->FrameLimit = SDL_strtoul(Args[++I], NULL, 0);
+        }
+        else
+        {
+            printf("Unknown option %s\n", Arg);
+            printf("Usage: sdltest [--bench] [--bench-gpu] [--bench-heightfield SIZE] [--seed N] [--quality low|medium|high] [--present vsync|mailbox|immediate] [--fps N] [--mesh FILE.obj|glb [--weld DISTANCE]] [--heightfield FILE] [--write-heightfield FILE SIZE] [--capture FILE] [--replay FILE [--headless]]\n");
+            return false;
+        }
+    }
+
+    if (Options->WriteHeightfieldPath && !IsHeightfieldSize(Options->WriteHeightfieldSize))
+    {
+        printf("--write-heightfield needs a power of two size of at least %u\n", HEIGHTFIELD_TILE_SIZE);
+        return false;
+    }
+
+    if (Options->HeightfieldBenchmarkSize && !IsHeightfieldSize(Options->HeightfieldBenchmarkSize))
+    {
+        printf("--bench-heightfield needs a power of two size of at least %u\n", HEIGHTFIELD_TILE_SIZE);
+        return false;
+    }
+
+    if (Options->WeldDistance != 0 && (!Options->MeshPath || !(Options->WeldDistance > 0) || !isfinite(Options->WeldDistance)))
+    {
+        printf("--weld needs a --mesh and a positive distance\n");
+        return false;
+    }
+
+    if (Options->Headless && !Options->ReplayPath)
+    {
+        printf("--headless needs a --replay to drive it\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Startup tasks...
+//
+// Everything main() needs before the first frame. See AddStartupTasks for
+// what depends on what.
+struct startup_data
+{
+    options *Options;
+    quality_tier Quality;
+
+    SDL_Window *Window;
+    SDL_GPUTexture *HeadlessTarget;
+    SDL_GPUTextureFormat ColorFormat;
+    SDL_GPUTextureFormat DepthFormat;
+    presenter Presenter;
+
+    water_shaders Shaders;
+    SDL_GPUGraphicsPipeline *Pipeline;
+    SDL_GPUTexture *DepthBuffer;
+
+    SDL_GPUBuffer *VertexBuffer;
+    SDL_GPUBuffer *IndexBuffer;
+    u32 IndexCount;
+    aabb MeshBox;
+
+    SDL_GPUTexture *Texture;
+    SDL_GPUSampler *Sampler;
+
+    object_buffer Objects;
+    cull_bvh ObjectBvh;
+
+    instance_renderer Instancer;
+    u32 ArchetypeMeshes[Archetype_Count];
+    u32 ArchetypeMaterials[Archetype_Count];
+
+    bool HasTerrain;
+    heightfield_streamer Heightfield;
+    terrain_renderer Terrain;
+};
+
+bool StartupCreateDevice(void *Data)
+{
+    State.Device = SDL_CreateGPUDevice(SDL_GPU_SHADERFORMAT_SPIRV, true, NULL);
+    if (!State.Device)
+    {
+        return false;
+    }
+
+    InitGpuRegistry(&State.Resources, State.Device);
+    return true;
+}
+
+bool StartupCreateWindow(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
+    if (Startup->Options->Headless)
+    {
+        return true;
+    }
+
+    Startup->Window = SDL_CreateWindow("My game", WindowWidth, WindowHeight, SDL_WINDOW_RESIZABLE | SDL_WINDOW_VULKAN);
+    return Startup->Window != NULL;
+}
+
+bool StartupClaimWindow(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
+    Startup->ColorFormat = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+
+    if (Startup->Options->Headless)
+    {
+        SDL_GPUTextureCreateInfo HeadlessTargetInfo = {};
+        HeadlessTargetInfo.type = SDL_GPU_TEXTURETYPE_2D;
+        HeadlessTargetInfo.format = Startup->ColorFormat;
+        HeadlessTargetInfo.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET;
+        HeadlessTargetInfo.width = WindowWidth;
+        HeadlessTargetInfo.height = WindowHeight;
+        HeadlessTargetInfo.layer_count_or_depth = 1;
+        HeadlessTargetInfo.num_levels = 1;
+        Startup->HeadlessTarget = CreateGpuTexture(&State.Resources, GpuCategory_Targets, "headless target", &HeadlessTargetInfo);
+    }
+    else
+    {
+        if (!SDL_ClaimWindowForGPUDevice(State.Device, Startup->Window))
+        {
+            printf("Failed to assign device to window\n");
+            return false;
+        }
+
+        Startup->ColorFormat = SDL_GetGPUSwapchainTextureFormat(State.Device, Startup->Window);
+    }
+
+    InitPresenter(&Startup->Presenter, Startup->Window, Startup->Options->PresentMode, Startup->Options->FrameLimit);
+    return true;
+}
+
+bool StartupLoadShaders(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
+    Startup->Shaders = LoadWaterShaders(QualityVariants[Startup->Quality]);
+    if (!Startup->Shaders.Vertex)
+    {
+        return false;
+    }
+
+    shader_variant Variant = Startup->Shaders.Variant;
+    SDL_Log("Quality %s: %u octaves, normal mode %u, lighting %u", QualityNames[Startup->Quality],
+            Variant.OctaveCount, Variant.NormalMode, Variant.Lighting);
+    return true;
+}
+
+bool StartupCreatePipeline(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
+    Startup->Pipeline = CreateWaterPipeline(Startup->Shaders, Startup->ColorFormat, Startup->DepthFormat);
+    return Startup->Pipeline != NULL;
+}
+
+bool StartupCreateDepthBuffer(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
 
-    // Depth Buffer
-    //
     SDL_GPUTextureCreateInfo DepthBufferInfo = {};
     DepthBufferInfo.type = SDL_GPU_TEXTURETYPE_2D;
-    DepthBufferInfo.format = DepthFormat;
+    DepthBufferInfo.format = Startup->DepthFormat;
     DepthBufferInfo.usage = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET;
     DepthBufferInfo.width = WindowWidth;
     DepthBufferInfo.height = WindowHeight;
     DepthBufferInfo.layer_count_or_depth = 1;
     DepthBufferInfo.num_levels = 1;
-    SDL_GPUTexture *DepthBuffer = SDL_CreateGPUTexture(State.Device, &DepthBufferInfo);
+    Startup->DepthBuffer = CreateGpuTexture(&State.Resources, GpuCategory_Targets, "depth buffer", &DepthBufferInfo);
+    return Startup->DepthBuffer != NULL;
+}
+
+bool StartupUploadGeometry(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
+
+    if (Startup->Options->MeshPath)
+    {
+        return UploadMeshFile(Startup->Options->MeshPath, Startup->Options->WeldDistance, &Startup->VertexBuffer,
+                              &Startup->IndexBuffer, &Startup->IndexCount, &Startup->MeshBox);
+    }
 
     u32 VertexCount = 0;
     vertex Vertices[1024] = {};
 
-    u32 IndexCount = 0;
     u32 Indices[1024] = {};
 
-    i32 Segments = 5;
+    BuildPlane(5, Vertices, &VertexCount, Indices, &Startup->IndexCount);
+    Startup->MeshBox = MeshBounds(Vertices, VertexCount);
 
-    for (i32 I = -Segments; I <= Segments; ++I)
+    // Vertex Buffer
+    //
+    SDL_GPUBufferCreateInfo VertexBufferInfo = {};
+    VertexBufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
+    VertexBufferInfo.size = sizeof(vertex) * VertexCount;
+    Startup->VertexBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Geometry, "water vertices", &VertexBufferInfo);
+
+    CopyToBuffer(Startup->VertexBuffer, Vertices, sizeof(vertex) * VertexCount);
+
+    // Index Buffer
+    //
+    SDL_GPUBufferCreateInfo IndexBufferInfo = {};
+    IndexBufferInfo.usage = SDL_GPU_BUFFERUSAGE_INDEX;
+    IndexBufferInfo.size = sizeof(u32) * Startup->IndexCount;
+    Startup->IndexBuffer = CreateGpuBuffer(&State.Resources, GpuCategory_Geometry, "water indices", &IndexBufferInfo);
+
+    CopyToBuffer(Startup->IndexBuffer, Indices, sizeof(u32) * Startup->IndexCount);
+    return true;
+}
+
+bool StartupBakeNoise(void *Data)
+{
+    BakeNoise(State.NoiseData, State.Seed);
+    return true;
+}
+
+bool StartupCreateNoiseTexture(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
+    Startup->Texture = CreateNoiseTexture(State.NoiseData);
+    return Startup->Texture != NULL;
+}
+
+bool StartupCreateSampler(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
+    Startup->Sampler = CreateWrapSampler();
+    return Startup->Sampler != NULL;
+}
+
+// Floating objects
+bool StartupSpawnEntities(void *Data)
+{
+    u32 EntityCount = 20000;
+    u32 Random = State.Seed * 2654435761u | 1;
+    InitEntityStore(&State.Entities);
+    SpawnEntities(&State.Entities, EntityCount, 10, &Random);
+    State.EntityInstances = (entity_instance *) SDL_malloc(sizeof(entity_instance) * EntityCount);
+    return true;
+}
+
+// Per object data. The plane gets tiled around the origin, an imported mesh
+// is drawn once.
+bool StartupBuildObjects(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
+
+    object_buffer *Objects = &Startup->Objects;
+    v4 WaterMaterial = V4(0.2, 0.3, 0.4, 1);
+    i32 TileRadius = Startup->Options->MeshPath ? 0 : WATER_TILE_RADIUS;
+    u32 ObjectCapacity = (2 * TileRadius + 1) * (2 * TileRadius + 1);
+    InitObjectBuffer(Objects, ObjectCapacity);
+
+    // Every vertex goes through WaterHeight, so boxes have to cover the waves.
+    aabb *ObjectBounds = (aabb *) SDL_malloc(sizeof(aabb) * ObjectCapacity);
+    v3 WaveExtent = V3(0, MaxWaterDisplacement(Startup->Shaders.Variant.OctaveCount), 0);
+    for (i32 Z = -TileRadius; Z <= TileRadius; ++Z)
     {
-        for (i32 J = -Segments; J <= Segments; ++J)
+        for (i32 X = -TileRadius; X <= TileRadius; ++X)
         {
-            f32 X = (f32) I / (f32) Segments;
-            f32 Z = (f32) J / (f32) Segments;
-
-            vertex *Vertex = Vertices + VertexCount++;
-            Vertex->Position = V3(X, 0, Z);
-            Vertex->Normal = V3(0, 1, 0);
-            Vertex->UV = V2((f32) I / (2 * Segments) + 0.5, (f32) J / (2 * Segments) + 0.5);
+            mat4 Model = Translation(V3(2 * X, 0, 2 * Z));
+            u32 Object = AddObject(Objects, Model, WaterMaterial);
+            ObjectBounds[Object] = InflateBounds(TransformBounds(Model, Startup->MeshBox), WaveExtent);
         }
     }
 
-    for (i32 I = 0; I < 2 * Segments; ++I)
+    BuildCullBvh(&Startup->ObjectBvh, ObjectBounds, Objects->Count);
+    SDL_free(ObjectBounds);
+    return true;
+}
+
+// One box per kind of floating object for now, scaled per entity.
+bool StartupCreateInstancer(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
+    instance_renderer *Instancer = &Startup->Instancer;
+    InitInstanceRenderer(Instancer, State.Entities.EntityCount, Startup->ColorFormat, Startup->DepthFormat);
+
+    v3 HalfSizes[Archetype_Count] = {};
+    HalfSizes[Archetype_Buoy] = V3(0.5, 1.5, 0.5);
+    HalfSizes[Archetype_Boat] = V3(1, 0.5, 2.5);
+    HalfSizes[Archetype_Debris] = V3(1, 0.25, 1);
+
+    v4 Colors[Archetype_Count] = {};
+    Colors[Archetype_Buoy] = V4(0.8, 0.2, 0.1, 1);
+    Colors[Archetype_Boat] = V4(0.9, 0.9, 0.85, 1);
+    Colors[Archetype_Debris] = V4(0.4, 0.3, 0.2, 1);
+
+    for (u32 Kind = 0; Kind < Archetype_Count; ++Kind)
     {
-        for (i32 J = 0; J < 2 * Segments; ++J)
+        vertex Vertices[24];
+        u32 Indices[36];
+        u32 VertexCount;
+        u32 IndexCount;
+        BuildBox(HalfSizes[Kind], Vertices, &VertexCount, Indices, &IndexCount);
+        Startup->ArchetypeMeshes[Kind] = AddInstanceMesh(Instancer, Vertices, VertexCount, Indices, IndexCount);
+        Startup->ArchetypeMaterials[Kind] = AddInstanceMaterial(Instancer, Colors[Kind]);
+    }
+
+    return true;
+}
+
+bool StartupOpenHeightfield(void *Data)
+{
+    startup_data *Startup = (startup_data *) Data;
+    if (!Startup->Options->HeightfieldPath)
+    {
+        return true;
+    }
+
+    // 64 MB of atlas, two tiles around the camera on every level.
+    Startup->HasTerrain = OpenHeightfield(&Startup->Heightfield, Startup->Options->HeightfieldPath,
+                                          64 * 1024 * 1024, 2, 32);
+    if (Startup->HasTerrain)
+    {
+        InitTerrainRenderer(&Startup->Terrain, Startup->ColorFormat, Startup->DepthFormat);
+    }
+    return true;
+}
+
+// Window and device creation stay on the main thread, everything else may
+// run on a worker. SDL_GPU is fine with that as long as each command buffer
+// is submitted on the thread that acquired it.
+void AddStartupTasks(startup_graph *Graph)
+{
+    u32 Device = AddStartupTask(Graph, "device", StartupCreateDevice, true);
+    u32 Window = AddStartupTask(Graph, "window", StartupCreateWindow, true);
+    u32 Noise = AddStartupTask(Graph, "bake noise", StartupBakeNoise);
+    u32 Entities = AddStartupTask(Graph, "spawn entities", StartupSpawnEntities);
+
+    u32 Claim = AddStartupTask(Graph, "claim window", StartupClaimWindow, true);
+    StartupDependsOn(Graph, Claim, Device);
+    StartupDependsOn(Graph, Claim, Window);
+
+    u32 Shaders = AddStartupTask(Graph, "load shaders", StartupLoadShaders);
+    StartupDependsOn(Graph, Shaders, Device);
+
+    u32 Pipeline = AddStartupTask(Graph, "pipeline", StartupCreatePipeline);
+    StartupDependsOn(Graph, Pipeline, Shaders);
+    StartupDependsOn(Graph, Pipeline, Claim);
+
+    u32 DepthBuffer = AddStartupTask(Graph, "depth buffer", StartupCreateDepthBuffer);
+    StartupDependsOn(Graph, DepthBuffer, Device);
+
+    u32 Geometry = AddStartupTask(Graph, "geometry", StartupUploadGeometry);
+    StartupDependsOn(Graph, Geometry, Device);
+
+    u32 NoiseTexture = AddStartupTask(Graph, "noise texture", StartupCreateNoiseTexture);
+    StartupDependsOn(Graph, NoiseTexture, Noise);
+    StartupDependsOn(Graph, NoiseTexture, Device);
+
+    u32 Sampler = AddStartupTask(Graph, "sampler", StartupCreateSampler);
+    StartupDependsOn(Graph, Sampler, Device);
+
+    u32 Objects = AddStartupTask(Graph, "objects", StartupBuildObjects);
+    StartupDependsOn(Graph, Objects, Device);
+    StartupDependsOn(Graph, Objects, Shaders);
+    StartupDependsOn(Graph, Objects, Geometry);
+
+    u32 Instancer = AddStartupTask(Graph, "instancer", StartupCreateInstancer);
+    StartupDependsOn(Graph, Instancer, Claim);
+    StartupDependsOn(Graph, Instancer, Entities);
+
+    u32 Heightfield = AddStartupTask(Graph, "heightfield", StartupOpenHeightfield);
+    StartupDependsOn(Graph, Heightfield, Claim);
+}
+
+// Releases everything startup made, after the game loop and when startup
+// failed half way. Whatever a task didn't get to is still zero.
+void FreeStartup(startup_data *Startup)
+{
+    if (State.Device)
+    {
+        // Everything goes back through the registry, whatever is left leaked.
+        WaitForGpuFrames(&State.Resources);
+        if (Startup->HasTerrain)
+        {
+            FreeTerrainRenderer(&Startup->Terrain);
+            CloseHeightfield(&Startup->Heightfield);
+        }
+        FreeInstanceRenderer(&Startup->Instancer);
+        FreeObjectBuffer(&Startup->Objects);
+        ReleaseGpuResource(&State.Resources, Startup->Sampler);
+        ReleaseGpuResource(&State.Resources, Startup->Texture);
+        ReleaseGpuResource(&State.Resources, Startup->IndexBuffer);
+        ReleaseGpuResource(&State.Resources, Startup->VertexBuffer);
+        ReleaseGpuResource(&State.Resources, Startup->DepthBuffer);
+        ReleaseGpuResource(&State.Resources, Startup->HeadlessTarget);
+        ReleaseGpuResource(&State.Resources, Startup->Pipeline);
+
+        // CreateWaterPipeline releases the shaders, unless it never ran.
+        if (!Startup->Pipeline && Startup->Shaders.Vertex)
+        {
+            SDL_ReleaseGPUShader(State.Device, Startup->Shaders.Vertex);
+        }
+        if (!Startup->Pipeline && Startup->Shaders.Fragment)
         {
-            Indices[IndexCount + 0] = PlaneVertexAt(I, J, Segments);
-            Indices[IndexCount + 1] = PlaneVertexAt(I + 1, J, Segments);
-            Indices[IndexCount + 2] = PlaneVertexAt(I + 1, J + 1, Segments);
+            SDL_ReleaseGPUShader(State.Device, Startup->Shaders.Fragment);
+        }
+
+        ShutdownGpuRegistry(&State.Resources);
+        SDL_DestroyGPUDevice(State.Device);
+        State.Device = NULL;
+    }
+    FreeCullBvh(&Startup->ObjectBvh);
+
+    if (Startup->Window)
+    {
+        SDL_DestroyWindow(Startup->Window);
+    }
+    *Startup = {};
+}
+
+i32 main(i32 ArgCount, char **Args)
+{
+    // Time to first frame counts from here.
+    f64 ProcessStart = GetSeconds();
 
-            Indices[IndexCount + 3] = PlaneVertexAt(I, J, Segments);
-            Indices[IndexCount + 4] = PlaneVertexAt(I + 1, J + 1, Segments);
-            Indices[IndexCount + 5] = PlaneVertexAt(I, J + 1, Segments);
+    options Options;
+    if (!ParseOptions(&Options, ArgCount, Args))
+    {
+        return 1;
+    }
 
-            IndexCount += 6;
+    InitJobs();
+
+    if (Options.Benchmark || Options.GpuBenchmark || Options.HeightfieldBenchmarkSize)
+    {
+        if (Options.Benchmark)
+        {
+            RunBenchmarks();
+        }
+        if (Options.HeightfieldBenchmarkSize)
+        {
+            BenchmarkHeightfield(Options.HeightfieldBenchmarkSize);
+        }
+        if (Options.GpuBenchmark)
+        {
+            RunGpuBenchmarks();
         }
+        ShutdownJobs();
+        return 0;
     }
 
-    // Vertex Buffer
-    //
-    SDL_GPUBufferCreateInfo VertexBufferInfo = {};
-    VertexBufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
-    VertexBufferInfo.size = sizeof(vertex) * VertexCount;
-    SDL_GPUBuffer *VertexBuffer = SDL_CreateGPUBuffer(State.Device, &VertexBufferInfo);
+    if (Options.WriteHeightfieldPath)
+    {
+        f64 Start = GetSeconds();
+        u64 Size = WriteHeightfield(Options.WriteHeightfieldPath, Options.WriteHeightfieldSize, Options.Seed, 1.0f, 512.0f);
+        if (!Size)
+        {
+            printf("Failed to write %s\n", Options.WriteHeightfieldPath);
+        }
+        else
+        {
+            printf("Wrote %s: %.2f MB in %.2f s\n", Options.WriteHeightfieldPath, Size / 1e6, GetSeconds() - Start);
+        }
+        ShutdownJobs();
+        return Size ? 0 : 1;
+    }
 
-    CopyToBuffer(VertexBuffer, Vertices, sizeof(vertex) * VertexCount);
+    State.Seed = Options.Seed;
+    quality_tier Quality = Options.HasQuality ? Options.Quality : PickQualityTier();
 
-    // Index Buffer
-    //
-    SDL_GPUBufferCreateInfo IndexBufferInfo = {};
-    IndexBufferInfo.usage = SDL_GPU_BUFFERUSAGE_INDEX;
-    IndexBufferInfo.size = sizeof(u32) * IndexCount;
-    SDL_GPUBuffer *IndexBuffer = SDL_CreateGPUBuffer(State.Device, &IndexBufferInfo);
+    if (Options.ReplayPath)
+    {
+        if (!BeginPlayback(&State.Replay, Options.ReplayPath))
+        {
+            ShutdownJobs();
+            return 1;
+        }
 
-    CopyToBuffer(IndexBuffer, Indices, sizeof(u32) * IndexCount);
-    
-    // Noise Texture
-    //
-    u8 NoiseData[256 * 256];
-    for (u32 X = 0; X < 256; ++X)
+        // Everything that influences the simulation comes from the log.
+        State.Seed = State.Replay.Header.Seed;
+        Quality = (quality_tier) SDL_min(State.Replay.Header.Quality, Quality_Count - 1);
+        WindowWidth = State.Replay.Header.WindowWidth;
+        WindowHeight = State.Replay.Header.WindowHeight;
+    }
+    else if (Options.CapturePath)
     {
-        for (u32 Y = 0; Y < 256; ++Y)
+        if (!BeginCapture(&State.Replay, Options.CapturePath, State.Seed, Quality, WindowWidth, WindowHeight))
         {
-            f32 NoiseX = (f32) X / 256.0f * 16.0f;
-            f32 NoiseY = (f32) Y / 256.0f * 16.0f;
-            // NoiseData[X + 256 * Y] = stb_perlin_noise3(NoiseX, NoiseY, 0, 0, 0, 0);
-            f32 NoiseSample = (stb_perlin_noise3(NoiseX, NoiseY, 0, 256.0f / 16.0f, 256.0f / 16.0f, 0) + 1) / 2;
-            NoiseData[X + 256 * Y] = NoiseSample * 255;
+            ShutdownJobs();
+            return 1;
         }
     }
 
-    SDL_GPUTextureCreateInfo NoiseInfo = {};
-    NoiseInfo.type = SDL_GPU_TEXTURETYPE_2D;
-    NoiseInfo.format = SDL_GPU_TEXTUREFORMAT_R8_UNORM;
-    NoiseInfo.width = 256;
-    NoiseInfo.height = 256;
-    NoiseInfo.layer_count_or_depth = 1;
-    NoiseInfo.num_levels = 1;
-    NoiseInfo.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
-	SDL_GPUTexture *Texture = SDL_CreateGPUTexture(State.Device, &NoiseInfo);
+    if (Options.Headless)
+    {
+        // Vulkan still needs a video driver to load, just not a visible one.
+        SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+    }
 
-    CopyToTexture(Texture, NoiseData, 256, 256, sizeof(u8));
+    SDL_Init(SDL_INIT_VIDEO);
 
-    SDL_GPUSamplerCreateInfo PointWrapSamplerInfo = {};
-    PointWrapSamplerInfo.min_filter = SDL_GPU_FILTER_LINEAR;
-    PointWrapSamplerInfo.mag_filter = SDL_GPU_FILTER_LINEAR;
-    PointWrapSamplerInfo.mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_NEAREST;
-    PointWrapSamplerInfo.address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_REPEAT;
-    PointWrapSamplerInfo.address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_REPEAT;
-    PointWrapSamplerInfo.address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_REPEAT;
-    SDL_GPUSampler *PointWrapSampler = SDL_CreateGPUSampler(State.Device, &PointWrapSamplerInfo);
+    SDL_SetLogPriorities(SDL_LOG_PRIORITY_DEBUG);
+
+    startup_data Startup = {};
+    Startup.Options = &Options;
+    Startup.Quality = Quality;
+    // TODO: Make sure this format is actually available. Use fallback then!
+    Startup.DepthFormat = SDL_GPU_TEXTUREFORMAT_D32_FLOAT;
+
+    startup_graph StartupGraph;
+    InitStartupGraph(&StartupGraph, &Startup);
+    AddStartupTasks(&StartupGraph);
+    if (!RunStartup(&StartupGraph))
+    {
+        EndReplay(&State.Replay);
+        FreeStartup(&Startup);
+        ShutdownJobs();
+        SDL_Quit();
+        return 1;
+    }
+
+    SDL_Window *Window = Startup.Window;
+    SDL_GPUTexture *HeadlessTarget = Startup.HeadlessTarget;
+    presenter Presenter = Startup.Presenter;
+    shader_variant Variant = Startup.Shaders.Variant;
+    SDL_GPUGraphicsPipeline *Pipeline = Startup.Pipeline;
+    SDL_GPUTexture *DepthBuffer = Startup.DepthBuffer;
+    SDL_GPUBuffer *VertexBuffer = Startup.VertexBuffer;
+    SDL_GPUBuffer *IndexBuffer = Startup.IndexBuffer;
+    u32 IndexCount = Startup.IndexCount;
+    SDL_GPUTexture *Texture = Startup.Texture;
+    SDL_GPUSampler *PointWrapSampler = Startup.Sampler;
+    object_buffer *Objects = &Startup.Objects;
+    cull_bvh *ObjectBvh = &Startup.ObjectBvh;
+    instance_renderer *Instancer = &Startup.Instancer;
+    u32 InstanceDraws = 0;
+    heightfield_streamer *Heightfield = &Startup.Heightfield;
+    heightfield_stats ReportedStreamStats = {};
+
+    u32 ObjectCapacity = Objects->Capacity;
+    u32 *VisibleObjects = (u32 *) SDL_malloc(sizeof(u32) * ObjectCapacity);
+    u32 *DrawStarts = (u32 *) SDL_malloc(sizeof(u32) * ObjectCapacity);
+    u32 *DrawCounts = (u32 *) SDL_malloc(sizeof(u32) * ObjectCapacity);
+    cull_stats CullStats = {};
+    f64 CullSeconds = 0;
+    u32 FrameIndex = 0;
+    bool FirstFramePresented = false;
 
     // Main loop...
     //
     bool WindowIsOpen = true;
+    v3 CameraPosition = V3(0, 1, 1);
+    camera Camera = {};
 
     SDL_Event Event;
     while (WindowIsOpen)
     {
-        while (SDL_PollEvent(&Event))
+        // Minimized or hidden: no simulation, no rendering, no replay frame.
+        if (PresenterWaitWhileIdle(&Presenter))
+        {
+            continue;
+        }
+
+        f64 FrameStart = GetSeconds();
+
+        if (!ReplayBeginFrame(&State.Replay))
+        {
+            break;
+        }
+
+        while (ReplayPollEvent(&State.Replay, &Event))
         {
             switch (Event.type)
             {
@@ -343,19 +1115,95 @@ i32 main()
         f32 Delta = 1.0 / 60.0;
         State.Time += Delta;
 
-        SDL_GPUCommandBuffer *CommandBuffer = SDL_AcquireGPUCommandBuffer(State.Device);
+        UpdateEntities(&State.Entities, State.NoiseData, Variant.OctaveCount, State.Time, Delta);
+        u32 ArchetypeOffsets[Archetype_Count];
+        FillEntityInstances(&State.Entities, State.EntityInstances, ArchetypeOffsets);
 
-        SDL_GPUTexture *SwapchainTexture;
-        SDL_AcquireGPUSwapchainTexture(CommandBuffer, Window, &SwapchainTexture, NULL, NULL);
+        BeginInstances(Instancer);
+        for (u32 Kind = 0; Kind < Archetype_Count; ++Kind)
+        {
+            PushInstances(Instancer, Startup.ArchetypeMeshes[Kind], Startup.ArchetypeMaterials[Kind],
+                          State.EntityInstances + ArchetypeOffsets[Kind], State.Entities.Archetypes[Kind].Count);
+        }
+
+        SetCameraView(&Camera, CameraPosition, V3(0), V3(0, 1, 0));
+        SetCameraProjection(&Camera, Radians(50), (f32) WindowWidth / (f32) WindowHeight, 0.01, 1000);
+        UpdateCamera(&Camera);
 
         global_uniforms GlobalUniforms = {};
-        GlobalUniforms.Projection = Perspective(Radians(50), (f32) WindowWidth / (f32) WindowHeight, 0.01, 1000);
-        GlobalUniforms.View = LookAt(V3(0, 1, 1), V3(0), V3(0, 1, 0));
+        GlobalUniforms.ViewProjection = Camera.ViewProjection;
         GlobalUniforms.Time = State.Time;
 
+        fragment_uniforms FragmentUniforms = DefaultFragmentUniforms(CameraPosition);
+
+        // The terrain scrolls under the scene, flying diagonally across the heightfield.
+        f32 TerrainX = 0;
+        f32 TerrainZ = 0;
+        if (Startup.HasTerrain)
+        {
+            heightfield_header *Header = Heightfield->Header;
+            f32 TerrainSize = Header->Size * Header->SampleSpacing;
+            f32 Travelled = SDL_fmodf(State.Time * 40.0f * Header->SampleSpacing, 0.9f * TerrainSize);
+            TerrainX = 0.05f * TerrainSize + Travelled;
+            TerrainZ = 0.05f * TerrainSize + Travelled;
+        }
+
+        f64 CullStart = GetSeconds();
+        frustum Frustum = ExtractFrustum(Camera.ViewProjection);
+        u32 VisibleCount = CullBvh(ObjectBvh, &Frustum, VisibleObjects, &CullStats);
+        u32 DrawCount = VisibleRanges(VisibleObjects, VisibleCount, DrawStarts, DrawCounts);
+        CullStats.Seconds = GetSeconds() - CullStart;
+
+        CullSeconds += CullStats.Seconds;
+        if (++FrameIndex % CULL_REPORT_FRAMES == 0)
+        {
+            SDL_Log("Culling: %u visible, %u culled, %u draws, %u nodes, %.3f ms (avg %.3f ms)",
+                    CullStats.Visible, CullStats.Culled, DrawCount, CullStats.NodesVisited,
+                    CullStats.Seconds * 1000, CullSeconds * 1000 / CULL_REPORT_FRAMES);
+            SDL_Log("Instancing: %u instances in %u draws", Instancer->Count, InstanceDraws);
+            LogGpuResources(&State.Resources);
+            if (Startup.HasTerrain)
+            {
+                heightfield_stats Stats = Heightfield->Stats;
+                u64 Requests = Stats.Requests - ReportedStreamStats.Requests;
+                u64 Bytes = Stats.BytesStreamed - ReportedStreamStats.BytesStreamed;
+                SDL_Log("Heightfield: %.2f%% faults, %llu loads, %llu evictions, %.2f MB/s, %.3f ms/frame",
+                        Requests ? 100.0 * (Stats.Faults - ReportedStreamStats.Faults) / Requests : 0.0,
+                        (unsigned long long) (Stats.Loads - ReportedStreamStats.Loads),
+                        (unsigned long long) (Stats.Evictions - ReportedStreamStats.Evictions),
+                        Bytes / 1e6 / (CULL_REPORT_FRAMES * Delta),
+                        (Stats.StreamNS - ReportedStreamStats.StreamNS) / 1e6 / CULL_REPORT_FRAMES);
+                ReportedStreamStats = Stats;
+            }
+            CullSeconds = 0;
+        }
+
+        if (State.Replay.Mode != Replay_Off)
+        {
+            u32 StateHash = HashBytes(HASH_SEED, &GlobalUniforms, sizeof(GlobalUniforms));
+            StateHash = HashBytes(StateHash, State.EntityInstances, sizeof(entity_instance) * State.Entities.EntityCount);
+            ReplayRecordFrame(&State.Replay, &GlobalUniforms, StateHash);
+        }
+
+        SDL_GPUCommandBuffer *CommandBuffer = SDL_AcquireGPUCommandBuffer(State.Device);
+
+        SDL_GPUTexture *SwapchainTexture = HeadlessTarget;
+        if (Window)
+        {
+            SDL_AcquireGPUSwapchainTexture(CommandBuffer, Window, &SwapchainTexture, NULL, NULL);
+        }
+
         // NOTE: When window is minimized there is no swapchain image, so SwapchainTexture will be NULL
         if (SwapchainTexture)
         {
+            // NOTE: Inside the branch, a cancelled command buffer would drop the upload.
+            UploadObjects(Objects, CommandBuffer);
+            UploadInstances(Instancer, CommandBuffer);
+            if (Startup.HasTerrain)
+            {
+                UpdateHeightfield(Heightfield, TerrainX, TerrainZ, CommandBuffer);
+            }
+
             SDL_GPUColorTargetInfo ColorTargetInfo = {};
             ColorTargetInfo.texture = SwapchainTexture;
             ColorTargetInfo.clear_color = { 1, 1, 1, 1 };
@@ -384,13 +1232,74 @@ i32 main()
             TextureSamplerBinding.sampler = PointWrapSampler;
             SDL_BindGPUVertexSamplers(RenderPass, 0, &TextureSamplerBinding, 1);
             SDL_BindGPUFragmentSamplers(RenderPass, 0, &TextureSamplerBinding, 1);
+            SDL_BindGPUVertexStorageBuffers(RenderPass, 0, &Objects->Buffer, 1);
 
             SDL_PushGPUVertexUniformData(CommandBuffer, 0, &GlobalUniforms, sizeof(GlobalUniforms));
-            SDL_DrawGPUIndexedPrimitives(RenderPass, IndexCount, 1, 0, 0, 0);
+            SDL_PushGPUFragmentUniformData(CommandBuffer, 0, &FragmentUniforms, sizeof(FragmentUniforms));
+            TouchGpuResource(&State.Resources, VertexBuffer);
+            TouchGpuResource(&State.Resources, IndexBuffer);
+            TouchGpuResource(&State.Resources, Texture);
+            TouchGpuResource(&State.Resources, Objects->Buffer);
+            // Culled objects leave gaps, every run of visible ones is one draw.
+            for (u32 Draw = 0; Draw < DrawCount; ++Draw)
+            {
+                SDL_DrawGPUIndexedPrimitives(RenderPass, IndexCount, DrawCounts[Draw], 0, 0, DrawStarts[Draw]);
+            }
+
+            InstanceDraws = DrawInstances(Instancer, RenderPass, CommandBuffer, &GlobalUniforms, &FragmentUniforms);
+
+            if (Startup.HasTerrain)
+            {
+                DrawTerrain(&Startup.Terrain, Heightfield, RenderPass, CommandBuffer, &GlobalUniforms,
+                            &FragmentUniforms, TerrainX, TerrainZ);
+            }
 
             SDL_EndGPURenderPass(RenderPass);
         }
 
-        SDL_SubmitGPUCommandBuffer(CommandBuffer);
+        if (!SwapchainTexture)
+        {
+            // Nothing to present, don't make the GPU chew on an empty submit.
+            SDL_CancelGPUCommandBuffer(CommandBuffer);
+            SkipGpuFrame(&State.Resources);
+        }
+        else
+        {
+            // Every frame gets a fence, that's what deferred releases wait on.
+            SubmitGpuFrame(&State.Resources, CommandBuffer);
+
+            // Headless waits so frame times include the GPU work too. The first
+            // frame waits because that's when it's actually on screen.
+            if (Options.Headless || !FirstFramePresented)
+            {
+                WaitForGpuFrames(&State.Resources);
+            }
+        }
+
+        if (SwapchainTexture && !FirstFramePresented)
+        {
+            FirstFramePresented = true;
+            ReportStartup(&StartupGraph);
+            printf("Time to first frame: %.2f ms\n", (GetSeconds() - ProcessStart) * 1000);
+            ReportGpuResources(&State.Resources);
+        }
+
+        if (State.Replay.Mode != Replay_Off)
+        {
+            ReplayTrackFrameTime(&State.Replay, GetSeconds() - FrameStart);
+        }
+
+        PresenterEndFrame(&Presenter);
     }
+
+    EndReplay(&State.Replay);
+    FreeStartup(&Startup);
+
+    SDL_free(DrawCounts);
+    SDL_free(DrawStarts);
+    SDL_free(VisibleObjects);
+
+    ShutdownJobs();
+    SDL_Quit();
+    return 0;
 }
@@ -0,0 +1,460 @@
+// CPU mesh processing for imported and procedurally combined meshes: merge by
+// distance, degenerate triangle removal, normal recomputation and flipping.
+//
+// Everything works in place on indexed triangle lists of `vertex`. The usual
+// order after an import is WeldVertices, RemoveDegenerateTriangles,
+// RecomputeNormals, since welding can collapse thin triangles.
+
+#define MESH_CHUNK_SIZE 16384
+#define WELD_CELL_SCALE 16
+
+struct mesh
+{
+    vertex *Vertices;
+    u32 VertexCount;
+
+    u32 *Indices;
+    u32 IndexCount;
+};
+
+struct mesh_job_data
+{
+    mesh *Mesh;
+
+    // Welding
+    f32 InvCellSize;
+    f32 Distance;
+    f32 DistanceSquared;
+    u32 TableMask;
+    u32 *VertexBuckets;
+    SDL_AtomicInt *BucketCursors;
+    u32 *BucketStarts;
+    u32 *SortedVertices;
+    v3 *SortedPositions;
+    SDL_AtomicInt *Parents;
+    u32 *Remap;
+
+    // Degenerates
+    f32 MinArea;
+    u8 *KeepTriangle;
+
+    // Normals
+    v3 *FaceNormals;
+    u32 *VertexTriangleStarts;
+    u32 *VertexTriangles;
+};
+
+inline i32 WeldCell(f32 Value, f32 InvCellSize)
+{
+    return (i32) floorf(Value * InvCellSize);
+}
+
+inline u32 WeldBucket(i32 X, i32 Y, i32 Z, u32 TableMask)
+{
+    u32 Hash = ((u32) X * 73856093u) ^ ((u32) Y * 19349663u) ^ ((u32) Z * 83492791u);
+    Hash ^= Hash >> 16;
+    Hash *= 0x7FEB352D;
+    Hash ^= Hash >> 15;
+    return Hash & TableMask;
+}
+
+void WeldBucketJob(void *Data, u32 Start, u32 End)
+{
+    mesh_job_data *Job = (mesh_job_data *) Data;
+    vertex *Vertices = Job->Mesh->Vertices;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        v3 P = Vertices[I].Position;
+        u32 Bucket = WeldBucket(WeldCell(P.X, Job->InvCellSize), WeldCell(P.Y, Job->InvCellSize),
+                                WeldCell(P.Z, Job->InvCellSize), Job->TableMask);
+        Job->VertexBuckets[I] = Bucket;
+        SDL_AddAtomicInt(Job->BucketCursors + Bucket, 1);
+    }
+}
+
+void WeldScatterJob(void *Data, u32 Start, u32 End)
+{
+    mesh_job_data *Job = (mesh_job_data *) Data;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        u32 Slot = SDL_AddAtomicInt(Job->BucketCursors + Job->VertexBuckets[I], 1);
+        Job->SortedVertices[Slot] = I;
+        Job->SortedPositions[Slot] = Job->Mesh->Vertices[I].Position;
+    }
+}
+
+// Union-find over the vertices. A root is always the lowest index in its
+// cluster and parents only ever point down, so Parents[I] <= I.
+u32 WeldFind(SDL_AtomicInt *Parents, u32 I)
+{
+    for (;;)
+    {
+        u32 Parent = (u32) SDL_GetAtomicInt(Parents + I);
+        if (Parent == I)
+        {
+            return I;
+        }
+
+        // Path halving. Losing the race is fine, the parent only moved closer
+        // to the root in the meantime.
+        u32 GrandParent = (u32) SDL_GetAtomicInt(Parents + Parent);
+        SDL_CompareAndSwapAtomicInt(Parents + I, Parent, GrandParent);
+        I = GrandParent;
+    }
+}
+
+void WeldUnion(SDL_AtomicInt *Parents, u32 A, u32 B)
+{
+    for (;;)
+    {
+        A = WeldFind(Parents, A);
+        B = WeldFind(Parents, B);
+        if (A == B)
+        {
+            return;
+        }
+
+        // Hang the higher root under the lower one. The swap fails if someone
+        // else linked it first, then both roots get looked up again.
+        u32 High = SDL_max(A, B);
+        u32 Low = SDL_min(A, B);
+        if (SDL_CompareAndSwapAtomicInt(Parents + High, High, Low))
+        {
+            return;
+        }
+    }
+}
+
+// Joins every vertex with each lower indexed vertex within Distance of it.
+// Runs in bucket order over the sorted copies, so candidates are contiguous in
+// memory instead of scattered all over the vertex array.
+void WeldSearchJob(void *Data, u32 Start, u32 End)
+{
+    mesh_job_data *Job = (mesh_job_data *) Data;
+
+    for (u32 Sorted = Start; Sorted < End; ++Sorted)
+    {
+        u32 I = Job->SortedVertices[Sorted];
+        v3 P = Job->SortedPositions[Sorted];
+        f32 D = Job->Distance;
+        i32 MinX = WeldCell(P.X - D, Job->InvCellSize);
+        i32 MinY = WeldCell(P.Y - D, Job->InvCellSize);
+        i32 MinZ = WeldCell(P.Z - D, Job->InvCellSize);
+        i32 MaxX = WeldCell(P.X + D, Job->InvCellSize);
+        i32 MaxY = WeldCell(P.Y + D, Job->InvCellSize);
+        i32 MaxZ = WeldCell(P.Z + D, Job->InvCellSize);
+
+        for (i32 Z = MinZ; Z <= MaxZ; ++Z)
+        {
+            for (i32 Y = MinY; Y <= MaxY; ++Y)
+            {
+                for (i32 X = MinX; X <= MaxX; ++X)
+                {
+                    u32 Bucket = WeldBucket(X, Y, Z, Job->TableMask);
+                    for (u32 Slot = Job->BucketStarts[Bucket]; Slot < Job->BucketStarts[Bucket + 1]; ++Slot)
+                    {
+                        u32 Other = Job->SortedVertices[Slot];
+                        if (Other < I)
+                        {
+                            v3 Delta = Job->SortedPositions[Slot] - P;
+                            if (Dot(Delta, Delta) <= Job->DistanceSquared)
+                            {
+                                WeldUnion(Job->Parents, I, Other);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void WeldRootJob(void *Data, u32 Start, u32 End)
+{
+    mesh_job_data *Job = (mesh_job_data *) Data;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        Job->Remap[I] = WeldFind(Job->Parents, I);
+    }
+}
+
+void RemapIndicesJob(void *Data, u32 Start, u32 End)
+{
+    mesh_job_data *Job = (mesh_job_data *) Data;
+    u32 *Indices = Job->Mesh->Indices;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        Indices[I] = Job->Remap[Indices[I]];
+    }
+}
+
+// Merges every cluster of vertices chained together by gaps of at most
+// Distance into one vertex, keeping the attributes of the lowest indexed one.
+// This is transitive: with Distance 1, vertices at x=0, 0.9, 1.8 and 2.7 all
+// become one, although the ends are 2.7 apart. The clusters don't depend on
+// vertex order or thread timing. Returns how many vertices were removed.
+u32 WeldVertices(mesh *Mesh, f32 Distance)
+{
+    assert(Distance > 0);
+
+    u32 VertexCount = Mesh->VertexCount;
+    if (VertexCount == 0)
+    {
+        return 0;
+    }
+
+    u32 TableSize = 1;
+    while (TableSize < VertexCount)
+    {
+        TableSize *= 2;
+    }
+
+    mesh_job_data Job = {};
+    Job.Mesh = Mesh;
+    // With cells much bigger than Distance most vertices only have to look at
+    // their own cell, instead of always 27. Every probe is a cache miss on big
+    // meshes, and vertices are rarely that close unless they're duplicates.
+    Job.InvCellSize = 1.0f / (WELD_CELL_SCALE * Distance);
+    Job.Distance = Distance;
+    Job.DistanceSquared = Distance * Distance;
+    Job.TableMask = TableSize - 1;
+    Job.VertexBuckets = (u32 *) SDL_malloc(sizeof(u32) * VertexCount);
+    Job.BucketCursors = (SDL_AtomicInt *) SDL_calloc(TableSize, sizeof(SDL_AtomicInt));
+    Job.BucketStarts = (u32 *) SDL_malloc(sizeof(u32) * (TableSize + 1));
+    Job.SortedVertices = (u32 *) SDL_malloc(sizeof(u32) * VertexCount);
+    Job.SortedPositions = (v3 *) SDL_malloc(sizeof(v3) * VertexCount);
+    Job.Parents = (SDL_AtomicInt *) SDL_malloc(sizeof(SDL_AtomicInt) * VertexCount);
+    Job.Remap = (u32 *) SDL_malloc(sizeof(u32) * VertexCount);
+    for (u32 I = 0; I < VertexCount; ++I)
+    {
+        SDL_SetAtomicInt(Job.Parents + I, I);
+    }
+
+    // Counting sort of the vertices by hash bucket, so every bucket is one
+    // contiguous range of SortedVertices.
+    ParallelFor(VertexCount, MESH_CHUNK_SIZE, WeldBucketJob, &Job);
+
+    u32 Offset = 0;
+    for (u32 Bucket = 0; Bucket < TableSize; ++Bucket)
+    {
+        u32 Count = SDL_GetAtomicInt(Job.BucketCursors + Bucket);
+        Job.BucketStarts[Bucket] = Offset;
+        SDL_SetAtomicInt(Job.BucketCursors + Bucket, Offset);
+        Offset += Count;
+    }
+    Job.BucketStarts[TableSize] = Offset;
+
+    ParallelFor(VertexCount, MESH_CHUNK_SIZE, WeldScatterJob, &Job);
+    ParallelFor(VertexCount, MESH_CHUNK_SIZE, WeldSearchJob, &Job);
+    ParallelFor(VertexCount, MESH_CHUNK_SIZE, WeldRootJob, &Job);
+
+    // Every vertex now points straight at its root, and the root is lower, so
+    // it already has its final index here.
+    u32 NewCount = 0;
+    for (u32 I = 0; I < VertexCount; ++I)
+    {
+        if (Job.Remap[I] == I)
+        {
+            Mesh->Vertices[NewCount] = Mesh->Vertices[I];
+            Job.Remap[I] = NewCount++;
+        }
+        else
+        {
+            Job.Remap[I] = Job.Remap[Job.Remap[I]];
+        }
+    }
+
+    ParallelFor(Mesh->IndexCount, MESH_CHUNK_SIZE, RemapIndicesJob, &Job);
+    Mesh->VertexCount = NewCount;
+
+    SDL_free(Job.Remap);
+    SDL_free(Job.Parents);
+    SDL_free(Job.SortedPositions);
+    SDL_free(Job.SortedVertices);
+    SDL_free(Job.BucketStarts);
+    SDL_free(Job.BucketCursors);
+    SDL_free(Job.VertexBuckets);
+
+    return VertexCount - NewCount;
+}
+
+void MarkDegeneratesJob(void *Data, u32 Start, u32 End)
+{
+    mesh_job_data *Job = (mesh_job_data *) Data;
+    vertex *Vertices = Job->Mesh->Vertices;
+    u32 *Indices = Job->Mesh->Indices;
+
+    // Cross product length is twice the area.
+    f32 MinCross = 2 * Job->MinArea;
+    f32 MinCrossSquared = MinCross * MinCross;
+
+    for (u32 Triangle = Start; Triangle < End; ++Triangle)
+    {
+        u32 A = Indices[Triangle * 3 + 0];
+        u32 B = Indices[Triangle * 3 + 1];
+        u32 C = Indices[Triangle * 3 + 2];
+
+        bool Keep = A != B && B != C && C != A;
+        if (Keep)
+        {
+            v3 Normal = Cross(Vertices[B].Position - Vertices[A].Position, Vertices[C].Position - Vertices[A].Position);
+            Keep = Dot(Normal, Normal) > MinCrossSquared;
+        }
+
+        Job->KeepTriangle[Triangle] = Keep;
+    }
+}
+
+// Drops triangles that reference a vertex twice or have an area of MinArea or
+// less. Vertices aren't touched. Returns how many triangles were removed.
+u32 RemoveDegenerateTriangles(mesh *Mesh, f32 MinArea)
+{
+    u32 TriangleCount = Mesh->IndexCount / 3;
+
+    mesh_job_data Job = {};
+    Job.Mesh = Mesh;
+    Job.MinArea = MinArea;
+    Job.KeepTriangle = (u8 *) SDL_malloc(TriangleCount);
+
+    ParallelFor(TriangleCount, MESH_CHUNK_SIZE, MarkDegeneratesJob, &Job);
+
+    u32 *Indices = Mesh->Indices;
+    u32 NewCount = 0;
+    for (u32 Triangle = 0; Triangle < TriangleCount; ++Triangle)
+    {
+        if (Job.KeepTriangle[Triangle])
+        {
+            Indices[NewCount * 3 + 0] = Indices[Triangle * 3 + 0];
+            Indices[NewCount * 3 + 1] = Indices[Triangle * 3 + 1];
+            Indices[NewCount * 3 + 2] = Indices[Triangle * 3 + 2];
+            NewCount++;
+        }
+    }
+    Mesh->IndexCount = NewCount * 3;
+
+    SDL_free(Job.KeepTriangle);
+
+    return TriangleCount - NewCount;
+}
+
+void FaceNormalJob(void *Data, u32 Start, u32 End)
+{
+    mesh_job_data *Job = (mesh_job_data *) Data;
+    vertex *Vertices = Job->Mesh->Vertices;
+    u32 *Indices = Job->Mesh->Indices;
+
+    for (u32 Triangle = Start; Triangle < End; ++Triangle)
+    {
+        v3 A = Vertices[Indices[Triangle * 3 + 0]].Position;
+        v3 B = Vertices[Indices[Triangle * 3 + 1]].Position;
+        v3 C = Vertices[Indices[Triangle * 3 + 2]].Position;
+
+        // Not normalized, the length is what weights by area.
+        Job->FaceNormals[Triangle] = Cross(B - A, C - A);
+    }
+}
+
+void VertexNormalJob(void *Data, u32 Start, u32 End)
+{
+    mesh_job_data *Job = (mesh_job_data *) Data;
+    vertex *Vertices = Job->Mesh->Vertices;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        v3 Sum = V3(0);
+        for (u32 Slot = Job->VertexTriangleStarts[I]; Slot < Job->VertexTriangleStarts[I + 1]; ++Slot)
+        {
+            v3 FaceNormal = Job->FaceNormals[Job->VertexTriangles[Slot]];
+            Sum = V3(Sum.X + FaceNormal.X, Sum.Y + FaceNormal.Y, Sum.Z + FaceNormal.Z);
+        }
+
+        // Unreferenced vertices and ones that only touch degenerates keep theirs.
+        if (Dot(Sum, Sum) > 0)
+        {
+            Vertices[I].Normal = Norm(Sum);
+        }
+    }
+}
+
+// Area weighted vertex normals. Gathers per vertex instead of scattering per
+// triangle, so it needs no atomics and sums in the same order every time.
+void RecomputeNormals(mesh *Mesh)
+{
+    u32 VertexCount = Mesh->VertexCount;
+    u32 TriangleCount = Mesh->IndexCount / 3;
+
+    mesh_job_data Job = {};
+    Job.Mesh = Mesh;
+    Job.FaceNormals = (v3 *) SDL_malloc(sizeof(v3) * TriangleCount);
+    Job.VertexTriangleStarts = (u32 *) SDL_calloc(VertexCount + 1, sizeof(u32));
+    Job.VertexTriangles = (u32 *) SDL_malloc(sizeof(u32) * TriangleCount * 3);
+
+    ParallelFor(TriangleCount, MESH_CHUNK_SIZE, FaceNormalJob, &Job);
+
+    // Vertex to triangle table. Counts go one slot ahead, so after the prefix
+    // sum VertexTriangleStarts[I + 1] is the fill cursor of vertex I and ends
+    // up as its end.
+    u32 *Indices = Mesh->Indices;
+    for (u32 I = 0; I < TriangleCount * 3; ++I)
+    {
+        Job.VertexTriangleStarts[Indices[I] + 1]++;
+    }
+
+    u32 Offset = 0;
+    for (u32 I = 0; I <= VertexCount; ++I)
+    {
+        u32 Count = Job.VertexTriangleStarts[I];
+        Job.VertexTriangleStarts[I] = Offset;
+        Offset += Count;
+    }
+
+    for (u32 I = 0; I < TriangleCount * 3; ++I)
+    {
+        Job.VertexTriangles[Job.VertexTriangleStarts[Indices[I] + 1]++] = I / 3;
+    }
+
+    ParallelFor(VertexCount, MESH_CHUNK_SIZE, VertexNormalJob, &Job);
+
+    SDL_free(Job.VertexTriangles);
+    SDL_free(Job.VertexTriangleStarts);
+    SDL_free(Job.FaceNormals);
+}
+
+void FlipWindingJob(void *Data, u32 Start, u32 End)
+{
+    mesh_job_data *Job = (mesh_job_data *) Data;
+    u32 *Indices = Job->Mesh->Indices;
+
+    for (u32 Triangle = Start; Triangle < End; ++Triangle)
+    {
+        u32 Temp = Indices[Triangle * 3 + 1];
+        Indices[Triangle * 3 + 1] = Indices[Triangle * 3 + 2];
+        Indices[Triangle * 3 + 2] = Temp;
+    }
+}
+
+void FlipNormalJob(void *Data, u32 Start, u32 End)
+{
+    mesh_job_data *Job = (mesh_job_data *) Data;
+    vertex *Vertices = Job->Mesh->Vertices;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        v3 Normal = Vertices[I].Normal;
+        Vertices[I].Normal = V3(-Normal.X, -Normal.Y, -Normal.Z);
+    }
+}
+
+// Reverses the winding of every triangle and negates the normals to match.
+void FlipFaces(mesh *Mesh)
+{
+    mesh_job_data Job = {};
+    Job.Mesh = Mesh;
+
+    ParallelFor(Mesh->IndexCount / 3, MESH_CHUNK_SIZE, FlipWindingJob, &Job);
+    ParallelFor(Mesh->VertexCount, MESH_CHUNK_SIZE, FlipNormalJob, &Job);
+}
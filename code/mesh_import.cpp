@@ -0,0 +1,1602 @@
+// Mesh import for Wavefront OBJ and binary glTF (.glb).
+//
+// Files are memory mapped and parsed straight out of the mapping. OpenMeshFile
+// only counts, so the caller can allocate the result (or map a transfer
+// buffer) and DecodeMeshFile writes vertices and indices into that memory
+// without ever reading them back. Bounds are gathered while writing, and
+// missing glTF normals are computed in scratch before the vertices go out.
+// OpenMeshFile also says how much scratch memory decoding needs (the parsed
+// OBJ attributes plus about 50 bytes per face corner for merging). The caller
+// passes that in too, so nothing is allocated while parsing and the scratch
+// can be reused across files.
+//
+// OBJ text is split into byte ranges on line boundaries. The count and parse
+// passes each run over all ranges in parallel, and a prefix sum over the
+// counts tells every range where its output goes. Face corners are then
+// merged where position, UV and normal index all match.
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define MESH_IMPORT_SSE2 1
+#endif
+
+#define OBJ_RANGE_SIZE (1 << 20)
+#define MESH_SCRATCH_ALIGN 16
+#define OBJ_NO_INDEX 0xFFFFFFFF
+
+#define GLB_MAGIC 0x46546C67
+#define GLB_CHUNK_JSON 0x4E4F534A
+#define GLB_CHUNK_BIN 0x004E4942
+
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+#define GLTF_TRIANGLES 4
+
+// Memory mapping...
+//
+struct mapped_file
+{
+    u8 *Data;
+    u64 Size;
+
+#if defined(_WIN32)
+    HANDLE File;
+    HANDLE Mapping;
+#endif
+};
+
+// RandomAccess is for big files that only get read in pieces (heightfield
+// tiles), everything else is read front to back and prefetched in full.
+bool MapFile(mapped_file *File, const char *Path, bool RandomAccess = false)
+{
+    *File = {};
+
+#if defined(_WIN32)
+    DWORD Flags = RandomAccess ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN;
+    File->File = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, Flags, NULL);
+    if (File->File == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER Size;
+    GetFileSizeEx(File->File, &Size);
+    File->Size = Size.QuadPart;
+
+    if (File->Size)
+    {
+        File->Mapping = CreateFileMappingA(File->File, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (File->Mapping)
+        {
+            File->Data = (u8 *) MapViewOfFile(File->Mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+
+    if (!File->Data)
+    {
+        if (File->Mapping)
+        {
+            CloseHandle(File->Mapping);
+        }
+        CloseHandle(File->File);
+        *File = {};
+        return false;
+    }
+#else
+    i32 Descriptor = open(Path, O_RDONLY);
+    if (Descriptor < 0)
+    {
+        return false;
+    }
+
+    struct stat Info;
+    if (fstat(Descriptor, &Info) == 0 && Info.st_size > 0)
+    {
+        void *Data = mmap(NULL, Info.st_size, PROT_READ, MAP_PRIVATE, Descriptor, 0);
+        if (Data != MAP_FAILED)
+        {
+            // The OBJ ranges are read in parallel, so sequential read-ahead
+            // alone doesn't help much. Just ask for all of it.
+            madvise(Data, Info.st_size, RandomAccess ? MADV_RANDOM : MADV_WILLNEED);
+            File->Data = (u8 *) Data;
+            File->Size = Info.st_size;
+        }
+    }
+
+    // The mapping keeps its own reference to the file.
+    close(Descriptor);
+
+    if (!File->Data)
+    {
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+void UnmapFile(mapped_file *File)
+{
+    if (File->Data)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(File->Data);
+        CloseHandle(File->Mapping);
+        CloseHandle(File->File);
+#else
+        munmap(File->Data, File->Size);
+#endif
+    }
+
+    *File = {};
+}
+
+// Number parsing...
+//
+// Parsers take the end of the whole mapping, not of the line. Lines end in
+// '\n', which stops every digit and whitespace run on its own, and SIMD loads
+// only need the bytes to be readable.
+
+f64 Pow10Table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+u64 Pow10Integers[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+};
+
+inline bool IsDigit(u8 Char)
+{
+    return (u8) (Char - '0') <= 9;
+}
+
+inline bool IsSpace(u8 Char)
+{
+    return Char == ' ' || Char == '\t';
+}
+
+inline const u8 *SkipSpaces(const u8 *At, const u8 *End)
+{
+    while (At < End && IsSpace(*At))
+    {
+        At++;
+    }
+    return At;
+}
+
+#if MESH_IMPORT_SSE2
+// Value of the first Count (<= 8) digits in the low 8 lanes of Digits, which
+// already had '0' subtracted.
+inline u32 ConvertDigits8(__m128i Digits, u32 Count)
+{
+    // Shift the digits up so the last one lands in lane 7, which zero fills the
+    // lanes in front and drops everything after the run.
+    Digits = _mm_sll_epi64(Digits, _mm_cvtsi32_si128((8 - Count) * 8));
+
+    __m128i Wide = _mm_unpacklo_epi8(Digits, _mm_setzero_si128());
+    __m128i Pairs = _mm_madd_epi16(Wide, _mm_setr_epi16(10, 1, 10, 1, 10, 1, 10, 1));
+    __m128i Packed = _mm_packs_epi32(Pairs, Pairs);
+    __m128i Quads = _mm_madd_epi16(Packed, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+
+    u32 High = _mm_cvtsi128_si32(Quads);
+    u32 Low = _mm_cvtsi128_si32(_mm_srli_si128(Quads, 4));
+    return High * 10000 + Low;
+}
+#endif
+
+// Reads a run of decimal digits. Digits that don't fit into Value anymore are
+// skipped and counted in Dropped. Returns the number of digits read.
+u32 ParseDigits(const u8 **At, const u8 *End, u64 *Value, u32 *Dropped)
+{
+    const u8 *Start = *At;
+    const u8 *P = Start;
+    u64 Result = 0;
+    u32 DroppedCount = 0;
+
+#if MESH_IMPORT_SSE2
+    if (End - P >= 16)
+    {
+        __m128i Digits = _mm_sub_epi8(_mm_loadu_si128((__m128i *) P), _mm_set1_epi8('0'));
+        __m128i IsDigitMask = _mm_cmpeq_epi8(_mm_min_epu8(Digits, _mm_set1_epi8(9)), Digits);
+        u32 NotDigits = ~_mm_movemask_epi8(IsDigitMask);
+        u32 Count = SDL_MostSignificantBitIndex32(NotDigits & (0 - NotDigits));
+
+        if (Count <= 8)
+        {
+            Result = ConvertDigits8(Digits, Count);
+        }
+        else
+        {
+            Result = (u64) ConvertDigits8(Digits, 8) * Pow10Integers[Count - 8] +
+                     ConvertDigits8(_mm_srli_si128(Digits, 8), Count - 8);
+        }
+        P += Count;
+
+        if (Count < 16)
+        {
+            *At = P;
+            *Value = Result;
+            *Dropped = 0;
+            return Count;
+        }
+    }
+#endif
+
+    // Scalar tail, also picks up runs longer than 16 digits.
+    while (P < End && IsDigit(*P))
+    {
+        if (Result < 1000000000000000000ull)
+        {
+            Result = Result * 10 + (*P - '0');
+        }
+        else
+        {
+            DroppedCount++;
+        }
+        P++;
+    }
+
+    *At = P;
+    *Value = Result;
+    *Dropped = DroppedCount;
+    return (u32) (P - Start);
+}
+
+// Decimal and scientific notation. Mantissa digits beyond what a u64 holds are
+// dropped, which is far below f32 precision anyway. Going through f64 can be
+// one ulp off from strtof for 17 digit inputs that sit right on an f32
+// rounding midpoint, exporters don't write those.
+f32 ParseFloat(const u8 **At, const u8 *End)
+{
+    const u8 *P = SkipSpaces(*At, End);
+
+    bool Negative = false;
+    if (P < End && (*P == '-' || *P == '+'))
+    {
+        Negative = *P == '-';
+        P++;
+    }
+
+    u64 Integer;
+    u32 Dropped;
+    ParseDigits(&P, End, &Integer, &Dropped);
+    f64 Result = (f64) Integer;
+    if (Dropped)
+    {
+        Result *= pow(10.0, Dropped);
+    }
+
+    if (P < End && *P == '.')
+    {
+        P++;
+
+        u64 Fraction;
+        u32 Digits = ParseDigits(&P, End, &Fraction, &Dropped);
+        u32 Kept = Digits - Dropped;
+        if (Kept)
+        {
+            Result += (f64) Fraction / Pow10Table[Kept];
+        }
+    }
+
+    if (P < End && (*P == 'e' || *P == 'E'))
+    {
+        P++;
+
+        bool NegativeExponent = false;
+        if (P < End && (*P == '-' || *P == '+'))
+        {
+            NegativeExponent = *P == '-';
+            P++;
+        }
+
+        u64 Exponent;
+        ParseDigits(&P, End, &Exponent, &Dropped);
+        f64 Scale = Exponent < SDL_arraysize(Pow10Table) ? Pow10Table[Exponent] : pow(10.0, (f64) SDL_min(Exponent, 400ull));
+        Result = NegativeExponent ? Result / Scale : Result * Scale;
+    }
+
+    *At = P;
+    return (f32) (Negative ? -Result : Result);
+}
+
+// OBJ indices are 1-based, negative ones count back from the last element
+// read so far. 0 or nothing at all gives OBJ_NO_INDEX.
+u32 ParseObjIndex(const u8 **At, const u8 *End, u32 CountSoFar)
+{
+    const u8 *P = *At;
+
+    bool Negative = P < End && *P == '-';
+    if (Negative)
+    {
+        P++;
+    }
+
+    u64 Value;
+    u32 Dropped;
+    u32 Digits = ParseDigits(&P, End, &Value, &Dropped);
+    *At = P;
+
+    if (Digits == 0 || Value == 0 || Dropped || Value > 0xFFFFFFFF)
+    {
+        return OBJ_NO_INDEX;
+    }
+
+    if (Negative)
+    {
+        return Value <= CountSoFar ? CountSoFar - (u32) Value : OBJ_NO_INDEX;
+    }
+
+    return (u32) Value - 1;
+}
+
+// OBJ...
+//
+enum obj_line
+{
+    ObjLine_Other,
+    ObjLine_Position,
+    ObjLine_UV,
+    ObjLine_Normal,
+    ObjLine_Face,
+};
+
+struct obj_range
+{
+    const u8 *Start;
+    const u8 *End;
+
+    // Counts from the first pass, the offsets are a prefix sum over them.
+    u32 PositionCount;
+    u32 UVCount;
+    u32 NormalCount;
+    u32 CornerCount;
+
+    u32 PositionOffset;
+    u32 UVOffset;
+    u32 NormalOffset;
+    u32 CornerOffset;
+};
+
+struct obj_corner
+{
+    u32 Position;
+    u32 UV;
+    u32 Normal;
+};
+
+// Classifies the line at At and moves At past the keyword.
+obj_line ObjLineType(const u8 **At, const u8 *LineEnd)
+{
+    const u8 *P = SkipSpaces(*At, LineEnd);
+    obj_line Type = ObjLine_Other;
+
+    if (LineEnd - P >= 2)
+    {
+        if (P[0] == 'v' && IsSpace(P[1]))
+        {
+            Type = ObjLine_Position;
+            P += 1;
+        }
+        else if (P[0] == 'f' && IsSpace(P[1]))
+        {
+            Type = ObjLine_Face;
+            P += 1;
+        }
+        else if (LineEnd - P >= 3 && P[0] == 'v' && IsSpace(P[2]))
+        {
+            if (P[1] == 't')
+            {
+                Type = ObjLine_UV;
+            }
+            else if (P[1] == 'n')
+            {
+                Type = ObjLine_Normal;
+            }
+            P += 2;
+        }
+    }
+
+    *At = P;
+    return Type;
+}
+
+inline bool IsObjTokenEnd(u8 Char)
+{
+    return IsSpace(Char) || Char == '\r' || Char == '\n' || Char == '#';
+}
+
+// Every whitespace separated token on a face line is one corner, valid or
+// not, so both passes agree on the count.
+u32 CountFaceCorners(const u8 *At, const u8 *LineEnd)
+{
+    u32 Count = 0;
+    while (true)
+    {
+        At = SkipSpaces(At, LineEnd);
+        if (At >= LineEnd || *At == '\r' || *At == '#')
+        {
+            break;
+        }
+
+        Count++;
+        while (At < LineEnd && !IsObjTokenEnd(*At))
+        {
+            At++;
+        }
+    }
+    return Count;
+}
+
+const u8 *FindLineEnd(const u8 *At, const u8 *End)
+{
+    const u8 *LineEnd = (const u8 *) memchr(At, '\n', End - At);
+    return LineEnd ? LineEnd : End;
+}
+
+struct mesh_bounds
+{
+    v3 Min;
+    v3 Max;
+};
+
+inline mesh_bounds EmptyBounds()
+{
+    mesh_bounds Result;
+    Result.Min = V3(INFINITY, INFINITY, INFINITY);
+    Result.Max = V3(-INFINITY, -INFINITY, -INFINITY);
+    return Result;
+}
+
+inline void GrowBounds(mesh_bounds *Bounds, v3 P)
+{
+    Bounds->Min = V3(SDL_min(Bounds->Min.X, P.X), SDL_min(Bounds->Min.Y, P.Y), SDL_min(Bounds->Min.Z, P.Z));
+    Bounds->Max = V3(SDL_max(Bounds->Max.X, P.X), SDL_max(Bounds->Max.Y, P.Y), SDL_max(Bounds->Max.Z, P.Z));
+}
+
+// Jobs keep one box per MESH_CHUNK_SIZE chunk, so they never share one. This
+// folds the first Count items' chunks into Bounds. Without workers ParallelFor
+// runs everything as one job, so some chunks can still be empty.
+void MergeChunkBounds(mesh_bounds *Bounds, mesh_bounds *ChunkBounds, u32 Count)
+{
+    for (u32 Chunk = 0; Chunk < (Count + MESH_CHUNK_SIZE - 1) / MESH_CHUNK_SIZE; ++Chunk)
+    {
+        if (ChunkBounds[Chunk].Min.X <= ChunkBounds[Chunk].Max.X)
+        {
+            GrowBounds(Bounds, ChunkBounds[Chunk].Min);
+            GrowBounds(Bounds, ChunkBounds[Chunk].Max);
+        }
+        ChunkBounds[Chunk] = EmptyBounds();
+    }
+}
+
+struct gltf_accessor
+{
+    const u8 *Data;
+    u32 Count;
+    u32 Stride;
+    u32 ComponentType;
+};
+
+struct glb_primitive
+{
+    gltf_accessor Positions;
+    gltf_accessor Normals;
+    gltf_accessor UVs;
+    gltf_accessor Indices;
+
+    u32 VertexOffset;
+    u32 IndexOffset;
+};
+
+enum mesh_file_format
+{
+    MeshFile_OBJ,
+    MeshFile_GLB,
+};
+
+struct mesh_file
+{
+    mapped_file File;
+    mesh_file_format Format;
+
+    // What the caller has to make room for. For OBJ VertexCount is an upper
+    // bound until DecodeMeshFile merged the corners.
+    u32 VertexCount;
+    u32 IndexCount;
+    u64 ScratchSize;
+
+    // Around every vertex written, set by DecodeMeshFile.
+    mesh_bounds Bounds;
+
+    u32 RangeCount;
+    obj_range *Ranges;
+    u32 PositionCount;
+    u32 UVCount;
+    u32 NormalCount;
+
+    u32 PrimitiveCount;
+    glb_primitive *Primitives;
+};
+
+struct obj_job_data
+{
+    mesh_file *File;
+
+    v3 *Positions;
+    v2 *UVs;
+    v3 *Normals;
+    obj_corner *Corners;
+
+    // Corner merging, same bucket sort as WeldVertices.
+    u32 TableMask;
+    u32 *CornerBuckets;
+    SDL_AtomicInt *BucketCursors;
+    u32 *BucketStarts;
+    u32 *SortedCorners;
+    obj_corner *SortedKeys;
+    u32 *Remap;
+    u32 UniqueCount;
+    mesh_bounds *ChunkBounds;
+
+    vertex *Vertices;
+    u32 *Indices;
+    SDL_AtomicInt Errors;
+};
+
+struct glb_job_data
+{
+    glb_primitive *Primitive;
+    vertex *Vertices;
+    u32 *Indices;
+    u32 VertexCount;
+    SDL_AtomicInt Errors;
+
+    // Smooth normals for primitives that come without, NULL otherwise.
+    v3 *Normals;
+    mesh_bounds *ChunkBounds;
+};
+
+void ObjCountJob(void *Data, u32 Start, u32 End)
+{
+    obj_range *Ranges = (obj_range *) Data;
+
+    for (u32 RangeIndex = Start; RangeIndex < End; ++RangeIndex)
+    {
+        obj_range *Range = Ranges + RangeIndex;
+
+        const u8 *At = Range->Start;
+        while (At < Range->End)
+        {
+            const u8 *LineEnd = FindLineEnd(At, Range->End);
+
+            switch (ObjLineType(&At, LineEnd))
+            {
+                case ObjLine_Position: Range->PositionCount++; break;
+                case ObjLine_UV: Range->UVCount++; break;
+                case ObjLine_Normal: Range->NormalCount++; break;
+                case ObjLine_Face: {
+                    // Triangle fan.
+                    u32 Corners = CountFaceCorners(At, LineEnd);
+                    if (Corners >= 3)
+                    {
+                        Range->CornerCount += (Corners - 2) * 3;
+                    }
+                    break;
+                }
+                default: break;
+            }
+
+            At = LineEnd + 1;
+        }
+    }
+}
+
+obj_corner ParseObjCorner(const u8 **At, const u8 *End, u32 PositionCount, u32 UVCount, u32 NormalCount)
+{
+    obj_corner Corner = { OBJ_NO_INDEX, OBJ_NO_INDEX, OBJ_NO_INDEX };
+
+    const u8 *P = *At;
+    Corner.Position = ParseObjIndex(&P, End, PositionCount);
+    if (P < End && *P == '/')
+    {
+        P++;
+        Corner.UV = ParseObjIndex(&P, End, UVCount);
+        if (P < End && *P == '/')
+        {
+            P++;
+            Corner.Normal = ParseObjIndex(&P, End, NormalCount);
+        }
+    }
+
+    // Skip whatever is left of a malformed token.
+    while (P < End && !IsObjTokenEnd(*P))
+    {
+        P++;
+    }
+
+    *At = P;
+    return Corner;
+}
+
+void ObjParseJob(void *Data, u32 Start, u32 End)
+{
+    obj_job_data *Job = (obj_job_data *) Data;
+    const u8 *FileEnd = Job->File->File.Data + Job->File->File.Size;
+
+    for (u32 RangeIndex = Start; RangeIndex < End; ++RangeIndex)
+    {
+        obj_range *Range = Job->File->Ranges + RangeIndex;
+
+        // Global indices, so relative face indices resolve across ranges.
+        u32 PositionIndex = Range->PositionOffset;
+        u32 UVIndex = Range->UVOffset;
+        u32 NormalIndex = Range->NormalOffset;
+        obj_corner *Corners = Job->Corners + Range->CornerOffset;
+
+        const u8 *At = Range->Start;
+        while (At < Range->End)
+        {
+            const u8 *LineEnd = FindLineEnd(At, Range->End);
+
+            switch (ObjLineType(&At, LineEnd))
+            {
+                case ObjLine_Position: {
+                    f32 X = ParseFloat(&At, FileEnd);
+                    f32 Y = ParseFloat(&At, FileEnd);
+                    f32 Z = ParseFloat(&At, FileEnd);
+                    Job->Positions[PositionIndex++] = V3(X, Y, Z);
+                    break;
+                }
+                case ObjLine_UV: {
+                    f32 U = ParseFloat(&At, FileEnd);
+                    f32 V = ParseFloat(&At, FileEnd);
+                    // OBJ has V going up, textures here start at the top like in glTF.
+                    Job->UVs[UVIndex++] = V2(U, 1 - V);
+                    break;
+                }
+                case ObjLine_Normal: {
+                    f32 X = ParseFloat(&At, FileEnd);
+                    f32 Y = ParseFloat(&At, FileEnd);
+                    f32 Z = ParseFloat(&At, FileEnd);
+                    Job->Normals[NormalIndex++] = V3(X, Y, Z);
+                    break;
+                }
+                case ObjLine_Face: {
+                    // Faces with less than 3 corners don't emit anything,
+                    // same as in the count pass.
+                    obj_corner First = {};
+                    obj_corner Previous = {};
+                    for (u32 Corner = 0;; ++Corner)
+                    {
+                        At = SkipSpaces(At, LineEnd);
+                        if (At >= LineEnd || *At == '\r' || *At == '#')
+                        {
+                            break;
+                        }
+
+                        obj_corner Current = ParseObjCorner(&At, FileEnd, PositionIndex, UVIndex, NormalIndex);
+                        if (Corner == 0)
+                        {
+                            First = Current;
+                        }
+                        else if (Corner >= 2)
+                        {
+                            *Corners++ = First;
+                            *Corners++ = Previous;
+                            *Corners++ = Current;
+                        }
+                        Previous = Current;
+                    }
+                    break;
+                }
+                default: break;
+            }
+
+            At = LineEnd + 1;
+        }
+    }
+}
+
+void ObjBucketJob(void *Data, u32 Start, u32 End)
+{
+    obj_job_data *Job = (obj_job_data *) Data;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        obj_corner Corner = Job->Corners[I];
+        u32 Bucket = WeldBucket(Corner.Position, Corner.UV, Corner.Normal, Job->TableMask);
+        Job->CornerBuckets[I] = Bucket;
+        SDL_AddAtomicInt(Job->BucketCursors + Bucket, 1);
+    }
+}
+
+void ObjScatterJob(void *Data, u32 Start, u32 End)
+{
+    obj_job_data *Job = (obj_job_data *) Data;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        u32 Slot = SDL_AddAtomicInt(Job->BucketCursors + Job->CornerBuckets[I], 1);
+        Job->SortedCorners[Slot] = I;
+        Job->SortedKeys[Slot] = Job->Corners[I];
+    }
+}
+
+// Maps every corner to the first one with the same indices. Goes bucket by
+// bucket, so everything but the Remap writes is read in order.
+void ObjMatchJob(void *Data, u32 Start, u32 End)
+{
+    obj_job_data *Job = (obj_job_data *) Data;
+
+    for (u32 Bucket = Start; Bucket < End; ++Bucket)
+    {
+        u32 First = Job->BucketStarts[Bucket];
+        u32 Last = Job->BucketStarts[Bucket + 1];
+
+        for (u32 Slot = First; Slot < Last; ++Slot)
+        {
+            obj_corner Corner = Job->SortedKeys[Slot];
+            u32 Best = Job->SortedCorners[Slot];
+
+            for (u32 Other = First; Other < Last; ++Other)
+            {
+                obj_corner OtherCorner = Job->SortedKeys[Other];
+                if (Job->SortedCorners[Other] < Best && OtherCorner.Position == Corner.Position &&
+                    OtherCorner.UV == Corner.UV && OtherCorner.Normal == Corner.Normal)
+                {
+                    Best = Job->SortedCorners[Other];
+                }
+            }
+
+            Job->Remap[Job->SortedCorners[Slot]] = Best;
+        }
+    }
+}
+
+void ObjVertexJob(void *Data, u32 Start, u32 End)
+{
+    obj_job_data *Job = (obj_job_data *) Data;
+    mesh_file *File = Job->File;
+
+    // SortedCorners holds the first corner of every unique vertex by now.
+    mesh_bounds Bounds = EmptyBounds();
+    for (u32 I = Start; I < End; ++I)
+    {
+        obj_corner Corner = Job->Corners[Job->SortedCorners[I]];
+
+        vertex Vertex = {};
+        if (Corner.Position < File->PositionCount)
+        {
+            Vertex.Position = Job->Positions[Corner.Position];
+            GrowBounds(&Bounds, Vertex.Position);
+        }
+        else
+        {
+            SDL_AddAtomicInt(&Job->Errors, 1);
+        }
+
+        if (Corner.UV < File->UVCount)
+        {
+            Vertex.UV = Job->UVs[Corner.UV];
+        }
+
+        if (File->NormalCount == 0 && Corner.Position < File->PositionCount)
+        {
+            // Smooth normals accumulated per position, see DecodeObj.
+            Vertex.Normal = Norm(Job->Normals[Corner.Position]);
+        }
+        else if (Corner.Normal < File->NormalCount)
+        {
+            Vertex.Normal = Job->Normals[Corner.Normal];
+        }
+
+        Job->Vertices[I] = Vertex;
+    }
+
+    Job->ChunkBounds[Start / MESH_CHUNK_SIZE] = Bounds;
+}
+
+void ObjIndexJob(void *Data, u32 Start, u32 End)
+{
+    obj_job_data *Job = (obj_job_data *) Data;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        Job->Indices[I] = Job->Remap[I];
+    }
+}
+
+// glTF...
+//
+// Just enough JSON to walk the glTF scene description in place. A json value
+// is the span of its text, objects and arrays are searched on every lookup.
+struct json
+{
+    const u8 *At;
+    const u8 *End;
+};
+
+const u8 *JsonSkipWhitespace(const u8 *At, const u8 *End)
+{
+    while (At < End && (*At == ' ' || *At == '\t' || *At == '\r' || *At == '\n'))
+    {
+        At++;
+    }
+    return At;
+}
+
+// Returns the end of the value starting at At, NULL if it runs off the end.
+const u8 *JsonValueEnd(const u8 *At, const u8 *End)
+{
+    if (At >= End)
+    {
+        return NULL;
+    }
+
+    if (*At == '"')
+    {
+        for (At++; At < End; At++)
+        {
+            if (*At == '\\')
+            {
+                At++;
+            }
+            else if (*At == '"')
+            {
+                return At + 1;
+            }
+        }
+        return NULL;
+    }
+
+    if (*At == '{' || *At == '[')
+    {
+        u32 Depth = 0;
+        while (At < End)
+        {
+            if (*At == '"')
+            {
+                At = JsonValueEnd(At, End);
+                if (!At)
+                {
+                    return NULL;
+                }
+                continue;
+            }
+
+            if (*At == '{' || *At == '[')
+            {
+                Depth++;
+            }
+            else if (*At == '}' || *At == ']')
+            {
+                if (--Depth == 0)
+                {
+                    return At + 1;
+                }
+            }
+            At++;
+        }
+        return NULL;
+    }
+
+    // Number, true, false or null.
+    while (At < End && *At != ',' && *At != '}' && *At != ']' &&
+           *At != ' ' && *At != '\t' && *At != '\r' && *At != '\n')
+    {
+        At++;
+    }
+    return At;
+}
+
+// Finds element Index of an array, or member Index of an object with Key set
+// to its name. False once Index is past the end.
+bool JsonIterate(json Container, json *Key, json *Value, u32 Index)
+{
+    const u8 *End = Container.End;
+    const u8 *At = Container.At;
+    if (At >= End || (*At != '{' && *At != '['))
+    {
+        return false;
+    }
+
+    bool IsObject = *At == '{';
+    At++;
+
+    for (u32 Current = 0;; ++Current)
+    {
+        At = JsonSkipWhitespace(At, End);
+        if (At >= End || *At == '}' || *At == ']')
+        {
+            return false;
+        }
+
+        if (IsObject)
+        {
+            const u8 *KeyEnd = JsonValueEnd(At, End);
+            if (!KeyEnd)
+            {
+                return false;
+            }
+            *Key = { At, KeyEnd };
+
+            At = JsonSkipWhitespace(KeyEnd, End);
+            if (At >= End || *At != ':')
+            {
+                return false;
+            }
+            At = JsonSkipWhitespace(At + 1, End);
+        }
+
+        const u8 *ValueEnd = JsonValueEnd(At, End);
+        if (!ValueEnd)
+        {
+            return false;
+        }
+        *Value = { At, ValueEnd };
+
+        if (Current == Index)
+        {
+            return true;
+        }
+
+        At = JsonSkipWhitespace(ValueEnd, End);
+        if (At < End && *At == ',')
+        {
+            At++;
+        }
+    }
+}
+
+bool JsonElement(json Array, u32 Index, json *Value)
+{
+    json Key;
+    return JsonIterate(Array, &Key, Value, Index);
+}
+
+bool JsonStringEquals(json String, const char *Text)
+{
+    u64 Length = SDL_strlen(Text);
+    return (u64) (String.End - String.At) == Length + 2 && String.At[0] == '"' &&
+           SDL_memcmp(String.At + 1, Text, Length) == 0;
+}
+
+bool JsonMember(json Object, const char *Name, json *Value)
+{
+    json Key;
+    for (u32 Index = 0; JsonIterate(Object, &Key, Value, Index); ++Index)
+    {
+        if (JsonStringEquals(Key, Name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+u32 JsonCount(json Array)
+{
+    json Key;
+    json Value;
+    u32 Count = 0;
+    while (JsonIterate(Array, &Key, &Value, Count))
+    {
+        Count++;
+    }
+    return Count;
+}
+
+u32 JsonU32(json Object, const char *Name, u32 Default)
+{
+    json Value;
+    if (!JsonMember(Object, Name, &Value) || !IsDigit(*Value.At))
+    {
+        return Default;
+    }
+
+    const u8 *At = Value.At;
+    u64 Result;
+    u32 Dropped;
+    ParseDigits(&At, Value.End, &Result, &Dropped);
+    return Dropped || Result > 0xFFFFFFFF ? Default : (u32) Result;
+}
+
+u32 GltfComponentSize(u32 ComponentType)
+{
+    switch (ComponentType)
+    {
+        case GLTF_UNSIGNED_BYTE: return 1;
+        case GLTF_UNSIGNED_SHORT: return 2;
+        case GLTF_UNSIGNED_INT: return 4;
+        case GLTF_FLOAT: return 4;
+    }
+    return 0;
+}
+
+// Resolves accessor Index down to bytes in the BIN chunk. Sparse accessors
+// and external buffers aren't supported.
+bool GetGltfAccessor(json Root, const u8 *Bin, u64 BinSize, u32 Index, const char *Type, gltf_accessor *Accessor)
+{
+    json Accessors;
+    json Views;
+    json AccessorJson;
+    json ViewJson;
+    json TypeJson;
+    if (!JsonMember(Root, "accessors", &Accessors) || !JsonElement(Accessors, Index, &AccessorJson) ||
+        !JsonMember(AccessorJson, "type", &TypeJson) || !JsonStringEquals(TypeJson, Type) ||
+        JsonMember(AccessorJson, "sparse", &ViewJson))
+    {
+        return false;
+    }
+
+    u32 ViewIndex = JsonU32(AccessorJson, "bufferView", 0xFFFFFFFF);
+    if (!JsonMember(Root, "bufferViews", &Views) || !JsonElement(Views, ViewIndex, &ViewJson) ||
+        JsonU32(ViewJson, "buffer", 0) != 0)
+    {
+        return false;
+    }
+
+    u32 ComponentCount = Type[0] == 'V' ? Type[3] - '0' : 1;
+    Accessor->ComponentType = JsonU32(AccessorJson, "componentType", 0);
+    Accessor->Count = JsonU32(AccessorJson, "count", 0);
+
+    u32 ElementSize = GltfComponentSize(Accessor->ComponentType) * ComponentCount;
+    Accessor->Stride = JsonU32(ViewJson, "byteStride", ElementSize);
+
+    u64 Offset = (u64) JsonU32(ViewJson, "byteOffset", 0) + JsonU32(AccessorJson, "byteOffset", 0);
+    u64 ViewEnd = (u64) JsonU32(ViewJson, "byteOffset", 0) + JsonU32(ViewJson, "byteLength", 0);
+    u64 AccessorEnd = Offset + (Accessor->Count ? (u64) (Accessor->Count - 1) * Accessor->Stride + ElementSize : 0);
+    if (ElementSize == 0 || AccessorEnd > ViewEnd || ViewEnd > BinSize)
+    {
+        return false;
+    }
+
+    Accessor->Data = Bin + Offset;
+    return true;
+}
+
+// Bump allocation out of the scratch memory the caller passed to
+// DecodeMeshFile. With a NULL Base it only adds up the size.
+inline void *PushScratch(u8 *Base, u64 *Used, u64 Size)
+{
+    void *Result = Base ? Base + *Used : NULL;
+    *Used += (Size + MESH_SCRATCH_ALIGN - 1) & ~(u64) (MESH_SCRATCH_ALIGN - 1);
+    return Result;
+}
+
+// Lays the decode arrays out in Scratch and returns how many bytes they take.
+// OpenObj calls it with NULL to size the scratch memory.
+u64 LayoutObjScratch(mesh_file *File, obj_job_data *Job, u8 *Scratch)
+{
+    u32 CornerCount = File->IndexCount;
+
+    u32 TableSize = 1;
+    while (TableSize < CornerCount)
+    {
+        TableSize *= 2;
+    }
+
+    // With no normals in the file, Normals holds smooth normals per position.
+    u32 NormalCount = File->NormalCount ? File->NormalCount : File->PositionCount;
+
+    u64 Used = 0;
+    Job->Positions = (v3 *) PushScratch(Scratch, &Used, sizeof(v3) * File->PositionCount);
+    Job->UVs = (v2 *) PushScratch(Scratch, &Used, sizeof(v2) * File->UVCount);
+    Job->Normals = (v3 *) PushScratch(Scratch, &Used, sizeof(v3) * NormalCount);
+    Job->Corners = (obj_corner *) PushScratch(Scratch, &Used, sizeof(obj_corner) * CornerCount);
+    Job->TableMask = TableSize - 1;
+    Job->CornerBuckets = (u32 *) PushScratch(Scratch, &Used, sizeof(u32) * CornerCount);
+    Job->BucketCursors = (SDL_AtomicInt *) PushScratch(Scratch, &Used, sizeof(SDL_AtomicInt) * TableSize);
+    Job->BucketStarts = (u32 *) PushScratch(Scratch, &Used, sizeof(u32) * (TableSize + 1));
+    Job->SortedCorners = (u32 *) PushScratch(Scratch, &Used, sizeof(u32) * CornerCount);
+    Job->SortedKeys = (obj_corner *) PushScratch(Scratch, &Used, sizeof(obj_corner) * CornerCount);
+    Job->Remap = (u32 *) PushScratch(Scratch, &Used, sizeof(u32) * CornerCount);
+    u32 ChunkCount = CornerCount / MESH_CHUNK_SIZE + 1;
+    Job->ChunkBounds = (mesh_bounds *) PushScratch(Scratch, &Used, sizeof(mesh_bounds) * ChunkCount);
+
+    if (Scratch)
+    {
+        for (u32 Chunk = 0; Chunk < ChunkCount; ++Chunk)
+        {
+            Job->ChunkBounds[Chunk] = EmptyBounds();
+        }
+        if (File->NormalCount == 0)
+        {
+            SDL_memset(Job->Normals, 0, sizeof(v3) * NormalCount);
+        }
+        SDL_memset(Job->BucketCursors, 0, sizeof(SDL_AtomicInt) * TableSize);
+    }
+
+    return Used;
+}
+
+// Lays the decode arrays for a primitive with VertexCount vertices out in
+// Scratch and returns how many bytes they take. OpenGlb sizes the scratch
+// with the largest primitive.
+u64 LayoutGlbScratch(u32 VertexCount, bool NeedsNormals, glb_job_data *Job, u8 *Scratch)
+{
+    u64 Used = 0;
+    u32 ChunkCount = VertexCount / MESH_CHUNK_SIZE + 1;
+    Job->ChunkBounds = (mesh_bounds *) PushScratch(Scratch, &Used, sizeof(mesh_bounds) * ChunkCount);
+    Job->Normals = NULL;
+    if (NeedsNormals)
+    {
+        Job->Normals = (v3 *) PushScratch(Scratch, &Used, sizeof(v3) * VertexCount);
+    }
+
+    if (Scratch)
+    {
+        for (u32 Chunk = 0; Chunk < ChunkCount; ++Chunk)
+        {
+            Job->ChunkBounds[Chunk] = EmptyBounds();
+        }
+    }
+
+    return Used;
+}
+
+bool OpenObj(mesh_file *File)
+{
+    const u8 *Data = File->File.Data;
+    const u8 *End = Data + File->File.Size;
+
+    File->Ranges = (obj_range *) SDL_calloc(File->File.Size / OBJ_RANGE_SIZE + 1, sizeof(obj_range));
+    for (const u8 *At = Data; At < End;)
+    {
+        const u8 *RangeEnd = End;
+        if (End - At > OBJ_RANGE_SIZE)
+        {
+            RangeEnd = FindLineEnd(At + OBJ_RANGE_SIZE, End);
+            RangeEnd = SDL_min(RangeEnd + 1, End);
+        }
+
+        obj_range *Range = File->Ranges + File->RangeCount++;
+        Range->Start = At;
+        Range->End = RangeEnd;
+        At = RangeEnd;
+    }
+
+    ParallelFor(File->RangeCount, 1, ObjCountJob, File->Ranges);
+
+    u32 CornerCount = 0;
+    for (u32 I = 0; I < File->RangeCount; ++I)
+    {
+        obj_range *Range = File->Ranges + I;
+        Range->PositionOffset = File->PositionCount;
+        Range->UVOffset = File->UVCount;
+        Range->NormalOffset = File->NormalCount;
+        Range->CornerOffset = CornerCount;
+
+        File->PositionCount += Range->PositionCount;
+        File->UVCount += Range->UVCount;
+        File->NormalCount += Range->NormalCount;
+        CornerCount += Range->CornerCount;
+    }
+
+    File->VertexCount = CornerCount;
+    File->IndexCount = CornerCount;
+
+    obj_job_data Layout = {};
+    File->ScratchSize = LayoutObjScratch(File, &Layout, NULL);
+
+    return CornerCount > 0;
+}
+
+bool OpenGlb(mesh_file *File)
+{
+    const u8 *Data = File->File.Data;
+    u64 Size = File->File.Size;
+
+    u32 Header[5];
+    if (Size < sizeof(Header))
+    {
+        return false;
+    }
+    SDL_memcpy(Header, Data, sizeof(Header));
+
+    u32 JsonSize = Header[3];
+    if (Header[1] != 2 || Header[4] != GLB_CHUNK_JSON || 20 + (u64) JsonSize > Size)
+    {
+        return false;
+    }
+    json Root = { Data + 20, Data + 20 + JsonSize };
+    Root.At = JsonSkipWhitespace(Root.At, Root.End);
+
+    const u8 *Bin = NULL;
+    u64 BinSize = 0;
+    u64 BinChunk = 20 + (((u64) JsonSize + 3) & ~3ull);
+    if (BinChunk + 8 <= Size)
+    {
+        u32 ChunkHeader[2];
+        SDL_memcpy(ChunkHeader, Data + BinChunk, sizeof(ChunkHeader));
+        if (ChunkHeader[1] == GLB_CHUNK_BIN)
+        {
+            Bin = Data + BinChunk + 8;
+            BinSize = SDL_min((u64) ChunkHeader[0], Size - BinChunk - 8);
+        }
+    }
+
+    json Meshes;
+    if (!JsonMember(Root, "meshes", &Meshes))
+    {
+        return false;
+    }
+
+    // Every primitive of every mesh, node transforms aren't applied.
+    json Mesh;
+    json Primitives;
+    json Primitive;
+    for (u32 MeshIndex = 0; JsonElement(Meshes, MeshIndex, &Mesh); ++MeshIndex)
+    {
+        if (JsonMember(Mesh, "primitives", &Primitives))
+        {
+            File->PrimitiveCount += JsonCount(Primitives);
+        }
+    }
+
+    File->Primitives = (glb_primitive *) SDL_calloc(SDL_max(File->PrimitiveCount, 1u), sizeof(glb_primitive));
+    u32 PrimitiveCount = 0;
+
+    for (u32 MeshIndex = 0; JsonElement(Meshes, MeshIndex, &Mesh); ++MeshIndex)
+    {
+        if (!JsonMember(Mesh, "primitives", &Primitives))
+        {
+            continue;
+        }
+
+        for (u32 PrimitiveIndex = 0; JsonElement(Primitives, PrimitiveIndex, &Primitive); ++PrimitiveIndex)
+        {
+            json Attributes;
+            if (JsonU32(Primitive, "mode", GLTF_TRIANGLES) != GLTF_TRIANGLES ||
+                !JsonMember(Primitive, "attributes", &Attributes))
+            {
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Skipping glTF primitive %u of mesh %u, only triangles are supported",
+                            PrimitiveIndex, MeshIndex);
+                continue;
+            }
+
+            glb_primitive *Result = File->Primitives + PrimitiveCount;
+            *Result = {};
+
+            u32 Position = JsonU32(Attributes, "POSITION", 0xFFFFFFFF);
+            if (!GetGltfAccessor(Root, Bin, BinSize, Position, "VEC3", &Result->Positions) ||
+                Result->Positions.ComponentType != GLTF_FLOAT)
+            {
+                return false;
+            }
+
+            u32 Normal = JsonU32(Attributes, "NORMAL", 0xFFFFFFFF);
+            if (Normal != 0xFFFFFFFF &&
+                (!GetGltfAccessor(Root, Bin, BinSize, Normal, "VEC3", &Result->Normals) ||
+                 Result->Normals.ComponentType != GLTF_FLOAT || Result->Normals.Count != Result->Positions.Count))
+            {
+                return false;
+            }
+
+            u32 UV = JsonU32(Attributes, "TEXCOORD_0", 0xFFFFFFFF);
+            if (UV != 0xFFFFFFFF &&
+                (!GetGltfAccessor(Root, Bin, BinSize, UV, "VEC2", &Result->UVs) ||
+                 Result->UVs.ComponentType != GLTF_FLOAT || Result->UVs.Count != Result->Positions.Count))
+            {
+                return false;
+            }
+
+            u32 Indices = JsonU32(Primitive, "indices", 0xFFFFFFFF);
+            if (Indices != 0xFFFFFFFF &&
+                (!GetGltfAccessor(Root, Bin, BinSize, Indices, "SCALAR", &Result->Indices) ||
+                 Result->Indices.ComponentType == GLTF_FLOAT))
+            {
+                return false;
+            }
+
+            glb_job_data Layout = {};
+            u64 ScratchSize = LayoutGlbScratch(Result->Positions.Count, Normal == 0xFFFFFFFF, &Layout, NULL);
+            File->ScratchSize = SDL_max(File->ScratchSize, ScratchSize);
+
+            Result->VertexOffset = File->VertexCount;
+            Result->IndexOffset = File->IndexCount;
+            File->VertexCount += Result->Positions.Count;
+            File->IndexCount += Indices != 0xFFFFFFFF ? Result->Indices.Count : Result->Positions.Count;
+            PrimitiveCount++;
+        }
+    }
+
+    File->PrimitiveCount = PrimitiveCount;
+    return File->IndexCount > 0;
+}
+
+// Maps the file and counts what's in it. Afterwards VertexCount and IndexCount
+// say how much room DecodeMeshFile needs.
+bool OpenMeshFile(mesh_file *File, const char *Path)
+{
+    *File = {};
+    if (!MapFile(&File->File, Path))
+    {
+        printf("Failed to open mesh %s\n", Path);
+        return false;
+    }
+
+    u32 Magic = 0;
+    if (File->File.Size >= 4)
+    {
+        SDL_memcpy(&Magic, File->File.Data, 4);
+    }
+    File->Format = Magic == GLB_MAGIC ? MeshFile_GLB : MeshFile_OBJ;
+
+    bool Result = File->Format == MeshFile_GLB ? OpenGlb(File) : OpenObj(File);
+    if (!Result)
+    {
+        printf("%s has no triangles we can read\n", Path);
+    }
+
+    return Result;
+}
+
+bool DecodeObj(mesh_file *File, vertex *Vertices, u32 *Indices, u8 *Scratch, mesh *Mesh)
+{
+    u32 CornerCount = File->IndexCount;
+
+    obj_job_data Job = {};
+    Job.File = File;
+    LayoutObjScratch(File, &Job, Scratch);
+    u32 TableSize = Job.TableMask + 1;
+    Job.Vertices = Vertices;
+    Job.Indices = Indices;
+
+    ParallelFor(File->RangeCount, 1, ObjParseJob, &Job);
+
+    if (File->NormalCount == 0)
+    {
+        // Area weighted, one pass over the triangles. Serial, but it's only
+        // a fallback for files exported without normals.
+        for (u32 I = 0; I < CornerCount; I += 3)
+        {
+            obj_corner *Corner = Job.Corners + I;
+            if (Corner[0].Position < File->PositionCount && Corner[1].Position < File->PositionCount &&
+                Corner[2].Position < File->PositionCount)
+            {
+                v3 A = Job.Positions[Corner[0].Position];
+                v3 Normal = Cross(Job.Positions[Corner[1].Position] - A, Job.Positions[Corner[2].Position] - A);
+                for (u32 J = 0; J < 3; ++J)
+                {
+                    v3 *Sum = Job.Normals + Corner[J].Position;
+                    *Sum = V3(Sum->X + Normal.X, Sum->Y + Normal.Y, Sum->Z + Normal.Z);
+                }
+            }
+        }
+    }
+
+    ParallelFor(CornerCount, MESH_CHUNK_SIZE, ObjBucketJob, &Job);
+
+    u32 Offset = 0;
+    for (u32 Bucket = 0; Bucket < TableSize; ++Bucket)
+    {
+        u32 Count = SDL_GetAtomicInt(Job.BucketCursors + Bucket);
+        Job.BucketStarts[Bucket] = Offset;
+        SDL_SetAtomicInt(Job.BucketCursors + Bucket, Offset);
+        Offset += Count;
+    }
+    Job.BucketStarts[TableSize] = Offset;
+
+    ParallelFor(CornerCount, MESH_CHUNK_SIZE, ObjScatterJob, &Job);
+    ParallelFor(TableSize, MESH_CHUNK_SIZE, ObjMatchJob, &Job);
+
+    // Same compaction as WeldVertices. SortedCorners isn't needed anymore and
+    // collects the first corner of every vertex instead.
+    for (u32 I = 0; I < CornerCount; ++I)
+    {
+        if (Job.Remap[I] == I)
+        {
+            Job.SortedCorners[Job.UniqueCount] = I;
+            Job.Remap[I] = Job.UniqueCount++;
+        }
+        else
+        {
+            Job.Remap[I] = Job.Remap[Job.Remap[I]];
+        }
+    }
+
+    ParallelFor(Job.UniqueCount, MESH_CHUNK_SIZE, ObjVertexJob, &Job);
+    ParallelFor(CornerCount, MESH_CHUNK_SIZE, ObjIndexJob, &Job);
+    MergeChunkBounds(&File->Bounds, Job.ChunkBounds, Job.UniqueCount);
+
+    Mesh->Vertices = Vertices;
+    Mesh->VertexCount = Job.UniqueCount;
+    Mesh->Indices = Indices;
+    Mesh->IndexCount = CornerCount;
+
+    u32 Errors = SDL_GetAtomicInt(&Job.Errors);
+    if (Errors)
+    {
+        printf("OBJ: %u vertices reference positions that don't exist\n", Errors);
+    }
+
+    return Errors == 0;
+}
+
+inline u32 GltfIndex(gltf_accessor *Accessor, u32 I)
+{
+    if (!Accessor->Data)
+    {
+        return I;
+    }
+
+    const u8 *Source = Accessor->Data + (u64) I * Accessor->Stride;
+    if (Accessor->ComponentType == GLTF_UNSIGNED_BYTE)
+    {
+        return *Source;
+    }
+    if (Accessor->ComponentType == GLTF_UNSIGNED_SHORT)
+    {
+        u16 Value;
+        SDL_memcpy(&Value, Source, sizeof(Value));
+        return Value;
+    }
+
+    u32 Value;
+    SDL_memcpy(&Value, Source, sizeof(Value));
+    return Value;
+}
+
+inline v3 GltfV3(gltf_accessor *Accessor, u32 I)
+{
+    v3 Result;
+    SDL_memcpy(&Result, Accessor->Data + (u64) I * Accessor->Stride, sizeof(v3));
+    return Result;
+}
+
+// Area weighted, straight from the file into scratch, so the output never
+// gets read back. Serial, but it's only a fallback, Blender always exports
+// normals.
+void AccumulateGlbNormals(glb_primitive *Primitive, v3 *Normals)
+{
+    u32 VertexCount = Primitive->Positions.Count;
+    u32 IndexCount = Primitive->Indices.Data ? Primitive->Indices.Count : VertexCount;
+    SDL_memset(Normals, 0, sizeof(v3) * VertexCount);
+
+    for (u32 I = 0; I + 2 < IndexCount; I += 3)
+    {
+        u32 A = GltfIndex(&Primitive->Indices, I);
+        u32 B = GltfIndex(&Primitive->Indices, I + 1);
+        u32 C = GltfIndex(&Primitive->Indices, I + 2);
+        if (A >= VertexCount || B >= VertexCount || C >= VertexCount)
+        {
+            // Counted as an error by GlbIndexJob.
+            continue;
+        }
+
+        v3 PositionA = GltfV3(&Primitive->Positions, A);
+        v3 Normal = Cross(GltfV3(&Primitive->Positions, B) - PositionA, GltfV3(&Primitive->Positions, C) - PositionA);
+        u32 Corners[3] = { A, B, C };
+        for (u32 J = 0; J < 3; ++J)
+        {
+            v3 *Sum = Normals + Corners[J];
+            *Sum = V3(Sum->X + Normal.X, Sum->Y + Normal.Y, Sum->Z + Normal.Z);
+        }
+    }
+}
+
+void GlbVertexJob(void *Data, u32 Start, u32 End)
+{
+    glb_job_data *Job = (glb_job_data *) Data;
+    glb_primitive *Primitive = Job->Primitive;
+
+    // Accessor data doesn't have to be aligned, so memcpy it out.
+    mesh_bounds Bounds = EmptyBounds();
+    for (u32 I = Start; I < End; ++I)
+    {
+        vertex Vertex = {};
+        Vertex.Position = GltfV3(&Primitive->Positions, I);
+        if (Primitive->Normals.Data)
+        {
+            Vertex.Normal = GltfV3(&Primitive->Normals, I);
+        }
+        else if (Job->Normals)
+        {
+            Vertex.Normal = Norm(Job->Normals[I]);
+        }
+        if (Primitive->UVs.Data)
+        {
+            SDL_memcpy(&Vertex.UV, Primitive->UVs.Data + (u64) I * Primitive->UVs.Stride, sizeof(v2));
+        }
+        GrowBounds(&Bounds, Vertex.Position);
+        Job->Vertices[I] = Vertex;
+    }
+
+    Job->ChunkBounds[Start / MESH_CHUNK_SIZE] = Bounds;
+}
+
+void GlbIndexJob(void *Data, u32 Start, u32 End)
+{
+    glb_job_data *Job = (glb_job_data *) Data;
+    gltf_accessor *Accessor = &Job->Primitive->Indices;
+    u32 VertexOffset = Job->Primitive->VertexOffset;
+
+    for (u32 I = Start; I < End; ++I)
+    {
+        u32 Index = GltfIndex(Accessor, I);
+        if (Index >= Job->VertexCount)
+        {
+            SDL_AddAtomicInt(&Job->Errors, 1);
+            Index = 0;
+        }
+
+        Job->Indices[I] = Index + VertexOffset;
+    }
+}
+
+bool DecodeGlb(mesh_file *File, vertex *Vertices, u32 *Indices, u8 *Scratch, mesh *Mesh)
+{
+    glb_job_data Job = {};
+
+    for (u32 I = 0; I < File->PrimitiveCount; ++I)
+    {
+        glb_primitive *Primitive = File->Primitives + I;
+        u32 IndexCount = Primitive->Indices.Data ? Primitive->Indices.Count : Primitive->Positions.Count;
+
+        Job.Primitive = Primitive;
+        Job.Vertices = Vertices + Primitive->VertexOffset;
+        Job.Indices = Indices + Primitive->IndexOffset;
+        Job.VertexCount = Primitive->Positions.Count;
+        LayoutGlbScratch(Primitive->Positions.Count, !Primitive->Normals.Data, &Job, Scratch);
+
+        if (Job.Normals)
+        {
+            AccumulateGlbNormals(Primitive, Job.Normals);
+        }
+
+        ParallelFor(Primitive->Positions.Count, MESH_CHUNK_SIZE, GlbVertexJob, &Job);
+        ParallelFor(IndexCount, MESH_CHUNK_SIZE, GlbIndexJob, &Job);
+        MergeChunkBounds(&File->Bounds, Job.ChunkBounds, Primitive->Positions.Count);
+    }
+
+    Mesh->Vertices = Vertices;
+    Mesh->VertexCount = File->VertexCount;
+    Mesh->Indices = Indices;
+    Mesh->IndexCount = File->IndexCount;
+
+    u32 Errors = SDL_GetAtomicInt(&Job.Errors);
+    if (Errors)
+    {
+        printf("glTF: %u indices out of range\n", Errors);
+    }
+
+    return Errors == 0;
+}
+
+// Vertices and Indices need room for File->VertexCount and File->IndexCount
+// and are only written to. Scratch needs File->ScratchSize bytes, 16 byte
+// aligned. Mesh gets the actual counts.
+bool DecodeMeshFile(mesh_file *File, vertex *Vertices, u32 *Indices, u8 *Scratch, mesh *Mesh)
+{
+    *Mesh = {};
+    File->Bounds = EmptyBounds();
+    if (File->Format == MeshFile_GLB)
+    {
+        return DecodeGlb(File, Vertices, Indices, Scratch, Mesh);
+    }
+
+    return DecodeObj(File, Vertices, Indices, Scratch, Mesh);
+}
+
+void CloseMeshFile(mesh_file *File)
+{
+    SDL_free(File->Primitives);
+    SDL_free(File->Ranges);
+    UnmapFile(&File->File);
+    *File = {};
+}
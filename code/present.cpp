@@ -0,0 +1,167 @@
+// Presentation: present mode selection, frame limiting and idling.
+//
+// While the window is minimized or hidden we don't run frames at all and
+// block in SDL_WaitEventTimeout instead. While it's visible but unfocused we
+// throttle to a low rate, but still wake up as soon as focus comes back.
+//
+// None of the waits take events out of the queue, input has to go through
+// the frame's poll loop so replay capture sees it. So a wait must never start
+// while something is queued, SDL_WaitEventTimeout(NULL) would return right
+// away every time and we'd spin.
+
+#define IDLE_TIMEOUT_MS 250
+#define UNFOCUSED_FRAME_TIME (1.0 / 20.0)
+#define UNFOCUSED_POLL_MS 10
+
+struct presenter
+{
+    SDL_Window *Window;
+    SDL_GPUPresentMode Mode;
+
+    // 0 means no limit, other than what the present mode imposes.
+    f64 TargetFrameTime;
+    u64 NextFrameNS;
+
+    u32 IdleFrames;
+};
+
+const char *PresentModeNames[] = { "vsync", "immediate", "mailbox" };
+
+bool ParsePresentMode(const char *Name, SDL_GPUPresentMode *Mode)
+{
+    for (u32 I = 0; I < SDL_arraysize(PresentModeNames); ++I)
+    {
+        if (SDL_strcmp(Name, PresentModeNames[I]) == 0)
+        {
+            *Mode = (SDL_GPUPresentMode) I;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Tries Preferred first, then the other mode without vsync and ends up at
+// VSYNC, which is always supported.
+void InitPresenter(presenter *Presenter, SDL_Window *Window, SDL_GPUPresentMode Preferred, u32 FrameLimit)
+{
+    *Presenter = {};
+    Presenter->Window = Window;
+    Presenter->TargetFrameTime = FrameLimit ? 1.0 / FrameLimit : 0;
+    Presenter->Mode = SDL_GPU_PRESENTMODE_VSYNC;
+
+    if (!Window)
+    {
+        return;
+    }
+
+    SDL_GPUPresentMode Candidates[3] = { Preferred, SDL_GPU_PRESENTMODE_MAILBOX, SDL_GPU_PRESENTMODE_IMMEDIATE };
+    if (Preferred == SDL_GPU_PRESENTMODE_MAILBOX)
+    {
+        Candidates[1] = SDL_GPU_PRESENTMODE_IMMEDIATE;
+    }
+
+    u32 CandidateCount = Preferred == SDL_GPU_PRESENTMODE_VSYNC ? 1 : 3;
+    for (u32 I = 0; I < CandidateCount; ++I)
+    {
+        if (SDL_WindowSupportsGPUPresentMode(State.Device, Window, Candidates[I]))
+        {
+            Presenter->Mode = Candidates[I];
+            break;
+        }
+    }
+
+    if (!SDL_SetGPUSwapchainParameters(State.Device, Window, SDL_GPU_SWAPCHAINCOMPOSITION_SDR, Presenter->Mode))
+    {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Failed to set present mode: %s", SDL_GetError());
+        Presenter->Mode = SDL_GPU_PRESENTMODE_VSYNC;
+    }
+
+    SDL_Log("Present mode %s (asked for %s), frame limit %u", PresentModeNames[Presenter->Mode],
+            PresentModeNames[Preferred], FrameLimit);
+}
+
+// Call at the top of the frame. Returns true if the window can't be seen, in
+// which case we already blocked for a while and the frame should be skipped.
+bool PresenterWaitWhileIdle(presenter *Presenter)
+{
+    if (!Presenter->Window)
+    {
+        return false;
+    }
+
+    SDL_WindowFlags Flags = SDL_GetWindowFlags(Presenter->Window);
+    bool Invisible = Flags & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN | SDL_WINDOW_OCCLUDED);
+
+    // Anything queued (quit included) runs a frame so the poll loop drains it.
+    SDL_PumpEvents();
+    if (!Invisible || SDL_HasEvents(SDL_EVENT_FIRST, SDL_EVENT_LAST))
+    {
+        return false;
+    }
+
+    // Passing NULL leaves the event in the queue, the next call sees it and
+    // lets the frame run.
+    SDL_WaitEventTimeout(NULL, IDLE_TIMEOUT_MS);
+    Presenter->IdleFrames++;
+    Presenter->NextFrameNS = 0;
+
+    return true;
+}
+
+// Call after submitting the frame.
+void PresenterEndFrame(presenter *Presenter)
+{
+    if (!Presenter->Window)
+    {
+        return;
+    }
+
+    bool Focused = SDL_GetWindowFlags(Presenter->Window) & SDL_WINDOW_INPUT_FOCUS;
+    f64 TargetFrameTime = Presenter->TargetFrameTime;
+    if (!Focused)
+    {
+        TargetFrameTime = SDL_max(TargetFrameTime, UNFOCUSED_FRAME_TIME);
+    }
+
+    if (TargetFrameTime <= 0)
+    {
+        return;
+    }
+
+    u64 Now = SDL_GetTicksNS();
+    u64 FrameNS = (u64) (TargetFrameTime * 1e9);
+    if (Presenter->NextFrameNS == 0 || Presenter->NextFrameNS + FrameNS < Now)
+    {
+        // First frame or we fell far behind, don't try to catch up.
+        Presenter->NextFrameNS = Now;
+    }
+    Presenter->NextFrameNS += FrameNS;
+
+    if (Presenter->NextFrameNS > Now)
+    {
+        u64 Remaining = Presenter->NextFrameNS - Now;
+        if (Focused)
+        {
+            SDL_DelayPrecise(Remaining);
+        }
+        else
+        {
+            // Sleep in slices and only cut the wait short when focus comes back
+            // or we're asked to quit. Other input (mouse moving over the window)
+            // stays queued for the next frame and doesn't undo the throttling.
+            u64 Deadline = Presenter->NextFrameNS;
+            while (Now < Deadline)
+            {
+                SDL_Delay((u32) SDL_min((Deadline - Now) / 1000000 + 1, UNFOCUSED_POLL_MS));
+                SDL_PumpEvents();
+                if (SDL_HasEvent(SDL_EVENT_WINDOW_FOCUS_GAINED) || SDL_HasEvent(SDL_EVENT_QUIT))
+                {
+                    Presenter->NextFrameNS = 0;
+                    break;
+                }
+                Now = SDL_GetTicksNS();
+            }
+        }
+    }
+}
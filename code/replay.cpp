@@ -0,0 +1,374 @@
+// Frame capture and deterministic replay.
+//
+// A capture stores the seed, quality tier and window size, then one record per
+// frame: the input events that came out of SDL_PollEvent, the global uniforms
+// (only when they changed since the previous frame) and a hash of the
+// simulation state.
+// Playback feeds the recorded events back into the main loop instead of real
+// input and checks the hash every frame, so any divergence shows up right away.
+
+#define REPLAY_MAGIC 0x59504C52
+#define REPLAY_VERSION 3
+#define REPLAY_MAX_EVENTS 1024
+
+#define REPLAY_FRAME_UNIFORMS 0x1
+
+struct replay_header
+{
+    u32 Magic;
+    u32 Version;
+    u32 Seed;
+    u32 Quality;
+    i32 WindowWidth;
+    i32 WindowHeight;
+
+    // Only written when the capture ends. 0 (a capture that crashed) plays
+    // back until the end of the file.
+    u32 FrameCount;
+};
+
+struct replay_frame_header
+{
+    u16 EventCount;
+    u16 Flags;
+    u32 StateHash;
+};
+
+enum replay_mode
+{
+    Replay_Off,
+    Replay_Capture,
+    Replay_Playback,
+};
+
+struct replay
+{
+    replay_mode Mode;
+    SDL_IOStream *File;
+    replay_header Header;
+    u32 Frame;
+
+    u32 EventCount;
+    u32 NextEvent;
+    SDL_Event Events[REPLAY_MAX_EVENTS];
+
+    global_uniforms Uniforms;
+    u32 StateHash;
+    u32 Mismatches;
+    bool Corrupt;
+
+    f64 TotalFrameTime;
+    f64 SlowestFrameTime;
+    u32 SlowestFrame;
+};
+
+// FNV-1a
+u32 HashBytes(u32 Hash, void *Data, u64 Size)
+{
+    u8 *Bytes = (u8 *) Data;
+    for (u64 I = 0; I < Size; ++I)
+    {
+        Hash ^= Bytes[I];
+        Hash *= 16777619;
+    }
+    return Hash;
+}
+
+#define HASH_SEED 2166136261
+
+// Only events without pointers in them can be stored. Returns 0 for events we
+// don't record.
+u32 ReplayEventSize(u32 Type)
+{
+    if (Type == SDL_EVENT_QUIT)
+    {
+        return sizeof(SDL_QuitEvent);
+    }
+    if (Type == SDL_EVENT_KEY_DOWN || Type == SDL_EVENT_KEY_UP)
+    {
+        return sizeof(SDL_KeyboardEvent);
+    }
+    if (Type == SDL_EVENT_MOUSE_MOTION)
+    {
+        return sizeof(SDL_MouseMotionEvent);
+    }
+    if (Type == SDL_EVENT_MOUSE_BUTTON_DOWN || Type == SDL_EVENT_MOUSE_BUTTON_UP)
+    {
+        return sizeof(SDL_MouseButtonEvent);
+    }
+    if (Type == SDL_EVENT_MOUSE_WHEEL)
+    {
+        return sizeof(SDL_MouseWheelEvent);
+    }
+    if (Type >= SDL_EVENT_WINDOW_FIRST && Type <= SDL_EVENT_WINDOW_LAST)
+    {
+        return sizeof(SDL_WindowEvent);
+    }
+
+    return 0;
+}
+
+bool BeginCapture(replay *Replay, const char *Path, u32 Seed, u32 Quality, i32 Width, i32 Height)
+{
+    *Replay = {};
+    Replay->File = SDL_IOFromFile(Path, "wb");
+    if (!Replay->File)
+    {
+        printf("Failed to open capture file %s\n", Path);
+        return false;
+    }
+
+    Replay->Mode = Replay_Capture;
+    Replay->Header.Magic = REPLAY_MAGIC;
+    Replay->Header.Version = REPLAY_VERSION;
+    Replay->Header.Seed = Seed;
+    Replay->Header.Quality = Quality;
+    Replay->Header.WindowWidth = Width;
+    Replay->Header.WindowHeight = Height;
+    SDL_WriteIO(Replay->File, &Replay->Header, sizeof(replay_header));
+
+    return true;
+}
+
+bool BeginPlayback(replay *Replay, const char *Path)
+{
+    *Replay = {};
+    Replay->File = SDL_IOFromFile(Path, "rb");
+    if (!Replay->File)
+    {
+        printf("Failed to open replay file %s\n", Path);
+        return false;
+    }
+
+    if (SDL_ReadIO(Replay->File, &Replay->Header, sizeof(replay_header)) != sizeof(replay_header) ||
+        Replay->Header.Magic != REPLAY_MAGIC ||
+        Replay->Header.Version != REPLAY_VERSION ||
+        Replay->Header.WindowWidth <= 0 || Replay->Header.WindowHeight <= 0)
+    {
+        printf("%s is not a valid replay\n", Path);
+        SDL_CloseIO(Replay->File);
+        Replay->File = NULL;
+        return false;
+    }
+
+    Replay->Mode = Replay_Playback;
+    return true;
+}
+
+bool ReadReplay(replay *Replay, void *Data, u64 Size)
+{
+    return SDL_ReadIO(Replay->File, Data, Size) == Size;
+}
+
+bool ReplayCorrupt(replay *Replay, const char *Reason)
+{
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Replay: %s in frame %u, stopping playback", Reason, Replay->Frame);
+    Replay->Corrupt = true;
+    return false;
+}
+
+// Playback: loads the next frame record, false once the log is exhausted or
+// turns out to be broken.
+bool ReplayBeginFrame(replay *Replay)
+{
+    Replay->EventCount = 0;
+    Replay->NextEvent = 0;
+
+    if (Replay->Mode != Replay_Playback)
+    {
+        return true;
+    }
+
+    if (Replay->Header.FrameCount && Replay->Frame >= Replay->Header.FrameCount)
+    {
+        return false;
+    }
+
+    replay_frame_header FrameHeader;
+    u64 HeaderBytes = SDL_ReadIO(Replay->File, &FrameHeader, sizeof(FrameHeader));
+    if (HeaderBytes != sizeof(FrameHeader))
+    {
+        // Running out exactly between frames is the normal end of a capture
+        // without a frame count.
+        if (HeaderBytes == 0 && Replay->Header.FrameCount == 0)
+        {
+            return false;
+        }
+        return ReplayCorrupt(Replay, "truncated frame header");
+    }
+
+    if (FrameHeader.EventCount > REPLAY_MAX_EVENTS)
+    {
+        return ReplayCorrupt(Replay, "too many events");
+    }
+
+    for (u32 I = 0; I < FrameHeader.EventCount; ++I)
+    {
+        u32 Type;
+        u16 Size;
+        if (!ReadReplay(Replay, &Type, sizeof(Type)) || !ReadReplay(Replay, &Size, sizeof(Size)))
+        {
+            return ReplayCorrupt(Replay, "truncated event");
+        }
+
+        // Capture only writes the types it knows, with their exact size.
+        if (Size == 0 || Size > sizeof(SDL_Event) || Size != ReplayEventSize(Type))
+        {
+            return ReplayCorrupt(Replay, "bad event");
+        }
+
+        SDL_Event *Event = Replay->Events + Replay->EventCount++;
+        *Event = {};
+        if (!ReadReplay(Replay, Event, Size))
+        {
+            return ReplayCorrupt(Replay, "truncated event");
+        }
+    }
+
+    if (FrameHeader.Flags & REPLAY_FRAME_UNIFORMS)
+    {
+        if (!ReadReplay(Replay, &Replay->Uniforms, sizeof(global_uniforms)))
+        {
+            return ReplayCorrupt(Replay, "truncated uniforms");
+        }
+    }
+    Replay->StateHash = FrameHeader.StateHash;
+
+    return true;
+}
+
+// Drop-in for SDL_PollEvent.
+bool ReplayPollEvent(replay *Replay, SDL_Event *Event)
+{
+    if (Replay->Mode == Replay_Playback)
+    {
+        if (Replay->NextEvent < Replay->EventCount)
+        {
+            *Event = Replay->Events[Replay->NextEvent++];
+            return true;
+        }
+
+        // Live input is ignored during playback, except for closing the window.
+        while (SDL_PollEvent(Event))
+        {
+            if (Event->type == SDL_EVENT_QUIT)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool Result = SDL_PollEvent(Event);
+    if (Result && Replay->Mode == Replay_Capture && ReplayEventSize(Event->type))
+    {
+        if (Replay->EventCount < REPLAY_MAX_EVENTS)
+        {
+            Replay->Events[Replay->EventCount++] = *Event;
+        }
+        else
+        {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Replay: dropped event in frame %u", Replay->Frame);
+        }
+    }
+
+    return Result;
+}
+
+// Call once per frame after the simulation step. Capture writes the frame
+// record. Playback checks the state hash and replaces Uniforms with the
+// recorded ones, so the renderer sees exactly what the original run saw.
+void ReplayRecordFrame(replay *Replay, global_uniforms *Uniforms, u32 StateHash)
+{
+    if (Replay->Mode == Replay_Capture)
+    {
+        replay_frame_header FrameHeader = {};
+        FrameHeader.EventCount = Replay->EventCount;
+        FrameHeader.StateHash = StateHash;
+        if (Replay->Frame == 0 || SDL_memcmp(&Replay->Uniforms, Uniforms, sizeof(global_uniforms)) != 0)
+        {
+            FrameHeader.Flags |= REPLAY_FRAME_UNIFORMS;
+        }
+
+        SDL_WriteIO(Replay->File, &FrameHeader, sizeof(FrameHeader));
+        for (u32 I = 0; I < Replay->EventCount; ++I)
+        {
+            SDL_Event *Event = Replay->Events + I;
+            u32 Type = Event->type;
+            u16 Size = ReplayEventSize(Type);
+            SDL_WriteIO(Replay->File, &Type, sizeof(Type));
+            SDL_WriteIO(Replay->File, &Size, sizeof(Size));
+            SDL_WriteIO(Replay->File, Event, Size);
+        }
+
+        if (FrameHeader.Flags & REPLAY_FRAME_UNIFORMS)
+        {
+            SDL_WriteIO(Replay->File, Uniforms, sizeof(global_uniforms));
+            Replay->Uniforms = *Uniforms;
+        }
+    }
+    else if (Replay->Mode == Replay_Playback)
+    {
+        if (StateHash != Replay->StateHash)
+        {
+            if (Replay->Mismatches == 0)
+            {
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Replay: diverged from capture at frame %u", Replay->Frame);
+            }
+            Replay->Mismatches++;
+        }
+
+        *Uniforms = Replay->Uniforms;
+    }
+
+    Replay->Frame++;
+}
+
+void ReplayTrackFrameTime(replay *Replay, f64 Seconds)
+{
+    Replay->TotalFrameTime += Seconds;
+    if (Seconds > Replay->SlowestFrameTime)
+    {
+        Replay->SlowestFrameTime = Seconds;
+        Replay->SlowestFrame = Replay->Frame - 1;
+    }
+}
+
+void EndReplay(replay *Replay)
+{
+    if (Replay->Mode == Replay_Capture)
+    {
+        Replay->Header.FrameCount = Replay->Frame;
+        SDL_SeekIO(Replay->File, 0, SDL_IO_SEEK_SET);
+        SDL_WriteIO(Replay->File, &Replay->Header, sizeof(replay_header));
+        printf("Captured %u frames\n", Replay->Frame);
+    }
+    else if (Replay->Mode == Replay_Playback)
+    {
+        if (Replay->Header.FrameCount)
+        {
+            printf("Replayed %u/%u frames, %u diverged\n", Replay->Frame, Replay->Header.FrameCount, Replay->Mismatches);
+        }
+        else
+        {
+            printf("Replayed %u frames of an unfinished capture, %u diverged\n", Replay->Frame, Replay->Mismatches);
+        }
+        if (Replay->Corrupt)
+        {
+            printf("Replay file is corrupt, playback stopped early\n");
+        }
+        if (Replay->Frame)
+        {
+            printf("Frame time: avg %.3f ms, slowest %.3f ms at frame %u\n",
+                   Replay->TotalFrameTime * 1000 / Replay->Frame,
+                   Replay->SlowestFrameTime * 1000, Replay->SlowestFrame);
+        }
+    }
+
+    if (Replay->File)
+    {
+        SDL_CloseIO(Replay->File);
+    }
+    *Replay = {};
+}
@@ -0,0 +1,109 @@
+// Water shader permutations. The build compiles default.vert/frag once per
+// combination of the defines below into assets/variants/, and we pick one per
+// quality tier at startup instead of branching in the shader.
+
+// Keep in sync with the defines in default.vert/frag and the lists in the
+// Makefile and CMakeLists.txt.
+#define NORMAL_MODE_DERIVATIVE 0
+#define NORMAL_MODE_VERTEX 1
+
+#define LIGHTING_BASIC 0
+#define LIGHTING_SPECULAR 1
+
+// Every combination of these gets built. Keep in sync with the Makefile and
+// CMakeLists.txt as well.
+u32 VariantOctaveCounts[] = { 2, 4, 6 };
+u32 VariantNormalModes[] = { NORMAL_MODE_DERIVATIVE, NORMAL_MODE_VERTEX };
+u32 VariantLightings[] = { LIGHTING_BASIC, LIGHTING_SPECULAR };
+
+struct shader_variant
+{
+    u32 OctaveCount;
+    u32 NormalMode;
+    u32 Lighting;
+};
+
+enum quality_tier
+{
+    Quality_Low,
+    Quality_Medium,
+    Quality_High,
+
+    Quality_Count
+};
+
+const char *QualityNames[Quality_Count] = { "low", "medium", "high" };
+
+shader_variant QualityVariants[Quality_Count] = {
+    { 2, NORMAL_MODE_VERTEX, LIGHTING_BASIC },
+    { 4, NORMAL_MODE_DERIVATIVE, LIGHTING_BASIC },
+    { 6, NORMAL_MODE_DERIVATIVE, LIGHTING_SPECULAR },
+};
+
+struct water_shaders
+{
+    SDL_GPUShader *Vertex;
+    SDL_GPUShader *Fragment;
+    shader_variant Variant;
+};
+
+bool ParseQualityTier(const char *Name, quality_tier *Tier)
+{
+    for (u32 I = 0; I < Quality_Count; ++I)
+    {
+        if (SDL_strcmp(Name, QualityNames[I]) == 0)
+        {
+            *Tier = (quality_tier) I;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// There's no GPU tier query in SDL_gpu, so go by the machine around it.
+// Integrated GPUs usually come with few cores and little RAM.
+quality_tier PickQualityTier()
+{
+    i32 MemoryMB = SDL_GetSystemRAM();
+    i32 CoreCount = SDL_GetNumLogicalCPUCores();
+
+    if (MemoryMB < 4096 || CoreCount <= 2)
+    {
+        return Quality_Low;
+    }
+
+    return Quality_Medium;
+}
+
+void GetVariantPaths(shader_variant Variant, char *VertexPath, char *FragmentPath, u32 PathSize)
+{
+    SDL_snprintf(VertexPath, PathSize, "assets/variants/default.vert.o%u.n%u.spv",
+                 Variant.OctaveCount, Variant.NormalMode);
+    SDL_snprintf(FragmentPath, PathSize, "assets/variants/default.frag.n%u.l%u.spv",
+                 Variant.NormalMode, Variant.Lighting);
+}
+
+// Returns NULL shaders if the variant wasn't built. There's no fallback, the
+// culling bounds and the log depend on which variant actually runs.
+water_shaders LoadWaterShaders(shader_variant Variant)
+{
+    water_shaders Shaders = {};
+
+    char VertexPath[256];
+    char FragmentPath[256];
+    GetVariantPaths(Variant, VertexPath, FragmentPath, sizeof(VertexPath));
+
+    if (!SDL_GetPathInfo(VertexPath, NULL) || !SDL_GetPathInfo(FragmentPath, NULL))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Shader variant %s or %s missing. Build the shaders!",
+                     VertexPath, FragmentPath);
+        return Shaders;
+    }
+
+    Shaders.Variant = Variant;
+    Shaders.Fragment = LoadShader(FragmentPath, 1, 0, 1, true);
+    Shaders.Vertex = LoadShader(VertexPath, 1, 1, 1, false);
+
+    return Shaders;
+}
@@ -0,0 +1,232 @@
+// Startup as a dependency graph.
+//
+// Every step of getting to the first frame is a task with explicit
+// dependencies. Tasks whose dependencies are done get pushed to the job
+// system, so independent steps (baking noise, spawning entities, loading
+// shaders) overlap. Tasks that touch the window or the video subsystem are
+// flagged MainThread and are picked up by the thread that called RunStartup.
+// Each task records when it ran, which gives the critical path afterwards.
+
+#define MAX_STARTUP_TASKS 32
+#define MAX_STARTUP_DEPENDENCIES 8
+
+// Return false to abort startup. Tasks that haven't started yet get skipped.
+typedef bool startup_func(void *Data);
+
+struct startup_task
+{
+    const char *Name;
+    startup_func *Func;
+    bool MainThread;
+
+    u32 DependencyCount;
+    u32 Dependencies[MAX_STARTUP_DEPENDENCIES];
+
+    u32 DependentCount;
+    u32 Dependents[MAX_STARTUP_TASKS];
+
+    // Unfinished dependencies, the task is ready at zero.
+    SDL_AtomicInt Waiting;
+    SDL_AtomicInt Claimed;
+
+    f64 Start;
+    f64 End;
+    bool OnWorker;
+};
+
+struct startup_graph
+{
+    void *Data;
+
+    u32 TaskCount;
+    startup_task Tasks[MAX_STARTUP_TASKS];
+
+    SDL_AtomicInt Pending;
+    SDL_AtomicInt Failed;
+    SDL_ThreadID MainThreadID;
+
+    f64 Origin;
+    f64 End;
+};
+
+void InitStartupGraph(startup_graph *Graph, void *Data)
+{
+    SDL_memset(Graph, 0, sizeof(*Graph));
+    Graph->Data = Data;
+}
+
+u32 AddStartupTask(startup_graph *Graph, const char *Name, startup_func *Func, bool MainThread = false)
+{
+    assert(Graph->TaskCount < MAX_STARTUP_TASKS);
+
+    u32 Index = Graph->TaskCount++;
+    startup_task *Task = Graph->Tasks + Index;
+    Task->Name = Name;
+    Task->Func = Func;
+    Task->MainThread = MainThread;
+    return Index;
+}
+
+// Dependencies have to be added before the task that needs them, so the task
+// list is always in a valid order.
+void StartupDependsOn(startup_graph *Graph, u32 Task, u32 Dependency)
+{
+    assert(Dependency < Task);
+
+    startup_task *Dependent = Graph->Tasks + Task;
+    assert(Dependent->DependencyCount < MAX_STARTUP_DEPENDENCIES);
+    Dependent->Dependencies[Dependent->DependencyCount++] = Dependency;
+
+    startup_task *Required = Graph->Tasks + Dependency;
+    Required->Dependents[Required->DependentCount++] = Task;
+}
+
+void StartupTaskJob(void *Data, u32 Start, u32 End);
+
+// Hands a ready task to whoever should run it. Main thread tasks stay put
+// until the main thread finds them in RunStartup.
+void ScheduleStartupTask(startup_graph *Graph, u32 Index)
+{
+    if (!Graph->Tasks[Index].MainThread)
+    {
+        PushJob(StartupTaskJob, Graph, Index, Index + 1, &Graph->Pending);
+    }
+}
+
+void RunStartupTask(startup_graph *Graph, u32 Index)
+{
+    startup_task *Task = Graph->Tasks + Index;
+
+    // NOTE: Without workers PushJob runs the task right away on this thread.
+    Task->OnWorker = SDL_GetCurrentThreadID() != Graph->MainThreadID;
+    Task->Start = GetSeconds();
+    if (!SDL_GetAtomicInt(&Graph->Failed) && !Task->Func(Graph->Data))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Startup: %s failed", Task->Name);
+        SDL_SetAtomicInt(&Graph->Failed, 1);
+    }
+    Task->End = GetSeconds();
+
+    for (u32 I = 0; I < Task->DependentCount; ++I)
+    {
+        u32 Dependent = Task->Dependents[I];
+        if (SDL_AddAtomicInt(&Graph->Tasks[Dependent].Waiting, -1) == 1)
+        {
+            ScheduleStartupTask(Graph, Dependent);
+        }
+    }
+}
+
+void StartupTaskJob(void *Data, u32 Start, u32 End)
+{
+    RunStartupTask((startup_graph *) Data, Start);
+}
+
+// Runs every task and returns once all are done. False if one of them failed.
+bool RunStartup(startup_graph *Graph)
+{
+    Graph->Origin = GetSeconds();
+    Graph->MainThreadID = SDL_GetCurrentThreadID();
+    SDL_SetAtomicInt(&Graph->Pending, Graph->TaskCount);
+    for (u32 I = 0; I < Graph->TaskCount; ++I)
+    {
+        SDL_SetAtomicInt(&Graph->Tasks[I].Waiting, Graph->Tasks[I].DependencyCount);
+    }
+
+    for (u32 I = 0; I < Graph->TaskCount; ++I)
+    {
+        if (Graph->Tasks[I].DependencyCount == 0)
+        {
+            ScheduleStartupTask(Graph, I);
+        }
+    }
+
+    while (SDL_GetAtomicInt(&Graph->Pending) > 0)
+    {
+        bool RanTask = false;
+        for (u32 I = 0; I < Graph->TaskCount; ++I)
+        {
+            startup_task *Task = Graph->Tasks + I;
+            if (Task->MainThread && SDL_GetAtomicInt(&Task->Waiting) == 0 &&
+                SDL_CompareAndSwapAtomicInt(&Task->Claimed, 0, 1))
+            {
+                RunStartupTask(Graph, I);
+                SDL_AddAtomicInt(&Graph->Pending, -1);
+                RanTask = true;
+            }
+        }
+
+        // Otherwise help with whatever the workers have queued.
+        job Job;
+        if (!RanTask && PopJob(&Job))
+        {
+            RunJob(&Job);
+        }
+        else if (!RanTask)
+        {
+            SDL_CPUPauseInstruction();
+        }
+    }
+
+    Graph->End = GetSeconds();
+    return !SDL_GetAtomicInt(&Graph->Failed);
+}
+
+// Prints every task with its start and duration relative to RunStartup,
+// marking the chain of tasks that decided when startup finished.
+void ReportStartup(startup_graph *Graph)
+{
+    bool Critical[MAX_STARTUP_TASKS] = {};
+
+    // Start at the task that finished last and keep following the dependency
+    // that finished last, that's the one each task was waiting for.
+    u32 Last = 0;
+    for (u32 I = 1; I < Graph->TaskCount; ++I)
+    {
+        if (Graph->Tasks[I].End > Graph->Tasks[Last].End)
+        {
+            Last = I;
+        }
+    }
+
+    f64 CriticalTime = 0;
+    if (Graph->TaskCount)
+    {
+        u32 Current = Last;
+        while (true)
+        {
+            startup_task *Task = Graph->Tasks + Current;
+            Critical[Current] = true;
+            CriticalTime += Task->End - Task->Start;
+            if (!Task->DependencyCount)
+            {
+                break;
+            }
+
+            u32 Latest = Task->Dependencies[0];
+            for (u32 I = 1; I < Task->DependencyCount; ++I)
+            {
+                if (Graph->Tasks[Task->Dependencies[I]].End > Graph->Tasks[Latest].End)
+                {
+                    Latest = Task->Dependencies[I];
+                }
+            }
+            Current = Latest;
+        }
+    }
+
+    f64 TaskTime = 0;
+    printf("Startup tasks (* = critical path):\n");
+    for (u32 I = 0; I < Graph->TaskCount; ++I)
+    {
+        startup_task *Task = Graph->Tasks + I;
+        TaskTime += Task->End - Task->Start;
+        printf("  %c %-16s | start %8.2f ms | %8.2f ms | %s\n", Critical[I] ? '*' : ' ', Task->Name,
+               (Task->Start - Graph->Origin) * 1000, (Task->End - Task->Start) * 1000,
+               Task->OnWorker ? "worker" : "main");
+    }
+
+    f64 WallTime = Graph->End - Graph->Origin;
+    printf("Startup: %.2f ms wall, %.2f ms of tasks, %.2f ms critical path, %u workers\n",
+           WallTime * 1000, TaskTime * 1000, CriticalTime * 1000, Jobs.WorkerCount);
+}
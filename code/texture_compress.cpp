@@ -0,0 +1,620 @@
+// Block compression for baked textures.
+//
+// BC4 for single channel data (noise, heights), BC1 and BC7 for colour. All
+// of them work on 4x4 blocks, so encoding is split across the job system by
+// rows of blocks. The encoders go for speed over quality: bounding box
+// endpoints with a small inset and nearest palette entry per pixel. BC7 only
+// uses mode 6 (one subset, RGBA endpoints with p-bits, 4 bit indices).
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define TEXTURE_COMPRESS_SSE2 1
+#endif
+
+enum texture_codec
+{
+    Codec_BC1,
+    Codec_BC4,
+    Codec_BC7,
+
+    Codec_Count
+};
+
+const char *CodecNames[Codec_Count] = { "BC1", "BC4", "BC7" };
+
+u32 CodecChannels(texture_codec Codec)
+{
+    return Codec == Codec_BC4 ? 1 : 4;
+}
+
+u32 CodecBlockBytes(texture_codec Codec)
+{
+    return Codec == Codec_BC7 ? 16 : 8;
+}
+
+u32 CompressedSize(texture_codec Codec, u32 Width, u32 Height)
+{
+    return ((Width + 3) / 4) * ((Height + 3) / 4) * CodecBlockBytes(Codec);
+}
+
+// Copies a 4x4 block, clamping at the right and bottom edge.
+void FetchBlock(u8 *Pixels, u32 Width, u32 Height, u32 Channels, u32 BlockX, u32 BlockY, u8 *Block)
+{
+    for (u32 Y = 0; Y < 4; ++Y)
+    {
+        u32 SourceY = SDL_min(BlockY * 4 + Y, Height - 1);
+        for (u32 X = 0; X < 4; ++X)
+        {
+            u32 SourceX = SDL_min(BlockX * 4 + X, Width - 1);
+            u8 *Source = Pixels + (SourceX + SourceY * Width) * Channels;
+            SDL_memcpy(Block + (X + Y * 4) * Channels, Source, Channels);
+        }
+    }
+}
+
+void StoreBlock(u8 *Block, u32 Width, u32 Height, u32 Channels, u32 BlockX, u32 BlockY, u8 *Pixels)
+{
+    for (u32 Y = 0; Y < 4 && BlockY * 4 + Y < Height; ++Y)
+    {
+        for (u32 X = 0; X < 4 && BlockX * 4 + X < Width; ++X)
+        {
+            u8 *Dest = Pixels + (BlockX * 4 + X + (BlockY * 4 + Y) * Width) * Channels;
+            SDL_memcpy(Dest, Block + (X + Y * 4) * Channels, Channels);
+        }
+    }
+}
+
+// BC4...
+//
+void EncodeBC4Block(u8 *Block, u8 *Out)
+{
+    u32 Min;
+    u32 Max;
+
+#if TEXTURE_COMPRESS_SSE2
+    __m128i Values = _mm_loadu_si128((__m128i *) Block);
+    __m128i MinValues = _mm_min_epu8(Values, _mm_srli_si128(Values, 8));
+    __m128i MaxValues = _mm_max_epu8(Values, _mm_srli_si128(Values, 8));
+    MinValues = _mm_min_epu8(MinValues, _mm_srli_si128(MinValues, 4));
+    MaxValues = _mm_max_epu8(MaxValues, _mm_srli_si128(MaxValues, 4));
+    MinValues = _mm_min_epu8(MinValues, _mm_srli_si128(MinValues, 2));
+    MaxValues = _mm_max_epu8(MaxValues, _mm_srli_si128(MaxValues, 2));
+    MinValues = _mm_min_epu8(MinValues, _mm_srli_si128(MinValues, 1));
+    MaxValues = _mm_max_epu8(MaxValues, _mm_srli_si128(MaxValues, 1));
+    Min = _mm_cvtsi128_si32(MinValues) & 0xFF;
+    Max = _mm_cvtsi128_si32(MaxValues) & 0xFF;
+#else
+    Min = 255;
+    Max = 0;
+    for (u32 I = 0; I < 16; ++I)
+    {
+        Min = SDL_min(Min, (u32) Block[I]);
+        Max = SDL_max(Max, (u32) Block[I]);
+    }
+#endif
+
+    // Red0 > Red1 selects the 8 value palette: Red0, Red1 and 6 steps between.
+    Out[0] = Max;
+    Out[1] = Min;
+    SDL_memset(Out + 2, 0, 6);
+    if (Max == Min)
+    {
+        return;
+    }
+
+    // Level 0 is Max, level 7 is Min.
+    u8 Levels[16];
+    f32 Scale = 7.0f / (f32) (Max - Min);
+
+#if TEXTURE_COMPRESS_SSE2
+    __m128i Zero = _mm_setzero_si128();
+    __m128i Low = _mm_unpacklo_epi8(Values, Zero);
+    __m128i High = _mm_unpackhi_epi8(Values, Zero);
+    __m128i Lanes[4] = {
+        _mm_unpacklo_epi16(Low, Zero), _mm_unpackhi_epi16(Low, Zero),
+        _mm_unpacklo_epi16(High, Zero), _mm_unpackhi_epi16(High, Zero),
+    };
+    __m128 MaxF = _mm_set1_ps((f32) Max);
+    __m128 ScaleF = _mm_set1_ps(Scale);
+    __m128 Half = _mm_set1_ps(0.5f);
+
+    __m128i Quantized[4];
+    for (u32 I = 0; I < 4; ++I)
+    {
+        __m128 Distance = _mm_sub_ps(MaxF, _mm_cvtepi32_ps(Lanes[I]));
+        Quantized[I] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(Distance, ScaleF), Half));
+    }
+    __m128i Packed = _mm_packus_epi16(_mm_packs_epi32(Quantized[0], Quantized[1]),
+                                      _mm_packs_epi32(Quantized[2], Quantized[3]));
+    _mm_storeu_si128((__m128i *) Levels, Packed);
+#else
+    for (u32 I = 0; I < 16; ++I)
+    {
+        Levels[I] = (u8) ((f32) (Max - Block[I]) * Scale + 0.5f);
+    }
+#endif
+
+    u64 Bits = 0;
+    for (u32 I = 0; I < 16; ++I)
+    {
+        u32 Level = Levels[I];
+        u32 Index = Level == 0 ? 0 : (Level == 7 ? 1 : Level + 1);
+        Bits |= (u64) Index << (3 * I);
+    }
+
+    for (u32 I = 0; I < 6; ++I)
+    {
+        Out[2 + I] = (u8) (Bits >> (8 * I));
+    }
+}
+
+void DecodeBC4Block(u8 *In, u8 *Block)
+{
+    u32 Red0 = In[0];
+    u32 Red1 = In[1];
+
+    u8 Palette[8];
+    Palette[0] = Red0;
+    Palette[1] = Red1;
+    if (Red0 > Red1)
+    {
+        for (u32 I = 2; I < 8; ++I)
+        {
+            Palette[I] = ((8 - I) * Red0 + (I - 1) * Red1) / 7;
+        }
+    }
+    else
+    {
+        for (u32 I = 2; I < 6; ++I)
+        {
+            Palette[I] = ((6 - I) * Red0 + (I - 1) * Red1) / 5;
+        }
+        Palette[6] = 0;
+        Palette[7] = 255;
+    }
+
+    u64 Bits = 0;
+    for (u32 I = 0; I < 6; ++I)
+    {
+        Bits |= (u64) In[2 + I] << (8 * I);
+    }
+
+    for (u32 I = 0; I < 16; ++I)
+    {
+        Block[I] = Palette[(Bits >> (3 * I)) & 7];
+    }
+}
+
+// Shared by BC1 and BC7: per channel bounding box of an RGBA block.
+void BlockBounds(u8 *Block, u8 *Min, u8 *Max)
+{
+#if TEXTURE_COMPRESS_SSE2
+    __m128i Row0 = _mm_loadu_si128((__m128i *) (Block + 0));
+    __m128i Row1 = _mm_loadu_si128((__m128i *) (Block + 16));
+    __m128i Row2 = _mm_loadu_si128((__m128i *) (Block + 32));
+    __m128i Row3 = _mm_loadu_si128((__m128i *) (Block + 48));
+
+    __m128i MinValues = _mm_min_epu8(_mm_min_epu8(Row0, Row1), _mm_min_epu8(Row2, Row3));
+    __m128i MaxValues = _mm_max_epu8(_mm_max_epu8(Row0, Row1), _mm_max_epu8(Row2, Row3));
+    MinValues = _mm_min_epu8(MinValues, _mm_srli_si128(MinValues, 8));
+    MaxValues = _mm_max_epu8(MaxValues, _mm_srli_si128(MaxValues, 8));
+    MinValues = _mm_min_epu8(MinValues, _mm_srli_si128(MinValues, 4));
+    MaxValues = _mm_max_epu8(MaxValues, _mm_srli_si128(MaxValues, 4));
+
+    u32 MinPacked = _mm_cvtsi128_si32(MinValues);
+    u32 MaxPacked = _mm_cvtsi128_si32(MaxValues);
+    SDL_memcpy(Min, &MinPacked, 4);
+    SDL_memcpy(Max, &MaxPacked, 4);
+#else
+    for (u32 Channel = 0; Channel < 4; ++Channel)
+    {
+        Min[Channel] = 255;
+        Max[Channel] = 0;
+        for (u32 I = 0; I < 16; ++I)
+        {
+            Min[Channel] = SDL_min(Min[Channel], Block[I * 4 + Channel]);
+            Max[Channel] = SDL_max(Max[Channel], Block[I * 4 + Channel]);
+        }
+    }
+#endif
+}
+
+// Shrinks the box a bit (the extremes are rarely hit exactly) and flips
+// channels that are anti-correlated with the widest channel, so the
+// endpoints lie on the right diagonal of the box.
+void SelectEndpoints(u8 *Block, u32 ChannelCount, u8 *Min, u8 *Max)
+{
+    BlockBounds(Block, Min, Max);
+
+    u32 Widest = 0;
+    for (u32 Channel = 1; Channel < ChannelCount; ++Channel)
+    {
+        if (Max[Channel] - Min[Channel] > Max[Widest] - Min[Widest])
+        {
+            Widest = Channel;
+        }
+    }
+
+    f32 Center[4];
+    for (u32 Channel = 0; Channel < 4; ++Channel)
+    {
+        Center[Channel] = ((f32) Min[Channel] + (f32) Max[Channel]) * 0.5f;
+    }
+
+    for (u32 Channel = 0; Channel < ChannelCount; ++Channel)
+    {
+        f32 Covariance = 0;
+        for (u32 I = 0; I < 16; ++I)
+        {
+            Covariance += (Block[I * 4 + Channel] - Center[Channel]) * (Block[I * 4 + Widest] - Center[Widest]);
+        }
+
+        u32 Inset = (Max[Channel] - Min[Channel]) / 16;
+        u8 Low = Min[Channel] + Inset;
+        u8 High = Max[Channel] - Inset;
+
+        if (Covariance < 0)
+        {
+            Min[Channel] = High;
+            Max[Channel] = Low;
+        }
+        else
+        {
+            Min[Channel] = Low;
+            Max[Channel] = High;
+        }
+    }
+}
+
+// BC1...
+//
+inline u16 PackRGB565(u8 *Color)
+{
+    u32 R = (Color[0] * 31 + 127) / 255;
+    u32 G = (Color[1] * 63 + 127) / 255;
+    u32 B = (Color[2] * 31 + 127) / 255;
+    return (u16) ((R << 11) | (G << 5) | B);
+}
+
+inline void UnpackRGB565(u16 Packed, i32 *Color)
+{
+    u32 R = (Packed >> 11) & 31;
+    u32 G = (Packed >> 5) & 63;
+    u32 B = Packed & 31;
+    Color[0] = (R << 3) | (R >> 2);
+    Color[1] = (G << 2) | (G >> 4);
+    Color[2] = (B << 3) | (B >> 2);
+}
+
+void BC1Palette(u16 Color0, u16 Color1, i32 Palette[4][3])
+{
+    UnpackRGB565(Color0, Palette[0]);
+    UnpackRGB565(Color1, Palette[1]);
+    for (u32 Channel = 0; Channel < 3; ++Channel)
+    {
+        if (Color0 > Color1)
+        {
+            Palette[2][Channel] = (2 * Palette[0][Channel] + Palette[1][Channel]) / 3;
+            Palette[3][Channel] = (Palette[0][Channel] + 2 * Palette[1][Channel]) / 3;
+        }
+        else
+        {
+            Palette[2][Channel] = (Palette[0][Channel] + Palette[1][Channel]) / 2;
+            Palette[3][Channel] = 0;
+        }
+    }
+}
+
+// Alpha is ignored, the block is always encoded opaque.
+void EncodeBC1Block(u8 *Block, u8 *Out)
+{
+    u8 Min[4];
+    u8 Max[4];
+    SelectEndpoints(Block, 3, Min, Max);
+
+    u16 Color0 = PackRGB565(Max);
+    u16 Color1 = PackRGB565(Min);
+    if (Color0 < Color1)
+    {
+        u16 Swap = Color0;
+        Color0 = Color1;
+        Color1 = Swap;
+    }
+
+    u32 Indices = 0;
+    if (Color0 != Color1)
+    {
+        i32 Palette[4][3];
+        BC1Palette(Color0, Color1, Palette);
+
+        for (u32 I = 0; I < 16; ++I)
+        {
+            u8 *Pixel = Block + I * 4;
+            u32 Best = 0;
+            i32 BestError = 0x7FFFFFFF;
+            for (u32 Entry = 0; Entry < 4; ++Entry)
+            {
+                i32 DR = Pixel[0] - Palette[Entry][0];
+                i32 DG = Pixel[1] - Palette[Entry][1];
+                i32 DB = Pixel[2] - Palette[Entry][2];
+                i32 Error = DR * DR + DG * DG + DB * DB;
+                if (Error < BestError)
+                {
+                    BestError = Error;
+                    Best = Entry;
+                }
+            }
+            Indices |= Best << (2 * I);
+        }
+    }
+
+    Out[0] = Color0 & 0xFF;
+    Out[1] = Color0 >> 8;
+    Out[2] = Color1 & 0xFF;
+    Out[3] = Color1 >> 8;
+    SDL_memcpy(Out + 4, &Indices, 4);
+}
+
+void DecodeBC1Block(u8 *In, u8 *Block)
+{
+    u16 Color0 = In[0] | (In[1] << 8);
+    u16 Color1 = In[2] | (In[3] << 8);
+    u32 Indices;
+    SDL_memcpy(&Indices, In + 4, 4);
+
+    i32 Palette[4][3];
+    BC1Palette(Color0, Color1, Palette);
+
+    for (u32 I = 0; I < 16; ++I)
+    {
+        u32 Index = (Indices >> (2 * I)) & 3;
+        Block[I * 4 + 0] = Palette[Index][0];
+        Block[I * 4 + 1] = Palette[Index][1];
+        Block[I * 4 + 2] = Palette[Index][2];
+        Block[I * 4 + 3] = (Color0 <= Color1 && Index == 3) ? 0 : 255;
+    }
+}
+
+// BC7 (mode 6 only)...
+//
+u32 BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+void WriteBits(u8 *Out, u32 *Bit, u32 Value, u32 Count)
+{
+    for (u32 I = 0; I < Count; ++I, ++*Bit)
+    {
+        Out[*Bit >> 3] |= ((Value >> I) & 1) << (*Bit & 7);
+    }
+}
+
+u32 ReadBits(u8 *In, u32 *Bit, u32 Count)
+{
+    u32 Value = 0;
+    for (u32 I = 0; I < Count; ++I, ++*Bit)
+    {
+        Value |= ((In[*Bit >> 3] >> (*Bit & 7)) & 1) << I;
+    }
+    return Value;
+}
+
+// Picks the p-bit that keeps the 7 bit quantized endpoint closest.
+void QuantizeBC7Endpoint(u8 *Endpoint, u8 *Quantized, u32 *PBit)
+{
+    i32 BestError = 0x7FFFFFFF;
+    for (u32 P = 0; P < 2; ++P)
+    {
+        i32 Error = 0;
+        u8 Candidate[4];
+        for (u32 Channel = 0; Channel < 4; ++Channel)
+        {
+            i32 Q = ((i32) Endpoint[Channel] - (i32) P + 1) / 2;
+            Q = SDL_clamp(Q, 0, 127);
+            Candidate[Channel] = (u8) Q;
+            i32 Difference = (i32) Endpoint[Channel] - ((Q << 1) | (i32) P);
+            Error += Difference * Difference;
+        }
+
+        if (Error < BestError)
+        {
+            BestError = Error;
+            SDL_memcpy(Quantized, Candidate, 4);
+            *PBit = P;
+        }
+    }
+}
+
+void EncodeBC7Block(u8 *Block, u8 *Out)
+{
+    u8 Min[4];
+    u8 Max[4];
+    SelectEndpoints(Block, 4, Min, Max);
+
+    u8 Quantized[2][4];
+    u32 PBits[2];
+    QuantizeBC7Endpoint(Min, Quantized[0], PBits + 0);
+    QuantizeBC7Endpoint(Max, Quantized[1], PBits + 1);
+
+    f32 Endpoints[2][4];
+    for (u32 E = 0; E < 2; ++E)
+    {
+        for (u32 Channel = 0; Channel < 4; ++Channel)
+        {
+            Endpoints[E][Channel] = (f32) ((Quantized[E][Channel] << 1) | PBits[E]);
+        }
+    }
+
+    f32 Axis[4];
+    f32 AxisLengthSquared = 0;
+    for (u32 Channel = 0; Channel < 4; ++Channel)
+    {
+        Axis[Channel] = Endpoints[1][Channel] - Endpoints[0][Channel];
+        AxisLengthSquared += Axis[Channel] * Axis[Channel];
+    }
+
+    u32 Indices[16] = {};
+    if (AxisLengthSquared > 0)
+    {
+        f32 Scale = 15.0f / AxisLengthSquared;
+        for (u32 I = 0; I < 16; ++I)
+        {
+            f32 Projection = 0;
+            for (u32 Channel = 0; Channel < 4; ++Channel)
+            {
+                Projection += ((f32) Block[I * 4 + Channel] - Endpoints[0][Channel]) * Axis[Channel];
+            }
+            i32 Index = (i32) (Projection * Scale + 0.5f);
+            Indices[I] = SDL_clamp(Index, 0, 15);
+        }
+    }
+
+    // The high bit of the first index is implied zero, swap the endpoints if needed.
+    u32 First = 0;
+    if (Indices[0] & 8)
+    {
+        First = 1;
+        for (u32 I = 0; I < 16; ++I)
+        {
+            Indices[I] = 15 - Indices[I];
+        }
+    }
+    u32 Second = 1 - First;
+
+    SDL_memset(Out, 0, 16);
+    u32 Bit = 0;
+    WriteBits(Out, &Bit, 1 << 6, 7);
+    for (u32 Channel = 0; Channel < 4; ++Channel)
+    {
+        WriteBits(Out, &Bit, Quantized[First][Channel], 7);
+        WriteBits(Out, &Bit, Quantized[Second][Channel], 7);
+    }
+    WriteBits(Out, &Bit, PBits[First], 1);
+    WriteBits(Out, &Bit, PBits[Second], 1);
+
+    WriteBits(Out, &Bit, Indices[0], 3);
+    for (u32 I = 1; I < 16; ++I)
+    {
+        WriteBits(Out, &Bit, Indices[I], 4);
+    }
+}
+
+// Only decodes mode 6, other modes come out black.
+void DecodeBC7Block(u8 *In, u8 *Block)
+{
+    SDL_memset(Block, 0, 64);
+    if ((In[0] & 0x7F) != (1 << 6))
+    {
+        return;
+    }
+
+    u32 Bit = 7;
+    u32 Endpoints[2][4];
+    for (u32 Channel = 0; Channel < 4; ++Channel)
+    {
+        Endpoints[0][Channel] = ReadBits(In, &Bit, 7) << 1;
+        Endpoints[1][Channel] = ReadBits(In, &Bit, 7) << 1;
+    }
+    u32 PBit0 = ReadBits(In, &Bit, 1);
+    u32 PBit1 = ReadBits(In, &Bit, 1);
+    for (u32 Channel = 0; Channel < 4; ++Channel)
+    {
+        Endpoints[0][Channel] |= PBit0;
+        Endpoints[1][Channel] |= PBit1;
+    }
+
+    for (u32 I = 0; I < 16; ++I)
+    {
+        u32 Index = ReadBits(In, &Bit, I == 0 ? 3 : 4);
+        u32 Weight = BC7Weights[Index];
+        for (u32 Channel = 0; Channel < 4; ++Channel)
+        {
+            Block[I * 4 + Channel] = ((64 - Weight) * Endpoints[0][Channel] + Weight * Endpoints[1][Channel] + 32) >> 6;
+        }
+    }
+}
+
+// Whole textures...
+//
+struct compress_job
+{
+    texture_codec Codec;
+    u8 *Pixels;
+    u32 Width;
+    u32 Height;
+    u8 *Blocks;
+};
+
+void CompressRowsJob(void *Data, u32 Start, u32 End)
+{
+    compress_job *Job = (compress_job *) Data;
+    u32 Channels = CodecChannels(Job->Codec);
+    u32 BlockBytes = CodecBlockBytes(Job->Codec);
+    u32 BlocksX = (Job->Width + 3) / 4;
+
+    u8 Block[64];
+    for (u32 BlockY = Start; BlockY < End; ++BlockY)
+    {
+        for (u32 BlockX = 0; BlockX < BlocksX; ++BlockX)
+        {
+            u8 *Out = Job->Blocks + (BlockX + BlockY * BlocksX) * BlockBytes;
+            FetchBlock(Job->Pixels, Job->Width, Job->Height, Channels, BlockX, BlockY, Block);
+            switch (Job->Codec)
+            {
+                case Codec_BC1: EncodeBC1Block(Block, Out); break;
+                case Codec_BC4: EncodeBC4Block(Block, Out); break;
+                case Codec_BC7: EncodeBC7Block(Block, Out); break;
+                default: break;
+            }
+        }
+    }
+}
+
+void DecompressRowsJob(void *Data, u32 Start, u32 End)
+{
+    compress_job *Job = (compress_job *) Data;
+    u32 Channels = CodecChannels(Job->Codec);
+    u32 BlockBytes = CodecBlockBytes(Job->Codec);
+    u32 BlocksX = (Job->Width + 3) / 4;
+
+    u8 Block[64];
+    for (u32 BlockY = Start; BlockY < End; ++BlockY)
+    {
+        for (u32 BlockX = 0; BlockX < BlocksX; ++BlockX)
+        {
+            u8 *In = Job->Blocks + (BlockX + BlockY * BlocksX) * BlockBytes;
+            switch (Job->Codec)
+            {
+                case Codec_BC1: DecodeBC1Block(In, Block); break;
+                case Codec_BC4: DecodeBC4Block(In, Block); break;
+                case Codec_BC7: DecodeBC7Block(In, Block); break;
+                default: break;
+            }
+            StoreBlock(Block, Job->Width, Job->Height, Channels, BlockX, BlockY, Job->Pixels);
+        }
+    }
+}
+
+// Pixels are 1 channel for BC4 and RGBA for BC1/BC7. Blocks must hold
+// CompressedSize() bytes.
+void CompressTexture(texture_codec Codec, u8 *Pixels, u32 Width, u32 Height, u8 *Blocks)
+{
+    compress_job Job = { Codec, Pixels, Width, Height, Blocks };
+    ParallelFor((Height + 3) / 4, 8, CompressRowsJob, &Job);
+}
+
+void DecompressTexture(texture_codec Codec, u8 *Blocks, u32 Width, u32 Height, u8 *Pixels)
+{
+    compress_job Job = { Codec, Pixels, Width, Height, Blocks };
+    ParallelFor((Height + 3) / 4, 8, DecompressRowsJob, &Job);
+}
+
+// Root mean square error over all channels, in 8 bit units.
+f64 TextureRMSE(u8 *A, u8 *B, u32 ByteCount)
+{
+    f64 Sum = 0;
+    for (u32 I = 0; I < ByteCount; ++I)
+    {
+        f64 Difference = (f64) A[I] - (f64) B[I];
+        Sum += Difference * Difference;
+    }
+    return sqrt(Sum / ByteCount);
+}
@@ -0,0 +1,200 @@
+// Per frame and per object shader data.
+//
+// The camera caches its matrices and only rebuilds the ones whose inputs
+// changed, and hands the shader one premultiplied view projection matrix.
+// Per object data (model matrix, material) lives in one storage buffer that
+// the vertex shader indexes with gl_InstanceIndex, so any number of objects
+// sharing a mesh is one draw call and no uniform pushes. Only the range of
+// objects touched since the last upload gets copied to the GPU.
+
+#define CAMERA_VIEW_DIRTY 0x1
+#define CAMERA_PROJECTION_DIRTY 0x2
+
+struct camera
+{
+    v3 Position;
+    v3 Target;
+    v3 Up;
+
+    f32 Fov;
+    f32 Aspect;
+    f32 NearPlane;
+    f32 FarPlane;
+
+    u32 Dirty;
+    mat4 View;
+    mat4 Projection;
+    mat4 ViewProjection;
+};
+
+void SetCameraView(camera *Camera, v3 Position, v3 Target, v3 Up)
+{
+    if (SDL_memcmp(&Camera->Position, &Position, sizeof(v3)) != 0 ||
+        SDL_memcmp(&Camera->Target, &Target, sizeof(v3)) != 0 ||
+        SDL_memcmp(&Camera->Up, &Up, sizeof(v3)) != 0)
+    {
+        Camera->Position = Position;
+        Camera->Target = Target;
+        Camera->Up = Up;
+        Camera->Dirty |= CAMERA_VIEW_DIRTY;
+    }
+}
+
+void SetCameraProjection(camera *Camera, f32 Fov, f32 Aspect, f32 NearPlane, f32 FarPlane)
+{
+    if (Camera->Fov != Fov || Camera->Aspect != Aspect ||
+        Camera->NearPlane != NearPlane || Camera->FarPlane != FarPlane)
+    {
+        Camera->Fov = Fov;
+        Camera->Aspect = Aspect;
+        Camera->NearPlane = NearPlane;
+        Camera->FarPlane = FarPlane;
+        Camera->Dirty |= CAMERA_PROJECTION_DIRTY;
+    }
+}
+
+// Returns true if any matrix changed.
+bool UpdateCamera(camera *Camera)
+{
+    if (!Camera->Dirty)
+    {
+        return false;
+    }
+
+    if (Camera->Dirty & CAMERA_VIEW_DIRTY)
+    {
+        Camera->View = LookAt(Camera->Position, Camera->Target, Camera->Up);
+    }
+    if (Camera->Dirty & CAMERA_PROJECTION_DIRTY)
+    {
+        Camera->Projection = Perspective(Camera->Fov, Camera->Aspect, Camera->NearPlane, Camera->FarPlane);
+    }
+    Camera->ViewProjection = Multiply(Camera->Projection, Camera->View);
+    Camera->Dirty = 0;
+
+    return true;
+}
+
+// Matches ObjectData in default.vert (std430).
+struct object_data
+{
+    mat4 Model;
+
+    // rgb: base colour
+    v4 Material;
+};
+
+struct object_buffer
+{
+    SDL_GPUBuffer *Buffer;
+    SDL_GPUTransferBuffer *TransferBuffer;
+
+    u32 Capacity;
+    u32 Count;
+    object_data *Objects;
+
+    // Objects in [DirtyStart, DirtyEnd) changed since the last upload.
+    u32 DirtyStart;
+    u32 DirtyEnd;
+};
+
+void InitObjectBuffer(object_buffer *Objects, u32 Capacity)
+{
+    *Objects = {};
+    Objects->Capacity = Capacity;
+    Objects->Objects = (object_data *) SDL_calloc(Capacity, sizeof(object_data));
+
+    SDL_GPUBufferCreateInfo BufferInfo = {};
+    BufferInfo.usage = SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ;
+    BufferInfo.size = sizeof(object_data) * Capacity;
+    Objects->Buffer = CreateGpuBuffer(&State.Resources, GpuCategory_Dynamic, "objects", &BufferInfo);
+
+    SDL_GPUTransferBufferCreateInfo TransferBufferInfo = {};
+    TransferBufferInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+    TransferBufferInfo.size = sizeof(object_data) * Capacity;
+    Objects->TransferBuffer = CreateGpuTransferBuffer(&State.Resources, "objects", &TransferBufferInfo);
+}
+
+void FreeObjectBuffer(object_buffer *Objects)
+{
+    ReleaseGpuResource(&State.Resources, Objects->TransferBuffer);
+    ReleaseGpuResource(&State.Resources, Objects->Buffer);
+    SDL_free(Objects->Objects);
+    *Objects = {};
+}
+
+inline void MarkObjectDirty(object_buffer *Objects, u32 Index)
+{
+    if (Objects->DirtyStart == Objects->DirtyEnd)
+    {
+        Objects->DirtyStart = Index;
+        Objects->DirtyEnd = Index + 1;
+    }
+    else
+    {
+        Objects->DirtyStart = SDL_min(Objects->DirtyStart, Index);
+        Objects->DirtyEnd = SDL_max(Objects->DirtyEnd, Index + 1);
+    }
+}
+
+// Returns the index the shader sees as gl_InstanceIndex.
+u32 AddObject(object_buffer *Objects, mat4 Model, v4 Material)
+{
+    assert(Objects->Count < Objects->Capacity);
+
+    u32 Index = Objects->Count++;
+    Objects->Objects[Index].Model = Model;
+    Objects->Objects[Index].Material = Material;
+    MarkObjectDirty(Objects, Index);
+
+    return Index;
+}
+
+void SetObjectModel(object_buffer *Objects, u32 Index, mat4 Model)
+{
+    Objects->Objects[Index].Model = Model;
+    MarkObjectDirty(Objects, Index);
+}
+
+void SetObjectMaterial(object_buffer *Objects, u32 Index, v4 Material)
+{
+    Objects->Objects[Index].Material = Material;
+    MarkObjectDirty(Objects, Index);
+}
+
+// Copies the dirty range to the GPU. Has to be recorded before the render
+// pass that reads the objects.
+void UploadObjects(object_buffer *Objects, SDL_GPUCommandBuffer *CommandBuffer)
+{
+    if (Objects->DirtyStart == Objects->DirtyEnd)
+    {
+        return;
+    }
+
+    u32 Offset = sizeof(object_data) * Objects->DirtyStart;
+    u32 Bytes = sizeof(object_data) * (Objects->DirtyEnd - Objects->DirtyStart);
+
+    // Cycling gives us a fresh transfer buffer if the last one is still in
+    // flight. Only the dirty range is written, and only that is copied.
+    u8 *TransferData = (u8 *) SDL_MapGPUTransferBuffer(State.Device, Objects->TransferBuffer, true);
+    SDL_memcpy(TransferData + Offset, Objects->Objects + Objects->DirtyStart, Bytes);
+    SDL_UnmapGPUTransferBuffer(State.Device, Objects->TransferBuffer);
+
+    SDL_GPUCopyPass *CopyPass = SDL_BeginGPUCopyPass(CommandBuffer);
+
+    SDL_GPUTransferBufferLocation Source = {};
+    Source.transfer_buffer = Objects->TransferBuffer;
+    Source.offset = Offset;
+
+    SDL_GPUBufferRegion Dest = {};
+    Dest.buffer = Objects->Buffer;
+    Dest.offset = Offset;
+    Dest.size = Bytes;
+
+    // NOTE: No cycling here, the objects outside the range have to stay.
+    SDL_UploadToGPUBuffer(CopyPass, &Source, &Dest, false);
+    SDL_EndGPUCopyPass(CopyPass);
+
+    Objects->DirtyStart = 0;
+    Objects->DirtyEnd = 0;
+}
@@ -0,0 +1,64 @@
+#define NOISE_SIZE 256
+
+void BakeNoise(u8 *NoiseData, u32 Seed)
+{
+    for (u32 X = 0; X < NOISE_SIZE; ++X)
+    {
+        for (u32 Y = 0; Y < NOISE_SIZE; ++Y)
+        {
+            f32 NoiseX = (f32) X / 256.0f * 16.0f;
+            f32 NoiseY = (f32) Y / 256.0f * 16.0f;
+            // NoiseData[X + 256 * Y] = stb_perlin_noise3(NoiseX, NoiseY, 0, 0, 0, 0);
+            // NOTE: stb_perlin only uses the low 8 bits of the seed
+            f32 NoiseSample = (stb_perlin_noise3_seed(NoiseX, NoiseY, 0, 256.0f / 16.0f, 256.0f / 16.0f, 0, Seed) + 1) / 2;
+            NoiseData[X + NOISE_SIZE * Y] = NoiseSample * 255;
+        }
+    }
+}
+
+// Same as sampling the noise texture with a linear, repeating sampler.
+f32 SampleNoise(u8 *NoiseData, f32 U, f32 V)
+{
+    f32 X = U * NOISE_SIZE - 0.5f;
+    f32 Y = V * NOISE_SIZE - 0.5f;
+    f32 FloorX = floorf(X);
+    f32 FloorY = floorf(Y);
+    f32 TX = X - FloorX;
+    f32 TY = Y - FloorY;
+
+    u32 X0 = (u32) (i32) FloorX & (NOISE_SIZE - 1);
+    u32 Y0 = (u32) (i32) FloorY & (NOISE_SIZE - 1);
+    u32 X1 = (X0 + 1) & (NOISE_SIZE - 1);
+    u32 Y1 = (Y0 + 1) & (NOISE_SIZE - 1);
+
+    f32 A = NoiseData[X0 + NOISE_SIZE * Y0];
+    f32 B = NoiseData[X1 + NOISE_SIZE * Y0];
+    f32 C = NoiseData[X0 + NOISE_SIZE * Y1];
+    f32 D = NoiseData[X1 + NOISE_SIZE * Y1];
+
+    f32 Top = A + (B - A) * TX;
+    f32 Bottom = C + (D - C) * TX;
+    return (Top + (Bottom - Top) * TY) / 255.0f;
+}
+
+// CPU version of the displacement in default.vert. Keep these in sync!
+f32 NoiseLayer(u8 *NoiseData, f32 X, f32 Z, f32 Time, f32 Value)
+{
+    f32 U = (X * 0.1f + Time * 0.01f) * Value;
+    f32 V = (Z * 0.1f + Time * 0.01f) * Value;
+    f32 NoiseSample = SampleNoise(NoiseData, U, V) * 2 - 1;
+    return 0.2f / Value * NoiseSample;
+}
+
+// OctaveCount has to match the vertex shader variant in use.
+f32 WaterHeight(u8 *NoiseData, u32 OctaveCount, f32 X, f32 Z, f32 Time)
+{
+    f32 Height = 0;
+    f32 Value = 1;
+    for (u32 Octave = 0; Octave < OctaveCount; ++Octave)
+    {
+        Height += NoiseLayer(NoiseData, X, Z, Time, Value);
+        Value *= 2;
+    }
+    return Height;
+}